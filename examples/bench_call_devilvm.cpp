@@ -0,0 +1,96 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include <hgl/devil/DevilVM.h>
+
+namespace
+{
+    // 旧方式：参数经由映射的全局变量传入，结果由脚本呼叫真实函数写回
+    int g_hp = 0;
+    int g_armor = 0;
+    int g_result = 0;
+
+    void set_result(int v) { g_result = v; }
+
+    const char *source =
+        "func int classify(int hp,int armor)\n"
+        "{\n"
+        "    if(hp<armor) return 1;\n"
+        "    if(hp==armor) return 2;\n"
+        "    return 3;\n"
+        "}\n"
+        "\n"
+        "func classify_global()\n"
+        "{\n"
+        "    if(g_hp<g_armor){ set_result(1); return; }\n"
+        "    if(g_hp==g_armor){ set_result(2); return; }\n"
+        "    set_result(3);\n"
+        "}\n"
+        "\n"
+        "func int outer(int hp,int armor)\n"
+        "{\n"
+        "    return classify(hp,armor);\n"
+        "}\n";
+}
+
+int main(int argc, char **argv)
+{
+    const int calls = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+
+    hgl::devil::Module module;
+
+    module.MapProperty("int g_hp", &g_hp);
+    module.MapProperty("int g_armor", &g_armor);
+    module.MapFunc("set_result", &set_result);
+
+    if(!module.AddScript(source))
+    {
+        std::cerr << "compile failed" << std::endl;
+        return 1;
+    }
+
+    hgl::devil::Context context(&module);
+
+    const hgl::devil::FuncHandle classify = module.GetFuncHandle("classify");
+    const hgl::devil::FuncHandle classify_global = module.GetFuncHandle("classify_global");
+    const hgl::devil::FuncHandle outer = module.GetFuncHandle("outer");
+
+    auto Bench = [&](auto &&call)
+    {
+        long long sum = 0;
+
+        const auto begin = std::chrono::steady_clock::now();
+
+        for(int i = 0; i < calls; i++)
+            sum += call(i & 7, (i >> 3) & 7);
+
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / calls;
+
+        return std::make_pair(ns, sum);
+    };
+
+    const auto global = Bench([&](int hp, int armor)
+    {
+        g_hp = hp;
+        g_armor = armor;
+        context.Start(classify_global);
+        return g_result;
+    });
+
+    const auto call = Bench([&](int hp, int armor) { return context.Call<int>(classify, hp, armor); });
+    const auto nested = Bench([&](int hp, int armor) { return context.Call<int>(outer, hp, armor); });
+
+    if(global.second != call.second || call.second != nested.second)
+    {
+        std::cerr << "results differ: " << global.second << " " << call.second << " " << nested.second << std::endl;
+        return 1;
+    }
+
+    std::cout << "calls: " << calls << std::endl;
+    std::cout << "globals + Start(FuncHandle) : " << global.first << " ns" << std::endl;
+    std::cout << "Call<int>(FuncHandle,a,b)   : " << call.first << " ns, x" << (global.first / call.first) << std::endl;
+    std::cout << "Call<int> -> script call    : " << nested.first << " ns" << std::endl;
+
+    return 0;
+}
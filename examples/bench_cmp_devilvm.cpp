@@ -0,0 +1,123 @@
+#include <chrono>
+#include <iostream>
+
+#include <hgl/devil/DevilVM.h>
+
+namespace
+{
+    int g_counter = 0;
+    int g_phase = 0;
+    int g_limit = 0;
+    float g_range = 0;
+
+    void Tick()
+    {
+        ++g_counter;
+        g_phase = g_counter & 3;
+        g_range = float(g_counter & 15);
+    }
+
+    int Threat() { return g_counter & 7; }
+
+    // AI脚本风格：每轮 tick 一次，其余全是各种操作数组合的 if
+    const char *script =
+        "func main()"
+        "{"
+        " int hp=0;"
+        " int armor=8;"
+        " float dist=0;"
+        " LOOP:   tick();"
+        "         hp=counter;"
+        "         dist=range;"
+        "         if(phase==0) goto A;"                  // 属性 - 常量
+        " A:      if(hp<armor) goto B;"                  // 局部 - 局部
+        " B:      if(dist>=4.5) goto C;"                 // 局部 - 常量
+        " C:      if(threat()==3) goto D;"               // 真实函数 - 常量
+        " D:      if(armor!=phase) goto E;"              // 局部 - 属性
+        " E:      if(range<dist) goto F;"                // 属性 - 局部
+        " F:      if(phase>=2) goto G;"
+        " G:      if(hp<limit) goto LOOP;"               // 局部 - 属性
+        "}";
+
+    double RunOnce(hgl::devil::Module &module, hgl::devil::DispatchMode mode)
+    {
+        hgl::devil::Context context(&module);
+
+        context.SetDispatchMode(mode);
+
+        g_counter = 0;
+        g_phase = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        if(!context.Start("main"))
+            return -1;
+
+        const auto stop = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double, std::milli>(stop - start).count();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_limit = (argc > 1) ? std::atoi(argv[1]) : 2000000;
+
+    hgl::devil::Module module;
+
+    if(!module.MapFunc("tick", &Tick)
+     ||!module.MapFunc("threat", &Threat)
+     ||!module.MapProperty("int counter", &g_counter)
+     ||!module.MapProperty("int phase", &g_phase)
+     ||!module.MapProperty("int limit", &g_limit)
+     ||!module.MapProperty("float range", &g_range))
+    {
+        std::cerr << "Map failed." << std::endl;
+        return 1;
+    }
+
+    if(!module.AddScript(script))
+    {
+        std::cerr << "AddScript failed." << std::endl;
+        return 1;
+    }
+
+    const struct
+    {
+        hgl::devil::DispatchMode mode;
+        const char *name;
+    }
+    modes[] =
+    {
+        { hgl::devil::ddmCommand,  "command (virtual comp)" },
+        { hgl::devil::ddmSwitch,   "bytecode switch       " },
+        { hgl::devil::ddmThreaded, "bytecode threaded     " },
+    };
+
+    std::cout << "loops: " << g_limit << ", 8 if per loop" << std::endl;
+
+    for(const auto &m : modes)
+    {
+        RunOnce(module, m.mode);                        // 预热
+
+        double best = 1e30;
+
+        for(int i = 0; i < 5; i++)
+        {
+            const double ms = RunOnce(module, m.mode);
+
+            if(ms < 0)
+            {
+                std::cerr << "Start failed." << std::endl;
+                return 1;
+            }
+
+            if(ms < best)
+                best = ms;
+        }
+
+        std::cout << m.name << ": " << best << " ms, " << (best * 1e6 / g_limit) << " ns/loop, counter=" << g_counter << std::endl;
+    }
+
+    return 0;
+}
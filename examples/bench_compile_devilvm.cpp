@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "bench_script_devilvm.h"
+
+int main(int argc, char **argv)
+{
+    const int func_count = (argc > 1) ? std::atoi(argv[1]) : 2000;
+    const int rounds = (argc > 2) ? std::atoi(argv[2]) : 5;
+
+    const std::string source = bench::RepeatChunk(bench::npc_chunk, func_count);
+
+    auto Compile = [&](hgl::devil::Module &module, int threads)
+    {
+        bench::BindNpc(module);
+        module.SetCompileThreads(threads);
+
+        return module.AddScript(source.c_str(), static_cast<int>(source.size()));
+    };
+
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+
+    const double serial = bench::BestMs(rounds, [&] { hgl::devil::Module module; return Compile(module, 1); });
+    const double parallel = bench::BestMs(rounds, [&] { hgl::devil::Module module; return Compile(module, 0); });
+
+    if(serial < 0 || parallel < 0)
+    {
+        std::cerr << "compile failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "functions: " << func_count << ", source: " << source.size() / 1024 << " KB, cores: " << cores << std::endl;
+    std::cout << "AddScript 1 thread  : " << serial << " ms (best of " << rounds << ")" << std::endl;
+    std::cout << "AddScript " << cores << " threads : " << parallel << " ms, x" << (serial / parallel) << std::endl;
+
+    // 单线程与多线程编译的运行结果都须与缺省设置编译的一致
+    {
+        hgl::devil::Module reference, one, all;
+
+        if(!bench::BindNpc(reference)
+         ||!reference.AddScript(source.c_str(), static_cast<int>(source.size()))
+         ||!Compile(one, 1)
+         ||!Compile(all, 0))
+        {
+            std::cerr << "compile failed" << std::endl;
+            return 1;
+        }
+
+        const std::string expected = bench::RunNpcSample(reference, func_count);
+
+        if(bench::RunNpcSample(one, func_count) != expected
+         ||bench::RunNpcSample(all, func_count) != expected)
+        {
+            std::cerr << "threaded compile result differs from AddScript" << std::endl;
+            return 1;
+        }
+    }
+
+    // 编译产物都在模块的Arena中，Clear时整块释放
+    {
+        hgl::devil::Module module;
+
+        bench::BindNpc(module);
+
+        if(!module.AddScript(source.c_str(), static_cast<int>(source.size())))
+            return 1;
+
+        size_t reserved = 0;
+        const size_t used = module.GetArenaBytes(&reserved);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        module.Clear();
+
+        const double clear_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "arena: " << used / 1024 << " KB used, " << reserved / 1024 << " KB reserved, Clear " << clear_ms << " ms" << std::endl;
+    }
+
+    return 0;
+}
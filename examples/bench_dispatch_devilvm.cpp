@@ -0,0 +1,106 @@
+#include <chrono>
+#include <iostream>
+
+#include <hgl/devil/DevilVM.h>
+
+namespace
+{
+    int g_counter = 0;
+    int g_phase = 0;
+    int g_limit = 0;
+
+    void Tick()
+    {
+        ++g_counter;
+        g_phase = g_counter & 1;
+    }
+
+    // goto_devilvm 风格的状态机：每轮 tick 一次，其余都是 label/goto/if 跳转
+    const char *script =
+        "func main()"
+        "{"
+        " IDLE:   tick();"
+        "         if(counter>=limit) goto DONE;"
+        "         goto PATROL;"
+        " PATROL: if(phase==0) goto CHASE; else goto ATTACK;"
+        " CHASE:  goto ATTACK;"
+        " ATTACK: goto IDLE;"
+        " DONE:;"
+        "}";
+
+    double RunOnce(hgl::devil::Module &module, hgl::devil::DispatchMode mode)
+    {
+        hgl::devil::Context context(&module);
+
+        context.SetDispatchMode(mode);
+
+        g_counter = 0;
+        g_phase = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        if(!context.Start("main"))
+            return -1;
+
+        const auto stop = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double, std::milli>(stop - start).count();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_limit = (argc > 1) ? std::atoi(argv[1]) : 5000000;
+
+    hgl::devil::Module module;
+
+    if(!module.MapFunc("tick", &Tick)
+     ||!module.MapProperty("int counter", &g_counter)
+     ||!module.MapProperty("int phase", &g_phase)
+     ||!module.MapProperty("int limit", &g_limit))
+    {
+        std::cerr << "Map failed." << std::endl;
+        return 1;
+    }
+
+    if(!module.AddScript(script))
+    {
+        std::cerr << "AddScript failed." << std::endl;
+        return 1;
+    }
+
+    const struct
+    {
+        hgl::devil::DispatchMode mode;
+        const char *name;
+    }
+    modes[] =
+    {
+        { hgl::devil::ddmCommand,  "command (virtual)" },
+        { hgl::devil::ddmSwitch,   "bytecode switch  " },
+        { hgl::devil::ddmThreaded, "bytecode threaded" },
+    };
+
+    double baseline = 0;
+
+    for(const auto &m : modes)
+    {
+        RunOnce(module, m.mode);                        // 预热
+
+        const double ms = RunOnce(module, m.mode);
+
+        if(ms < 0 || g_counter != g_limit)
+        {
+            std::cerr << m.name << ": script execution failed." << std::endl;
+            return 1;
+        }
+
+        if(baseline == 0)
+            baseline = ms;
+
+        std::cout << m.name << ": " << ms << " ms, "
+                  << (ms * 1e6 / g_limit) << " ns/loop, x" << (baseline / ms) << std::endl;
+    }
+
+    return 0;
+}
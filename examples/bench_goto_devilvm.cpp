@@ -0,0 +1,93 @@
+#include <chrono>
+#include <iostream>
+
+#include <hgl/devil/DevilVM.h>
+
+namespace
+{
+    int g_counter = 0;
+    int g_limit = 0;
+
+    void Tick() { ++g_counter; }
+
+    // 状态机风格：每个状态处理完后经过一串中转标识回到调度处
+    const char *script =
+        "func main()"
+        "{"
+        " DISPATCH: if(counter>=limit) goto DONE;"
+        "           tick();"
+        "           if(counter<limit) goto IDLE;"
+        "           goto NEXT;"
+        " IDLE:     goto WAIT;"
+        " WAIT:     goto NEXT;"
+        " NEXT:     goto DISPATCH;"
+        " DONE:     goto EXIT;"
+        " EXIT:     return;"
+        "}";
+
+    bool RunOnce(hgl::devil::Module &module, hgl::devil::DispatchMode mode, double &ms, uint64_t &retired)
+    {
+        hgl::devil::Context context(&module);
+
+        context.SetDispatchMode(mode);
+
+        g_counter = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        if(!context.Start("main"))
+            return false;
+
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        retired = context.GetRetiredCount();
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_limit = (argc > 1) ? std::atoi(argv[1]) : 2000000;
+
+    std::cout << "loops: " << g_limit << std::endl;
+
+    for(const bool optimize : { false, true })
+    {
+        hgl::devil::Module module;
+
+        module.SetOptimize(optimize);
+
+        if(!module.MapFunc("tick", &Tick)
+         ||!module.MapProperty("int counter", &g_counter)
+         ||!module.MapProperty("int limit", &g_limit)
+         ||!module.AddScript(script))
+        {
+            std::cerr << "AddScript failed." << std::endl;
+            return 1;
+        }
+
+        for(const auto mode : { hgl::devil::ddmSwitch, hgl::devil::ddmThreaded })
+        {
+            double best = 1e30, ms;
+            uint64_t retired = 0;
+
+            for(int i = 0; i < 5; i++)
+            {
+                if(!RunOnce(module, mode, ms, retired))
+                {
+                    std::cerr << "Start failed." << std::endl;
+                    return 1;
+                }
+
+                if(ms < best)
+                    best = ms;
+            }
+
+            std::cout << (optimize ? "optimized " : "original  ")
+                      << (mode == hgl::devil::ddmSwitch ? "switch  : " : "threaded: ")
+                      << best << " ms, " << (best * 1e6 / g_limit) << " ns/loop, "
+                      << (double(retired) / g_limit) << " instructions/loop" << std::endl;
+        }
+    }
+
+    return 0;
+}
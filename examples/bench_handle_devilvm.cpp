@@ -0,0 +1,85 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "bench_script_devilvm.h"
+
+namespace
+{
+    int counter = 0;
+
+    int tick() { return ++counter; }
+
+    // 函数体很短，每次启动的开销主要在查找函数与跳转标识上
+    const char *chunk =
+        "func npc_dialog_event_handler_%d()\n"
+        "{\n"
+        "           tick();\n"
+        " GREETING: tick();\n"
+        " FAREWELL: tick();\n"
+        "}\n"
+        "\n";
+}
+
+int main(int argc, char **argv)
+{
+    const int func_count = (argc > 1) ? std::atoi(argv[1]) : 2000;
+    const int calls = (argc > 2) ? std::atoi(argv[2]) : 1000000;
+
+    const std::string source = bench::RepeatChunk(chunk, func_count);
+
+    hgl::devil::Module module;
+
+    module.MapFunc("tick", &tick);
+
+    if(!module.AddScript(source.c_str(), static_cast<int>(source.size())))
+    {
+        std::cerr << "compile failed" << std::endl;
+        return 1;
+    }
+
+    hgl::devil::Context context(&module);
+
+    std::string name[16];
+    hgl::devil::FuncHandle func_handle[16];
+    hgl::devil::LabelHandle label_handle[16];
+
+    for(int i = 0; i < 16; i++)
+    {
+        name[i] = "npc_dialog_event_handler_" + std::to_string(i * func_count / 16);
+        func_handle[i] = module.GetFuncHandle(name[i]);
+        label_handle[i] = module.GetLabelHandle(func_handle[i], "FAREWELL");
+    }
+
+    auto Bench = [&](auto &&start)
+    {
+        counter = 0;
+
+        const auto begin = std::chrono::steady_clock::now();
+
+        for(int i = 0; i < calls; i++)
+            if(!start(i & 15))
+                return -1.0;
+
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / calls;
+    };
+
+    const double start_name = Bench([&](int i) { return context.Start(name[i].c_str()); });
+    const double start_handle = Bench([&](int i) { return context.Start(func_handle[i]); });
+    const double flag_name = Bench([&](int i) { return context.StartFlag(name[i].c_str(), "FAREWELL"); });
+    const double flag_handle = Bench([&](int i) { return context.StartFlag(label_handle[i]); });
+
+    if(start_name < 0 || start_handle < 0 || flag_name < 0 || flag_handle < 0)
+    {
+        std::cerr << "start failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "functions: " << func_count << ", starts: " << calls << std::endl;
+    std::cout << "Start(name)            : " << start_name << " ns" << std::endl;
+    std::cout << "Start(FuncHandle)      : " << start_handle << " ns, x" << (start_name / start_handle) << std::endl;
+    std::cout << "StartFlag(name,label)  : " << flag_name << " ns" << std::endl;
+    std::cout << "StartFlag(LabelHandle) : " << flag_handle << " ns, x" << (flag_name / flag_handle) << std::endl;
+
+    return 0;
+}
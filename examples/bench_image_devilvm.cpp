@@ -0,0 +1,103 @@
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "bench_script_devilvm.h"
+
+int main(int argc, char **argv)
+{
+    const int func_count = (argc > 1) ? std::atoi(argv[1]) : 2000;
+    const int rounds = (argc > 2) ? std::atoi(argv[2]) : 5;
+    const char *image_file = "bench_image_devilvm.img";
+    const char *cache_dir = "bench_image_devilvm.cache";
+
+    const std::string source = bench::RepeatChunk(bench::npc_chunk, func_count);
+
+    std::string expected;
+
+    {
+        hgl::devil::Module module;
+
+        if(!bench::BindNpc(module)
+         ||!module.AddScript(source.c_str(), static_cast<int>(source.size()))
+         ||!module.SaveImage(image_file))
+        {
+            std::cerr << "failed to build the module image" << std::endl;
+            return 1;
+        }
+
+        expected = bench::RunNpcSample(module, func_count);
+    }
+
+    const double compile = bench::BestMs(rounds, [&]
+    {
+        hgl::devil::Module module;
+
+        bench::BindNpc(module);
+
+        return module.AddScript(source.c_str(), static_cast<int>(source.size()));
+    });
+
+    const double load = bench::BestMs(rounds, [&]
+    {
+        hgl::devil::Module module;
+
+        bench::BindNpc(module);
+
+        return module.LoadImage(image_file);
+    });
+
+    const double cached = bench::BestMs(rounds, [&]
+    {
+        hgl::devil::Module module;
+
+        bench::BindNpc(module);
+
+        return module.SetCacheDirectory(cache_dir) && module.AddScript(source.c_str(), static_cast<int>(source.size()));
+    });
+
+    // 载入的映像与命中的编译缓存，运行结果都须与直接编译的一致
+    bool same = true;
+
+    {
+        hgl::devil::Module module;
+
+        bench::BindNpc(module);
+
+        if(!module.LoadImage(image_file) || bench::RunNpcSample(module, func_count) != expected)
+        {
+            std::cerr << "LoadImage result differs from AddScript" << std::endl;
+            same = false;
+        }
+    }
+
+    {
+        hgl::devil::Module module;
+
+        bench::BindNpc(module);
+
+        if(!module.SetCacheDirectory(cache_dir)
+         ||!module.AddScript(source.c_str(), static_cast<int>(source.size()))
+         ||bench::RunNpcSample(module, func_count) != expected)
+        {
+            std::cerr << "cached module result differs from AddScript" << std::endl;
+            same = false;
+        }
+    }
+
+    std::remove(image_file);
+    std::filesystem::remove_all(cache_dir);
+
+    if(compile < 0 || load < 0 || cached < 0)
+    {
+        std::cerr << "compile or image load failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "functions: " << func_count << ", source: " << source.size() / 1024 << " KB" << std::endl;
+    std::cout << "AddScript : " << compile << " ms (best of " << rounds << ")" << std::endl;
+    std::cout << "LoadImage : " << load << " ms, x" << (compile / load) << std::endl;
+    std::cout << "CacheHit  : " << cached << " ms, x" << (compile / cached) << " (first round compiles and fills the cache)" << std::endl;
+
+    return same ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <hgl/devil/DevilVM.h>
+
+namespace
+{
+    int g_counter = 0;
+    int g_limit = 0;
+
+    void Tick() { ++g_counter; }
+
+    // 每轮呼叫一次只有一条指令的小函数
+    const char *call_script =
+        "func step()"
+        "{"
+        " tick();"
+        "}"
+        "func main()"
+        "{"
+        " LOOP: if(counter>=limit) goto DONE;"
+        "       step();"
+        "       goto LOOP;"
+        " DONE: return;"
+        "}";
+
+    // 同样的循环，小函数的内容直接写在循环中，作为没有呼叫开销的基准
+    const char *manual_script =
+        "func main()"
+        "{"
+        " LOOP: if(counter>=limit) goto DONE;"
+        "       tick();"
+        "       goto LOOP;"
+        " DONE: return;"
+        "}";
+
+    struct Result
+    {
+        double ms;
+        uint64_t retired;
+    };
+
+    bool Measure(const char *script, uint32_t inline_limit, hgl::devil::DispatchMode mode, Result &result)
+    {
+        hgl::devil::Module module;
+
+        module.SetInlineLimit(inline_limit);
+
+        if(!module.MapFunc("tick", &Tick)
+         ||!module.MapProperty("int counter", &g_counter)
+         ||!module.MapProperty("int limit", &g_limit)
+         ||!module.AddScript(script))
+            return false;
+
+        hgl::devil::Context context(&module);
+
+        context.SetDispatchMode(mode);
+
+        result.ms = 1e30;
+
+        for(int i = 0; i < 5; i++)
+        {
+            g_counter = 0;
+
+            const auto start = std::chrono::steady_clock::now();
+
+            if(!context.Start("main"))
+                return false;
+
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            if(ms < result.ms)
+                result.ms = ms;
+
+            result.retired = context.GetRetiredCount();
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_limit = (argc > 1) ? std::atoi(argv[1]) : 2000000;
+
+    std::cout << "calls: " << g_limit << std::endl;
+    std::cout << "per-call cost = (call loop - hand-inlined loop) / calls" << std::endl;
+    std::cout << "retired instructions do not include the implicit return at the end of a function" << std::endl;
+
+    for(const auto mode : { hgl::devil::ddmSwitch, hgl::devil::ddmThreaded })
+    {
+        Result manual;
+
+        if(!Measure(manual_script, 0, mode, manual))
+        {
+            std::cerr << "run failed." << std::endl;
+            return 1;
+        }
+
+        for(const uint32_t limit : { 0u, hgl::devil::Module::DefaultInlineLimit })
+        {
+            Result call;
+
+            if(!Measure(call_script, limit, mode, call))
+            {
+                std::cerr << "run failed." << std::endl;
+                return 1;
+            }
+
+            std::cout << (mode == hgl::devil::ddmSwitch ? "switch  " : "threaded")
+                      << (limit ? " inline   : " : " call     : ")
+                      << ((call.ms - manual.ms) * 1e6 / g_limit) << " ns/call, "
+                      << (double(call.retired) - double(manual.retired)) / g_limit << " extra instructions/call"
+                      << std::endl;
+        }
+    }
+
+    return 0;
+}
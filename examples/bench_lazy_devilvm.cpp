@@ -0,0 +1,66 @@
+#include <iostream>
+#include <string>
+
+#include "bench_script_devilvm.h"
+
+int main(int argc, char **argv)
+{
+    const int func_count = (argc > 1) ? std::atoi(argv[1]) : 2000;
+    const int rounds = (argc > 2) ? std::atoi(argv[2]) : 5;
+
+    const std::string source = bench::RepeatChunk(bench::npc_chunk, func_count);
+
+    // 启动时编译全部函数，但只执行其中一个入口
+    auto StartOne = [&](bool lazy)
+    {
+        hgl::devil::Module module;
+
+        bench::BindNpc(module);
+        module.SetLazyCompile(lazy);
+
+        if(!module.AddScript(source.c_str(), static_cast<int>(source.size())))
+            return false;
+
+        bench::counter = 0;
+
+        hgl::devil::Context context(&module);
+
+        return context.Start("npc_update_7");
+    };
+
+    const double eager = bench::BestMs(rounds, [&] { return StartOne(false); });
+    const double lazy = bench::BestMs(rounds, [&] { return StartOne(true); });
+
+    if(eager < 0 || lazy < 0)
+    {
+        std::cerr << "compile or run failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "functions: " << func_count << ", source: " << source.size() / 1024 << " KB, one entry point executed" << std::endl;
+    std::cout << "eager AddScript+Start : " << eager << " ms (best of " << rounds << ")" << std::endl;
+    std::cout << "lazy  AddScript+Start : " << lazy << " ms, x" << (eager / lazy) << std::endl;
+
+    // 用到时才编译的函数，运行结果须与启动时全部编译的一致
+    {
+        hgl::devil::Module reference, module;
+
+        module.SetLazyCompile(true);
+
+        if(!bench::BindNpc(reference) || !bench::BindNpc(module)
+         ||!reference.AddScript(source.c_str(), static_cast<int>(source.size()))
+         ||!module.AddScript(source.c_str(), static_cast<int>(source.size())))
+        {
+            std::cerr << "compile failed" << std::endl;
+            return 1;
+        }
+
+        if(bench::RunNpcSample(module, func_count) != bench::RunNpcSample(reference, func_count))
+        {
+            std::cerr << "lazy compile result differs from AddScript" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
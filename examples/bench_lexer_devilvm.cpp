@@ -0,0 +1,130 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "DevilLexer.h"
+#include "bench_script_devilvm.h"
+
+namespace
+{
+    // 缩进、注释、字符串都比较多的脚本片段，接近实际项目中的脚本
+    const char *chunk =
+        "// ------------------------------------------------------------------\n"
+        "// state machine for npc %d, generated by the quest editor\n"
+        "// ------------------------------------------------------------------\n"
+        "func npc_update_%d()\n"
+        "{\n"
+        "    int hp = 100;                       // current hit points\n"
+        "    uint64 stamp = 6000000000;\n"
+        "    double ratio = 0.125;\n"
+        "\n"
+        "    /*\n"
+        "     * patrol until the player shows up, then chase and attack.\n"
+        "     * flee when hit points drop below the threshold.\n"
+        "     */\n"
+        "\n"
+        " IDLE:     tick();\n"
+        "           if(counter >= limit) goto DONE;\n"
+        "           if(phase == 0) goto CHASE; else goto ATTACK;\n"
+        "\n"
+        " CHASE:    move_to(player_x, player_y, 1.5f);\n"
+        "           hp = hp_of(self);\n"
+        "\n"
+        " ATTACK:   if(hp <= 10) goto FLEE;\n"
+        "           say(\"the npc attacks you with a rusty sword, \\\"watch out!\\\"\\n\");\n"
+        "           goto IDLE;\n"
+        "\n"
+        " FLEE:     if(distance != 0) goto IDLE;\n"
+        "           return;\n"
+        "\n"
+        " DONE:     ;\n"
+        "}\n"
+        "\n";
+
+    using namespace hgl::devil;
+
+    // 原先的做法：每次取一个token，空白与注释在循环中跳过
+    size_t LexLazy(const std::string &source)
+    {
+        asCTokenizer tokenizer;
+
+        const char *p = source.c_str();
+        hgl::uint left = static_cast<hgl::uint>(source.size());
+        size_t count = 0;
+
+        while(left > 0)
+        {
+            hgl::uint len;
+
+            const eTokenType type = tokenizer.GetToken(p, left, &len);
+
+            if(type <= ttEnd || len == 0 || len > left)
+                break;
+
+            p += len;
+            left -= len;
+
+            if(type > ttMultilineComment)
+                ++count;
+        }
+
+        return count;
+    }
+
+    size_t LexArray(const std::string &source, TokenList &tokens)
+    {
+        Tokenize(tokens, source.c_str(), static_cast<uint32_t>(source.size()));
+
+        return tokens.size() - 1;                       // 不计结尾的ttEnd
+    }
+
+    template<typename F>
+    double Best(const std::string &source, int rounds, size_t &count, F &&func)
+    {
+        double best = 0;
+
+        for(int r = 0; r < rounds; r++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            count = func();
+
+            const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const double mbs = double(source.size()) / (1024.0 * 1024.0) / sec;
+
+            if(mbs > best)
+                best = mbs;
+        }
+
+        return best;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const size_t target_bytes = size_t((argc > 1) ? std::atoi(argv[1]) : 16) * 1024 * 1024;
+    const int rounds = (argc > 2) ? std::atoi(argv[2]) : 5;
+
+    const std::string source = bench::RepeatChunkToSize(chunk, target_bytes);
+
+    TokenList tokens;
+
+    size_t lazy_count = 0, array_count = 0;
+
+    const double lazy = Best(source, rounds, lazy_count, [&] { return LexLazy(source); });
+    const double array = Best(source, rounds, array_count, [&] { return LexArray(source, tokens); });
+
+    std::cout << "source: " << source.size() / 1024 << " KB, tokens: " << array_count
+              << " (" << tokens.size() * sizeof(LexToken) / 1024 << " KB token array)" << std::endl;
+
+    std::cout << "lazy GetToken : " << lazy << " MB/s (best of " << rounds << ")" << std::endl;
+    std::cout << "Tokenize      : " << array << " MB/s, x" << (array / lazy) << std::endl;
+
+    if(lazy_count != array_count)
+    {
+        std::cerr << "token count mismatch: " << lazy_count << " vs " << array_count << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
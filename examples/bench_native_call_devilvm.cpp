@@ -0,0 +1,166 @@
+#include <chrono>
+#include <iostream>
+
+#include <hgl/devil/DevilVM.h>
+
+namespace
+{
+    int g_counter = 0;
+    int g_limit = 0;
+    int g_sum = 0;
+
+    void Step()
+    {
+        ++g_counter;
+    }
+
+    int Add3(int a, int b, int c)
+    {
+        g_sum += a + b + c;
+        return g_sum;
+    }
+
+    class Accumulator
+    {
+    public:
+
+        int total = 0;
+
+        void Add(int v)
+        {
+            total += v;
+        }
+    };
+
+    Accumulator g_acc;
+
+    // 每轮 5 次真实函数呼叫(含 2 次成员函数)，其余是一次比较跳转
+    const char *script =
+        "func main()"
+        "{"
+        " LOOP: add3(1,2,3);"
+        "       add3(4,5,6);"
+        "       acc_add(7);"
+        "       acc_add(8);"
+        "       step();"
+        "       if(counter<limit) goto LOOP;"
+        "}";
+
+    bool Setup(hgl::devil::Module &module)
+    {
+        return module.MapFunc("step", &Step)
+            && module.MapFunc("add3", &Add3)
+            && module.MapFunc("acc_add", &g_acc, &Accumulator::Add)
+            && module.MapProperty("int counter", &g_counter)
+            && module.MapProperty("int limit", &g_limit)
+            && module.AddScript(script);
+    }
+
+    // 以捕获了对象指针的lambda映射，模拟绑定到子系统实例的情况
+    bool SetupLambda(hgl::devil::Module &module)
+    {
+        int *counter = &g_counter;
+        int *sum = &g_sum;
+        Accumulator *acc = &g_acc;
+
+        return module.MapFunc("step", [counter]() { ++*counter; })
+            && module.MapFunc("add3", [sum](int a, int b, int c) { *sum += a + b + c; return *sum; })
+            && module.MapFunc("acc_add", [acc](int v) { acc->Add(v); })
+            && module.MapProperty("int counter", &g_counter)
+            && module.MapProperty("int limit", &g_limit)
+            && module.AddScript(script);
+    }
+
+    double RunOnce(hgl::devil::Module &module)
+    {
+        hgl::devil::Context context(&module);
+
+        g_counter = 0;
+        g_sum = 0;
+        g_acc.total = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        if(!context.Start("main"))
+            return -1;
+
+        const auto stop = std::chrono::steady_clock::now();
+
+        if(g_counter != g_limit || g_sum != 21 * g_limit || g_acc.total != 15 * g_limit)
+            return -1;
+
+        return std::chrono::duration<double, std::milli>(stop - start).count();
+    }
+
+    double Bench(hgl::devil::Module &module, const char *name, double baseline)
+    {
+        RunOnce(module);                                // 预热
+
+        const double ms = RunOnce(module);
+
+        if(ms < 0)
+        {
+            std::cerr << name << ": script execution failed." << std::endl;
+            return -1;
+        }
+
+        std::cout << name << ": " << ms << " ms, "
+                  << (ms * 1e6 / (g_limit * 5.0)) << " ns/call";
+
+        if(baseline > 0)
+            std::cout << ", x" << (baseline / ms);
+
+        std::cout << std::endl;
+        return ms;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_limit = (argc > 1) ? std::atoi(argv[1]) : 2000000;
+
+    hgl::devil::Module asm_module;
+
+    const bool has_asm = asm_module.SetNativeThunk(false);
+
+    double baseline = 0;
+
+    if(has_asm)
+    {
+        if(!Setup(asm_module))
+        {
+            std::cerr << "asm module setup failed." << std::endl;
+            return 1;
+        }
+
+        baseline = Bench(asm_module, "asm marshaller ", 0);
+
+        if(baseline < 0)
+            return 1;
+    }
+    else
+    {
+        std::cout << "asm marshaller : not available on this platform" << std::endl;
+    }
+
+    hgl::devil::Module thunk_module;
+
+    if(!Setup(thunk_module))
+    {
+        std::cerr << "thunk module setup failed." << std::endl;
+        return 1;
+    }
+
+    if(Bench(thunk_module, "typed thunk    ", baseline) < 0)
+        return 1;
+
+    hgl::devil::Module lambda_module;
+
+    if(!SetupLambda(lambda_module))
+    {
+        std::cerr << "lambda module setup failed." << std::endl;
+        return 1;
+    }
+
+    return Bench(lambda_module, "lambda thunk   ", baseline) < 0 ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench_script_devilvm.h"
+
+namespace
+{
+    int counter = 0;
+    int patched = 0;
+
+    void say(const char *) {}
+    int tick() { return ++counter; }
+    void mark() { ++patched; }
+
+    // 每段是一个独立的函数，npc_update_0会被反复热更新
+    const char *chunk =
+        "func npc_update_%d()\n"
+        "{\n"
+        "    int hp = 0;\n"
+        "\n"
+        " IDLE:     hp = tick();\n"
+        "           %s\n"
+        "           if(hp >= 2000000000) goto DONE;\n"
+        "           say(\"the npc attacks you with a rusty sword\");\n"
+        "           goto IDLE;\n"
+        " DONE:     ;\n"
+        "}\n"
+        "\n";
+
+    std::string MakeFunc(int index, bool patch)
+    {
+        return bench::FormatChunk(chunk, index, patch ? "mark();" : ";");
+    }
+
+    bool Bind(hgl::devil::Module &module)
+    {
+        return module.MapFunc("say", &say)
+            && module.MapFunc("tick", &tick)
+            && module.MapFunc("mark", &mark);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const int func_count = (argc > 1) ? std::atoi(argv[1]) : 2000;
+    const int context_count = (argc > 2) ? std::atoi(argv[2]) : 1000;
+    const int rounds = (argc > 3) ? std::atoi(argv[3]) : 20;
+
+    std::string source;
+
+    for(int i = 0; i < func_count; i++)
+        source += MakeFunc(i, false);
+
+    hgl::devil::Module module;
+
+    if(!Bind(module) || !module.AddScript(source.c_str(), static_cast<int>(source.size())))
+    {
+        std::cerr << "compile failed" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<hgl::devil::Context>> contexts;
+
+    // 全部Context停在npc_update_0的循环中，模拟正在运行的NPC
+    auto PrepareAll = [&]
+    {
+        for(auto &context : contexts)
+        {
+            if(!context->Prepare("npc_update_0"))
+                return false;
+
+            context->RunFor(5);
+        }
+
+        return true;
+    };
+
+    for(int i = 0; i < context_count; i++)
+        contexts.push_back(std::make_unique<hgl::devil::Context>(&module));
+
+    if(!PrepareAll())
+    {
+        std::cerr << "prepare failed" << std::endl;
+        return 1;
+    }
+
+    // 旧做法：清空模块重新编译全部脚本，再让所有Context重新开始
+    double rebuild_ms = 0;
+
+    for(int r = 0; r < rounds; r++)
+    {
+        const std::string patched_source = MakeFunc(0, r & 1) + source.substr(MakeFunc(0, false).size());
+
+        const auto start = std::chrono::steady_clock::now();
+
+        module.Clear();                 //保留真实函数映射，不需要重新映射
+
+        if(!module.AddScript(patched_source.c_str(), static_cast<int>(patched_source.size())) || !PrepareAll())
+        {
+            std::cerr << "rebuild failed" << std::endl;
+            return 1;
+        }
+
+        rebuild_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // 热更新：只替换一个函数，执行中的帧在下一次跳转时换到新版本
+    double reload_ms = 0;
+
+    for(int r = 0; r < rounds; r++)
+    {
+        const std::string patch = MakeFunc(0, (r & 1) || r == rounds - 1);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        if(!module.ReloadScript(patch.c_str(), static_cast<int>(patch.size())))
+        {
+            std::cerr << "reload failed" << std::endl;
+            return 1;
+        }
+
+        reload_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        for(auto &context : contexts)                                  // 各Context继续执行，离开旧版本
+            context->RunFor(10);
+    }
+
+    patched = 0;
+
+    for(auto &context : contexts)
+        context->RunFor(10);
+
+    const size_t reclaimed = module.ReclaimFunc();
+
+    std::cout << "functions: " << func_count << ", live contexts: " << context_count << std::endl;
+    std::cout << "Clear+AddScript+restart : " << rebuild_ms / rounds << " ms per patch" << std::endl;
+    std::cout << "ReloadScript            : " << reload_ms / rounds << " ms per patch, x" << (rebuild_ms / reload_ms) << std::endl;
+    std::cout << "contexts running patched body: " << (patched > 0 ? "yes" : "no") << ", reclaimed at end: " << reclaimed << std::endl;
+
+    return 0;
+}
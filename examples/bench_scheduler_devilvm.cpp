@@ -0,0 +1,96 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <memory>
+
+#include <hgl/devil/DevilVM.h>
+
+namespace
+{
+    int g_one = 1;
+
+    // 不会结束的状态机，每次tick每个Context执行固定数量的指令
+    const char *script =
+        "func main()"
+        "{"
+        " A: goto B;"
+        " B: if(one==1) goto C; else goto A;"
+        " C: goto D;"
+        " D: if(one!=1) goto C;"
+        "    goto A;"
+        "}";
+}
+
+int main(int argc, char **argv)
+{
+    const int context_count = (argc > 1) ? std::atoi(argv[1]) : 20000;
+    const int tick_count    = (argc > 2) ? std::atoi(argv[2]) : 20;
+    const int max_threads   = std::max(1u, std::thread::hardware_concurrency());
+
+    hgl::devil::Module module;
+
+    if(!module.MapProperty("int one", &g_one))
+    {
+        std::cerr << "MapProperty failed." << std::endl;
+        return 1;
+    }
+
+    if(!module.AddScript(script))
+    {
+        std::cerr << "AddScript failed." << std::endl;
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<hgl::devil::Context>> contexts;
+
+    contexts.reserve(context_count);
+
+    for(int i = 0; i < context_count; i++)
+        contexts.push_back(std::make_unique<hgl::devil::Context>(&module));
+
+    std::vector<int> thread_counts;
+
+    for(int threads = 1; threads < max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+
+    thread_counts.push_back(max_threads);               // 最后一轮使用全部核心
+
+    double single = 0;
+
+    for(const int threads : thread_counts)
+    {
+        hgl::devil::Scheduler scheduler(threads, 1024);
+
+        for(auto &c : contexts)
+        {
+            c->Prepare("main");
+            scheduler.Add(c.get());
+        }
+
+        uint64_t instructions = 0;
+        double seconds = 0;
+
+        for(int t = 0; t < tick_count; t++)
+        {
+            const hgl::devil::SchedulerStats &stats = scheduler.Tick();
+
+            if(stats.errors)
+            {
+                std::cerr << "Script execution failed." << std::endl;
+                return 1;
+            }
+
+            instructions += stats.instructions;
+            seconds += stats.seconds;
+        }
+
+        const double mips = instructions / seconds / 1e6;
+
+        if(threads == 1)
+            single = mips;
+
+        std::cout << threads << " thread(s): " << mips << " M instructions/s, x" << (mips / single) << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <hgl/devil/DevilVM.h>
+
+/**
+* 各性能测试共用的脚本生成、NPC状态机脚本与计时
+*/
+namespace bench
+{
+    // 按printf格式展开一段脚本片段
+    template<typename... Args>
+    std::string FormatChunk(const char *chunk, Args... args)
+    {
+        const int len = std::snprintf(nullptr, 0, chunk, args...);
+
+        if(len <= 0)
+            return std::string();
+
+        std::string text(len, '\0');
+
+        std::snprintf(text.data(), text.size() + 1, chunk, args...);
+
+        return text;
+    }
+
+    // 片段重复count次，其中的%d(最多两处)替换为片段编号
+    inline std::string RepeatChunk(const char *chunk, int count)
+    {
+        std::string source;
+
+        for(int i = 0; i < count; i++)
+            source += FormatChunk(chunk, i, i);
+
+        return source;
+    }
+
+    // 片段重复到至少bytes字节，其中的%d(最多两处)替换为片段编号
+    inline std::string RepeatChunkToSize(const char *chunk, size_t bytes)
+    {
+        std::string source;
+
+        source.reserve(bytes + 4096);
+
+        for(int i = 0; source.size() < bytes; i++)
+            source += FormatChunk(chunk, i, i);
+
+        return source;
+    }
+
+    // NPC状态机，每段是一个独立的函数
+    inline const char *npc_chunk =
+        "func npc_update_%d()\n"
+        "{\n"
+        "    int hp = 100;\n"
+        "    double r = 0.125;\n"
+        "\n"
+        " IDLE:     hp = tick();\n"
+        "           if(hp >= 1000) goto DONE;\n"
+        "           if(ratio < 0.25) goto FLEE; else goto CHASE;\n"
+        " CHASE:    move_to(1.5, 2.5, 1.0);\n"
+        "           say(\"the npc attacks you with a rusty sword\");\n"
+        "           goto IDLE;\n"
+        " FLEE:     if(r != 0.125) goto IDLE;\n"
+        "           say(\"the npc flees\");\n"
+        "           return;\n"
+        " DONE:     ;\n"
+        "}\n"
+        "\n";
+
+    inline int counter = 0;
+    inline int said = 0;
+    inline int moved = 0;
+    inline double ratio_value = 0.5;
+
+    inline void say(const char *) { ++said; }
+    inline int tick() { return ++counter; }
+    inline void move_to(float, float, float) { ++moved; }
+
+    inline bool BindNpc(hgl::devil::Module &module)
+    {
+        return module.MapFunc("say", &say)
+            && module.MapFunc("tick", &tick)
+            && module.MapFunc("move_to", &move_to)
+            && module.MapProperty("double ratio", &ratio_value);
+    }
+
+    // 运行一部分NPC函数(追击与逃跑两条路径)，把真实函数被呼叫的次数汇总成字符串，用于比较不同方式得到的模块行为是否一致
+    inline std::string RunNpcSample(hgl::devil::Module &module, int func_count)
+    {
+        std::string result;
+
+        hgl::devil::Context context(&module);
+
+        for(const double ratio : { 0.5, 0.1 })
+        {
+            ratio_value = ratio;
+
+            for(int i = 0; i < func_count; i += std::max(1, func_count / 16))
+            {
+                counter = said = moved = 0;
+
+                const bool ok = context.Start(("npc_update_" + std::to_string(i)).c_str());
+
+                result += FormatChunk("%d:%d/%d/%d/%d ", i, ok ? 1 : 0, counter, said, moved);
+            }
+        }
+
+        ratio_value = 0.5;
+        return result;
+    }
+
+    template<typename F>
+    double BestMs(int rounds, F &&func)
+    {
+        double best = 1e30;
+
+        for(int r = 0; r < rounds; r++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            if(!func())
+                return -1;
+
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            if(ms < best)
+                best = ms;
+        }
+
+        return best;
+    }
+}//namespace bench
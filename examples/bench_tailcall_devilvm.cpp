@@ -0,0 +1,99 @@
+#include <chrono>
+#include <iostream>
+
+#include <hgl/devil/DevilVM.h>
+
+namespace
+{
+    int g_counter = 0;
+    int g_limit = 0;
+    uint32_t g_max_depth = 0;
+
+    hgl::devil::Context *g_context = nullptr;
+
+    void Tick()
+    {
+        ++g_counter;
+
+        if(g_context->GetCallDepth() > g_max_depth)
+            g_max_depth = g_context->GetCallDepth();
+    }
+
+    // 状态处理函数一个接一个地呼叫下一个状态，呼叫都在尾位置
+    const char *script =
+        "func state_a(){ tick(); if(counter>=limit) return; state_b(); }"
+        "func state_b(){ tick(); state_c(); }"
+        "func state_c(){ tick(); state_a(); }";
+
+    bool RunOnce(hgl::devil::Module &module, hgl::devil::DispatchMode mode, double &ms)
+    {
+        hgl::devil::Context context(&module);
+
+        g_context = &context;
+
+        context.SetDispatchMode(mode);
+
+        if(!context.SetMaxCallDepth(g_limit + 16))          //未消除尾呼叫时每个状态压入一层
+            return false;
+
+        g_counter = 0;
+        g_max_depth = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        if(!context.Start("state_a"))
+            return false;
+
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_limit = (argc > 1) ? std::atoi(argv[1]) : 300000;
+
+    std::cout << "states: " << g_limit << std::endl;
+
+    for(const bool optimize : { false, true })
+    {
+        hgl::devil::Module module;
+
+        module.SetOptimize(optimize);
+        module.SetInlineLimit(0);                           //只比较尾呼叫
+
+        if(!module.MapFunc("tick", &Tick)
+         ||!module.MapProperty("int counter", &g_counter)
+         ||!module.MapProperty("int limit", &g_limit)
+         ||!module.AddScript(script))
+        {
+            std::cerr << "AddScript failed." << std::endl;
+            return 1;
+        }
+
+        for(const auto mode : { hgl::devil::ddmSwitch, hgl::devil::ddmThreaded })
+        {
+            double best = 1e30, ms;
+
+            for(int i = 0; i < 5; i++)
+            {
+                if(!RunOnce(module, mode, ms))
+                {
+                    std::cerr << "Start failed." << std::endl;
+                    return 1;
+                }
+
+                if(ms < best)
+                    best = ms;
+            }
+
+            std::cout << (optimize ? "tail call " : "original  ")
+                      << (mode == hgl::devil::ddmSwitch ? "switch  : " : "threaded: ")
+                      << best << " ms, " << (best * 1e6 / g_counter) << " ns/state, "
+                      << "max call depth " << g_max_depth
+                      << ", static depth " << module.GetCallDepth("state_a") << std::endl;
+        }
+    }
+
+    return 0;
+}
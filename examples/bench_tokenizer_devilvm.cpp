@@ -0,0 +1,75 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "as_tokenizer.h"
+#include "bench_script_devilvm.h"
+
+namespace
+{
+    // 有代表性的脚本片段：关键字、标识符、运算符、数值、字符串与注释混合
+    const char *chunk =
+        "// state machine for one npc\n"
+        "func npc_update_%d()\n"
+        "{\n"
+        "    int hp = 100;\n"
+        "    uint64 stamp = 6000000000;\n"
+        "    double ratio = 0.125;\n"
+        "    /* patrol until the player shows up */\n"
+        " IDLE:   tick(); if(counter>=limit) goto DONE;\n"
+        "         if(phase==0) goto CHASE; else goto ATTACK;\n"
+        " CHASE:  move_to(player_x, player_y, 1.5f); hp = hp_of(self);\n"
+        " ATTACK: if(hp <= 10) goto FLEE; say(\"attack!\\n\"); goto IDLE;\n"
+        " FLEE:   if(distance != 0) goto IDLE; return;\n"
+        " DONE:;\n"
+        "}\n";
+}
+
+int main(int argc, char **argv)
+{
+    const size_t target_bytes = size_t((argc > 1) ? std::atoi(argv[1]) : 16) * 1024 * 1024;
+    const int rounds = (argc > 2) ? std::atoi(argv[2]) : 5;
+
+    const std::string source = bench::RepeatChunkToSize(chunk, target_bytes);
+
+    angle_script::asCTokenizer tokenizer;
+
+    double best = 0;
+    size_t token_count = 0;
+
+    for(int r = 0; r < rounds; r++)
+    {
+        const char *p = source.c_str();
+        hgl::uint left = static_cast<hgl::uint>(source.size());
+        size_t count = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        while(left > 0)
+        {
+            hgl::uint len;
+
+            tokenizer.GetToken(p, left, &len);
+
+            if(len == 0 || len > left)
+                break;
+
+            p += len;
+            left -= len;
+            ++count;
+        }
+
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double mbs = double(source.size()) / (1024.0 * 1024.0) / sec;
+
+        if(mbs > best)
+            best = mbs;
+
+        token_count = count;
+    }
+
+    std::cout << "source: " << source.size() / 1024 << " KB, tokens: " << token_count << std::endl;
+    std::cout << "tokenizer: " << best << " MB/s (best of " << rounds << ")" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <hgl/devil/DevilVM.h>
+
+namespace
+{
+    std::string g_log;
+    int g_value = 0;
+    int g_other = 0;
+    hgl::devil::Context *g_context = nullptr;
+
+    void Say(int v) { g_log += std::to_string(v) + "|"; }
+    void IncValue() { ++g_value; }
+    void IncOther() { ++g_other; }
+    void PauseMe() { g_context->Pause(); }
+
+    // 覆盖展开后需要修正的各种情况：提前返回、分支、函数内循环、暂停、嵌套、递归与不能展开的函数
+    const char *script =
+        "func h1(){ say(1); }"
+        "func h2(){ if(value>2) return; say(2); inc_value(); }"
+        "func h3(){ if(other==0){ say(30); } else { say(31); } inc_other(); }"
+        "func h4(){ LOOP: if(value>=5) goto END; inc_value(); goto LOOP; END: say(4); }"
+        "func hp(){ say(7); pause_me(); say(8); }"
+        "func nest(){ h1(); h2(); }"
+        "func big(){ say(1); say(2); say(3); say(4); say(5); say(6); say(7); say(8); say(9); say(10); }"
+        "func rec(){ inc_value(); if(value<3) rec(); }"
+        "func int typed(){ return 5; }"
+        "func with_param(int a){ if(a==1) say(50); }"
+        "func tail(){ say(60); h1(); }"
+        "func main(){ h1(); h2(); h2(); h3(); h3(); AGAIN: h2(); h4(); nest(); big(); rec(); typed(); with_param(1); tail(); if(value<9) goto AGAIN; say(99); }"
+        "func pause_main(){ h1(); hp(); h1(); }"
+        "func user_flag(){ h1(); ENTRY: h1(); }";
+
+    // 热更新被展开的函数，展开处需要转到新版本
+    const char *reload_script =
+        "func h1(){ say(111); }"
+        "func h2(){ say(222); }";
+
+    struct Entry
+    {
+        const char *func;
+        const char *flag;
+    };
+
+    const Entry entries[] =
+    {
+        { "main", nullptr },
+        { "pause_main", nullptr },
+        { "nest", nullptr },
+        { "tail", nullptr },
+        { "user_flag", nullptr },
+        { "user_flag", "ENTRY" },
+    };
+
+    const char *mode_name[] = { "command", "switch", "threaded" };
+
+    bool Bind(hgl::devil::Module &module)
+    {
+        return module.MapFunc("say", &Say)
+            && module.MapFunc("inc_value", &IncValue)
+            && module.MapFunc("inc_other", &IncOther)
+            && module.MapFunc("pause_me", &PauseMe)
+            && module.MapProperty("int value", &g_value)
+            && module.MapProperty("int other", &g_other);
+    }
+
+    // 运行一次，把可观察的结果(真实函数记录与属性值)写成一个字符串
+    std::string Run(hgl::devil::Module &module, hgl::devil::DispatchMode mode, const Entry &entry)
+    {
+        hgl::devil::Context context(&module);
+
+        g_context = &context;
+        context.SetDispatchMode(mode);
+
+        g_log.clear();
+        g_value = 0;
+        g_other = 0;
+
+        const bool started = entry.flag ? context.StartFlag(entry.func, entry.flag) : context.Start(entry.func);
+
+        while(context.GetState() == hgl::devil::dvsPause)
+        {
+            g_log += "pause|";
+            context.Run();
+        }
+
+        g_context = nullptr;
+
+        return std::string(started ? "ok " : "failed ") + g_log
+             + " value=" + std::to_string(g_value)
+             + " other=" + std::to_string(g_other);
+    }
+
+    int Compare(const char *stage, hgl::devil::Module &inlined, hgl::devil::Module &plain, hgl::devil::DispatchMode mode)
+    {
+        int bad = 0;
+
+        for(const Entry &entry : entries)
+        {
+            const std::string a = Run(inlined, mode, entry);
+            const std::string b = Run(plain, mode, entry);
+
+            if(a == b)
+                continue;
+
+            std::cout << "[" << mode_name[mode] << "] " << stage << " " << entry.func
+                      << (entry.flag ? std::string(":") + entry.flag : std::string()) << " differs" << std::endl
+                      << "    inline:    " << a << std::endl
+                      << "    no inline: " << b << std::endl;
+            ++bad;
+        }
+
+        return bad;
+    }
+}
+
+int main()
+{
+    int bad = 0;
+
+    for(const auto mode : { hgl::devil::ddmCommand, hgl::devil::ddmSwitch, hgl::devil::ddmThreaded })
+    {
+        hgl::devil::Module inlined;
+        hgl::devil::Module plain;
+
+        plain.SetInlineLimit(0);
+
+        if(!Bind(inlined) || !Bind(plain)
+         ||!inlined.AddScript(script) || !plain.AddScript(script))
+        {
+            std::cerr << "compile failed." << std::endl;
+            return 1;
+        }
+
+        bad += Compare("compiled", inlined, plain, mode);
+
+        if(!inlined.ReloadScript(reload_script) || !plain.ReloadScript(reload_script))
+        {
+            std::cerr << "reload failed." << std::endl;
+            return 1;
+        }
+
+        bad += Compare("reloaded", inlined, plain, mode);
+    }
+
+    if(bad)
+    {
+        std::cout << bad << " difference(s) between inline and no inline." << std::endl;
+        return 1;
+    }
+
+    std::cout << "inline and no inline results match." << std::endl;
+    return 0;
+}
@@ -1,19 +1,98 @@
 #pragma once
 
 #include <stdarg.h>
+#include <atomic>
 #include <cstdint>
+#include <chrono>
 #include <string>
 #include <vector>
+#include <memory>
+#include <type_traits>
 #include <hgl/log/Log.h>
+#include <hgl/devil/DevilModule.h>
 
 namespace hgl::devil
 {
     class Module;
     class Func;
+    struct FuncHandle;
+    struct LabelHandle;
+    struct CallArg;
     class ScriptFuncCall;
+    class InlineCall;
     class Goto;
     class CompGoto;
     class Return;
+    class ReturnValue;
+
+    enum class OperandKind:uint8_t;
+    template<OperandKind,typename> struct CmpOperand;
+
+    namespace detail
+    {
+        /**
+        * 宿主与脚本函数之间传递的一个参数或返回值
+        */
+        struct ScriptArg
+        {
+            BindType type;
+
+            union
+            {
+                int64_t     i;                                                  //有符号整数
+                uint64_t    u;                                                  //无符号整数与bool
+                double      d;                                                  //浮点数
+                const char *str;                                                //字符串
+            };
+
+            template<typename T>
+            static ScriptArg From(T value)
+            {
+                ScriptArg arg;
+
+                arg.type=BindTypeOf<T>();
+
+                if constexpr(std::is_pointer_v<T>)
+                    arg.str=value;
+                else
+                if constexpr(std::is_floating_point_v<T>)
+                    arg.d=value;
+                else
+                if constexpr(std::is_signed_v<T>)
+                    arg.i=value;
+                else
+                    arg.u=value;
+
+                return arg;
+            }
+
+            template<typename T>
+            T To()const
+            {
+                if constexpr(std::is_void_v<T>)
+                    return;
+                else
+                if constexpr(std::is_pointer_v<T>)
+                    return(type==BindType::String?const_cast<T>(str):nullptr);
+                else
+                switch(type)
+                {
+                    case BindType::Void:
+                    case BindType::String:  return T();
+
+                    case BindType::Float:
+                    case BindType::Double:  return static_cast<T>(d);
+
+                    case BindType::Int:
+                    case BindType::Int8:
+                    case BindType::Int16:
+                    case BindType::Int64:   return static_cast<T>(i);
+
+                    default:                return static_cast<T>(u);
+                }
+            }
+        };//struct ScriptArg
+    }//namespace detail
 
     /**
     * 虚拟机状态
@@ -25,15 +104,27 @@ namespace hgl::devil
         dvsStop,    //停止
     };//enum VMState
 
+    /**
+    * 指令分派方式
+    */
+    enum DispatchMode
+    {
+        ddmCommand,     //Command树虚函数调用(参考实现)
+        ddmSwitch,      //连续字节码switch分派
+        ddmThreaded,    //连续字节码直接线索分派(需GCC/Clang及DEVIL_VM_THREADED_DISPATCH，否则同ddmSwitch)
+    };//enum DispatchMode
+
     struct ScriptFuncRunState
     {
         Func *func;         //函数指针
 
         int index;          //运行到的指令编号
 
+        uint32_t frame;     //局部变量帧在帧栈中的字节偏移
+
         bool operator==(const ScriptFuncRunState &other) const
         {
-            return func == other.func && index == other.index;
+            return func == other.func && index == other.index && frame == other.frame;
         }
     };//struct ScriptFuncRunState
 
@@ -46,23 +137,73 @@ namespace hgl::devil
 
         Module *module;
 
+        friend class Module;
         friend class ScriptFuncCall;
+        friend class InlineCall;
         friend class Goto;
         friend class CompGoto;
         friend class Return;
+        friend class ReturnValue;
+        template<typename T> friend class ScriptValue;
+        template<typename T> friend class ValueScriptCall;
+        template<typename T> friend class ScriptValueEqu;
+        template<OperandKind,typename> friend struct CmpOperand;
 
     private:
 
-        std::vector<ScriptFuncRunState>                 run_state;  //运行状态
-        ScriptFuncRunState *                            cur_state;  //当前状态
+        std::unique_ptr<ScriptFuncRunState[]>           run_state;      //呼叫堆栈，按最大呼叫深度预先分配，运行期间不再分配
+        uint32_t                                        run_depth;      //当前呼叫深度
+        uint32_t                                        max_call_depth; //最大呼叫深度
+        ScriptFuncRunState *                            cur_state;      //当前状态
+
+        std::vector<uint64_t>                           frame_stack;    //局部变量帧栈，每次函数呼叫在顶部压入一帧
+        uint32_t                                        frame_top;      //帧栈顶部的字节偏移
+
+        uint32_t                                        stop_depth;     //呼叫堆栈退回到此深度时运行结束，嵌套呼叫时为呼叫前的深度
+        uint64_t                                        return_value;   //最近一次带返回值的return所写入的值(按函数的返回类型存放)
+
+        uint8_t *GetLocalFrame()                                        //取得当前函数的局部变量帧
+        {
+            return reinterpret_cast<uint8_t *>(frame_stack.data())+cur_state->frame;
+        }
+
         void ClearStack();                                          //清空运行堆栈
-        bool RunContext();                                          //运行
+        bool RunContext(uint64_t budget=UINT64_MAX);                //运行，最多执行budget条指令
+        bool RunCommand();                                          //以Command树运行
+        bool RunBytecode();                                         //以字节码运行
+        bool RunThreaded();                                         //以字节码直接线索方式运行
+        bool RunError();                                            //报告当前指令运行错误
+        bool BudgetOut();                                           //指令预算用完
+
+        uint64_t                                        run_budget;     //剩余指令预算
+        uint64_t                                        retired_count;  //最近一次运行执行的指令数
+        uint64_t                                        budget_overrun; //运行中重入的宿主呼叫超出剩余预算的指令数，计入retired_count
+        bool                                            budget_out;     //最近一次运行是否因为指令预算用完而暂停
+
+        DispatchMode                                    dispatch_mode;  //指令分派方式
 
         bool Start(Func *,const va_list &);
 
+    private:    //热更新
+
+        class EpochScope;                                           //公开方法中持有函数引用期间的纪元保护
+
+        std::atomic<uint64_t>                           pin_epoch;      //本Context可能引用的函数至少在此纪元时还未被替换，UINT64_MAX表示从未进入过
+        uint32_t                                        pin_depth;      //EpochScope嵌套层数
+
+        void EnterEpoch();
+        void LeaveEpoch();
+        bool RemapFrame(int);                                       //当前函数已被替换时，将跳转换到新版本的同名跳转标识
+
     private:    //内部方法
 
-        void ScriptFuncCall(Func *);
+        bool ScriptFuncCall(Func *,const uint64_t *arg_value=nullptr);     //压入函数，arg_value为已按参数类型转换好的参数
+        bool ScriptFuncCall(Func *,const CallArg *,uint32_t);       //在当前函数中求出参数后压入函数
+        bool ScriptFuncTailCall(Func *,const CallArg *,uint32_t);   //在当前函数中求出参数后以被呼叫函数替换当前函数
+        bool CallFunc(Func *,const uint64_t *,uint64_t budget);     //在当前呼叫堆栈之上呼叫函数并运行到它返回，最多执行budget条指令
+        bool CallFunc(Func *,const CallArg *,uint32_t);             //量中的呼叫，使用外层剩余的指令预算
+        bool RunFunc(Func *,const uint64_t *);                      //呼叫堆栈为空时宿主的呼叫，不保存呼叫前的状态
+        bool EnterFunc(Func *);                                     //清空呼叫堆栈并进入指定函数
         bool Goto(Func *,int);
         bool Goto(Func *);
         bool Return();
@@ -71,26 +212,49 @@ namespace hgl::devil
 
         VMState State;                                              ///<虚拟机状态
 
+    public:
+
+        static constexpr uint32_t DefaultMaxCallDepth=128;                      ///<缺省最大呼叫深度
+
     public:
 
         explicit Context(Module *dm=nullptr)
-            : module(dm), cur_state(nullptr), State(dvsStop)
+            : module(nullptr), run_state(std::make_unique<ScriptFuncRunState[]>(DefaultMaxCallDepth)), run_depth(0), max_call_depth(DefaultMaxCallDepth), cur_state(nullptr), frame_top(0), stop_depth(0), return_value(0), run_budget(0), retired_count(0), budget_overrun(0), budget_out(false), dispatch_mode(ddmSwitch), pin_epoch(UINT64_MAX), pin_depth(0), State(dvsStop)
         {
+            SetModule(dm);
         }
 
-        virtual ~Context()=default;
+        virtual ~Context();
 
-        void SetModule(Module *dm)
-        {
-            module=dm;
-        }
+        void SetModule(Module *);                                               ///<设置使用的模块(模块借此得知哪些Context可能引用旧版本函数)
+
+        void SetDispatchMode(DispatchMode dm){dispatch_mode=dm;}                ///<设置指令分派方式
+        DispatchMode GetDispatchMode()const{return dispatch_mode;}              ///<取得指令分派方式
+
+        bool SetMaxCallDepth(uint32_t,uint32_t frame_bytes=0);                  ///<设置最大呼叫深度并预分配呼叫堆栈与局部变量帧栈(frame_bytes为0表示按模块中最大的帧估算)
+        bool SetMaxCallDepth(const char *);                                     ///<按从指定函数开始的呼叫图静态分析结果设置最大呼叫深度，存在递归时失败
+        uint32_t GetMaxCallDepth()const{return max_call_depth;}                 ///<取得最大呼叫深度
+        uint32_t GetCallDepth()const{return run_depth;}                         ///<取得当前呼叫深度
 
         virtual bool Start(Func *,...);
         virtual bool Start(const char *);
         virtual bool Start(const char *,const char *);                        ///<开始运行虚拟机
         virtual bool StartFlag(Func *,const char *);
         virtual bool StartFlag(const char *,const char *);
+
+        virtual bool Start(const FuncHandle &);                               ///<以句柄开始运行，不做字符串查找
+        virtual bool StartFlag(const LabelHandle &);                          ///<以句柄从函数的指定跳转标识开始运行
+        virtual bool Prepare(const FuncHandle &);                             ///<以句柄准备运行，但不执行
+        virtual bool Goto(const LabelHandle &);                               ///<以句柄跳转到当前函数的指定位置，句柄须属于当前函数
         virtual bool Run(const char *func_name=0);                            ///<运行虚拟机，如Start或End状态则从开始运行，Pause状态会继续运行
+        virtual bool Prepare(const char *);                                  ///<准备从指定函数开始运行，但不执行
+        virtual bool RunFor(uint64_t);                                       ///<最多执行指定数量的指令，预算用完时以暂停状态返回
+        virtual bool RunUntil(const std::chrono::steady_clock::time_point &,uint32_t slice=1024);   ///<运行到结束/暂停或到达截止时间
+
+        VMState GetState()const{return State;}                                ///<取得虚拟机状态
+        bool IsBudgetExhausted()const{return State==dvsPause&&budget_out;}    ///<最近一次暂停是否因为指令预算用完
+        uint64_t GetRetiredCount()const{return retired_count;}                ///<最近一次运行所执行的指令数
+
         virtual void Pause();                                                ///<暂停虚拟机，仅能从Run状态变为Pause，其它情况会失败
         virtual void Stop();                                                 ///<终止虚拟机，从任何状况变为Start状态
 
@@ -99,6 +263,26 @@ namespace hgl::devil
 
         virtual bool GetCurrentState(std::string &,int &);                   ///<取得当前状态
 
+        bool Invoke(const FuncHandle &,const detail::ScriptArg *,uint32_t,detail::ScriptArg *result=nullptr);  ///<呼叫脚本函数并运行到它返回，参数按声明的类型转换
+
+        /**
+        * 以句柄呼叫脚本函数并取得返回值，如ctx.Call<int>(handle,a,b)<br>
+        * 在当前呼叫堆栈之上运行，不清空堆栈也不影响暂停中的脚本，可以在脚本呼叫的真实函数中重入<br>
+        * 被呼叫的函数中途暂停时放弃执行
+        * @return 函数的返回值，失败时返回R()
+        */
+        template<typename R=void,typename... Args>
+        R Call(const FuncHandle &handle,Args... args)
+        {
+            const detail::ScriptArg arg[sizeof...(Args)+1]={detail::ScriptArg::From(args)...};
+            detail::ScriptArg result;
+
+            if(!Invoke(handle,arg,sizeof...(Args),&result))
+                return R();
+
+            return result.To<R>();
+        }
+
         virtual bool SaveState(std::vector<uint8_t> &);                      ///<保存状态(字节)
         virtual bool LoadState(const std::vector<uint8_t> &);                ///<加载状态(字节)
     };//class Context
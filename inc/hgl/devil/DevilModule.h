@@ -1,11 +1,18 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <atomic>
 #include <list>
+#include <mutex>
+#include <vector>
 #include <cstdint>
 #include <cstring>
 #include <initializer_list>
 #include <type_traits>
+#include <utility>
+#include <new>
+#include <cstddef>
 #include <ankerl/unordered_dense.h>
 #include <hgl/log/Log.h>
 #include <hgl/platform/compiler/EventFunc.h>
@@ -24,7 +31,10 @@ namespace hgl::devil
             UInt,
             UInt8,
             UInt16,
+            Int64,
+            UInt64,
             Float,
+            Double,
             String
         };
 
@@ -47,7 +57,12 @@ namespace hgl::devil
         template<> struct BindTypeTraits<unsigned int>  { static constexpr BindType value = BindType::UInt; };
         template<> struct BindTypeTraits<std::uint8_t>  { static constexpr BindType value = BindType::UInt8; };
         template<> struct BindTypeTraits<std::uint16_t> { static constexpr BindType value = BindType::UInt16; };
+        template<> struct BindTypeTraits<long long>             { static constexpr BindType value = BindType::Int64; };
+        template<> struct BindTypeTraits<unsigned long long>    { static constexpr BindType value = BindType::UInt64; };
+        template<> struct BindTypeTraits<long>                  { static constexpr BindType value = sizeof(long)==8?BindType::Int64:BindType::Int; };     //int64_t在LP64下是long
+        template<> struct BindTypeTraits<unsigned long>         { static constexpr BindType value = sizeof(long)==8?BindType::UInt64:BindType::UInt; };
         template<> struct BindTypeTraits<float>         { static constexpr BindType value = BindType::Float; };
+        template<> struct BindTypeTraits<double>        { static constexpr BindType value = BindType::Double; };
         template<> struct BindTypeTraits<char *>        { static constexpr BindType value = BindType::String; };
         template<> struct BindTypeTraits<const char *>  { static constexpr BindType value = BindType::String; };
 
@@ -56,10 +71,227 @@ namespace hgl::devil
         {
             return BindTypeTraits<std::decay_t<T>>::value;
         }
+
+        constexpr size_t NativeArgStride=8;                                     ///<脚本传给真实函数的每个参数所占字节数
+
+        template<typename T> struct NativeArgStorage        { using type=T; };  //解析器写入参数时使用的类型，小于int的整数按int/uint写入
+        template<> struct NativeArgStorage<std::int8_t>     { using type=int; };
+        template<> struct NativeArgStorage<std::int16_t>    { using type=int; };
+        template<> struct NativeArgStorage<std::uint8_t>    { using type=unsigned int; };
+        template<> struct NativeArgStorage<std::uint16_t>   { using type=unsigned int; };
+
+        template<typename T>
+        T LoadNativeArg(const void *args,size_t index)
+        {
+            using S=typename NativeArgStorage<std::decay_t<T>>::type;
+
+            S value;
+
+            std::memcpy(&value,static_cast<const char *>(args)+index*NativeArgStride,sizeof(S));
+
+            return static_cast<T>(value);
+        }
+
+        template<typename R>
+        void StoreNativeResult(void *result,R value)
+        {
+            if constexpr(std::is_pointer_v<R>)
+                *static_cast<void **>(result)=const_cast<void *>(static_cast<const void *>(value));
+            else
+                *static_cast<R *>(result)=value;
+        }
+
+        template<typename R,typename F,typename... Args,size_t... I>
+        void InvokeNative(F &call,const void *args,void *result,std::index_sequence<I...>)
+        {
+            if constexpr(std::is_void_v<R>)
+                call(LoadNativeArg<Args>(args,I)...);
+            else
+                StoreNativeResult<R>(result,call(LoadNativeArg<Args>(args,I)...));
+        }
+
+        constexpr size_t NativeCallableSize=64;                                 ///<可呼叫对象内联保存的最大字节数(足以放下常见实现的std::function)
+
+        /**
+        * 映射函数所保存的可呼叫对象<br>
+        * 不超过NativeCallableSize的对象直接构造在内部缓冲区中，不产生堆分配；更大的对象才在堆上分配
+        */
+        class NativeCallable
+        {
+            alignas(std::max_align_t) unsigned char storage[NativeCallableSize];
+
+            void (*relocate)(void *,void *)=nullptr;                            //移动到目标缓冲区并析构原对象，为nullptr表示没有对象
+            void (*destroy)(void *)=nullptr;
+
+            template<typename T>
+            static constexpr bool IsInline=sizeof(T)<=NativeCallableSize
+                                         &&alignof(T)<=alignof(std::max_align_t)
+                                         &&std::is_nothrow_move_constructible_v<T>;
+
+            void MoveFrom(NativeCallable &other)
+            {
+                if(other.relocate)
+                    other.relocate(storage,other.storage);
+
+                relocate=other.relocate;
+                destroy=other.destroy;
+
+                other.relocate=nullptr;
+                other.destroy=nullptr;
+            }
+
+        public:
+
+            NativeCallable()=default;
+            NativeCallable(const NativeCallable &)=delete;
+            NativeCallable &operator=(const NativeCallable &)=delete;
+
+            NativeCallable(NativeCallable &&other) noexcept{MoveFrom(other);}
+
+            NativeCallable &operator=(NativeCallable &&other) noexcept
+            {
+                if(this!=&other)
+                {
+                    Reset();
+                    MoveFrom(other);
+                }
+
+                return *this;
+            }
+
+            ~NativeCallable(){Reset();}
+
+            void Reset()
+            {
+                if(relocate)
+                    destroy(storage);
+
+                relocate=nullptr;
+                destroy=nullptr;
+            }
+
+            bool IsEmpty()const{return !relocate;}
+
+            template<typename F>
+            void Emplace(F &&f)
+            {
+                using T=std::decay_t<F>;
+
+                Reset();
+
+                if constexpr(IsInline<T>)
+                {
+                    new(storage) T(std::forward<F>(f));
+
+                    relocate=[](void *dst,void *src){T *obj=static_cast<T *>(src);new(dst) T(std::move(*obj));obj->~T();};
+                    destroy =[](void *obj){static_cast<T *>(obj)->~T();};
+                }
+                else
+                {
+                    new(storage) T *(new T(std::forward<F>(f)));
+
+                    relocate=[](void *dst,void *src){new(dst) T *(*static_cast<T **>(src));};
+                    destroy =[](void *obj){delete *static_cast<T **>(obj);};
+                }
+            }
+
+            template<typename T>
+            T &Get()
+            {
+                if constexpr(IsInline<T>)
+                    return *std::launder(reinterpret_cast<T *>(storage));
+                else
+                    return **std::launder(reinterpret_cast<T **>(storage));
+            }
+        };//class NativeCallable
+
+        /**
+        * 按函数签名与可呼叫对象类型生成的真实函数呼叫入口，直接按类型取出参数并呼叫，不依赖具体的调用约定<br>
+        * T在编译期已知，对象的operator()可以被内联，呼叫时只有一次经由thunk指针的间接跳转
+        */
+        template<typename T,typename R,typename... Args>
+        bool CallableThunk(NativeCallable &callable,const void *args,void *result)
+        {
+            InvokeNative<R,T,Args...>(callable.Get<T>(),args,result,std::index_sequence_for<Args...>{});
+            return(true);
+        }
+
+        template<typename C,typename M,typename R,typename... Args>
+        struct MethodCall                                                       //成员函数呼叫对象
+        {
+            C *object;
+            M method;
+
+            R operator()(Args... a)const{return (object->*method)(a...);}
+        };
+
+        template<typename M>
+        void *MethodAddress(M method)                                           //取得成员函数地址供汇编呼叫使用，无法用一个指针表示时返回nullptr
+        {
+            void *address=nullptr;
+
+            if constexpr(sizeof(M)==sizeof(void *))
+                std::memcpy(&address,&method,sizeof(address));
+
+            return address;
+        }
+
+        template<typename> struct CallableSignature;                           //由operator()取得可呼叫对象的返回值与参数类型
+
+        template<typename C,typename R,typename... Args> struct CallableSignature<R (C::*)(Args...)>                { using pointer=R (*)(Args...); };
+        template<typename C,typename R,typename... Args> struct CallableSignature<R (C::*)(Args...) const>          { using pointer=R (*)(Args...); };
+        template<typename C,typename R,typename... Args> struct CallableSignature<R (C::*)(Args...) noexcept>       { using pointer=R (*)(Args...); };
+        template<typename C,typename R,typename... Args> struct CallableSignature<R (C::*)(Args...) const noexcept> { using pointer=R (*)(Args...); };
     }//namespace detail
 
+    using NativeThunk=bool (*)(detail::NativeCallable &,const void *args,void *result);    ///<真实函数呼叫入口
+
+    /**
+     * 名字表用的透明哈希，可直接用std::string_view查找，不必为查找构造std::string
+     */
+    struct StringHash
+    {
+        using is_transparent=void;
+        using is_avalanching=void;
+
+        uint64_t operator()(std::string_view str)const noexcept
+        {
+            return ankerl::unordered_dense::hash<std::string_view>{}(str);
+        }
+    };//struct StringHash
+
+    template<typename V> using StringMap=ankerl::unordered_dense::map<std::string,V,StringHash,std::equal_to<>>;    ///<以名字为键的表
+
+    /**
+    * 脚本函数句柄<br>
+    * 由Module::GetFuncHandle解析一次后，按编号直接取得函数，不再做字符串查找。热更新后依然有效(指向最新版本)，Module::Clear后失效
+    */
+    struct FuncHandle
+    {
+        uint32_t index=UINT32_MAX;                                              ///<函数在模块中的编号
+        uint32_t generation=0;                                                  ///<解析时模块的Clear次数
+
+        bool IsValid()const{return index!=UINT32_MAX;}
+    };//struct FuncHandle
+
+    /**
+    * 跳转标识句柄<br>
+    * 同一函数的各个热更新版本共用跳转标识编号，新版本中删除了的标识跳转时失败
+    */
+    struct LabelHandle
+    {
+        FuncHandle func;
+        uint32_t label=UINT32_MAX;                                              ///<跳转标识在函数中的编号
+
+        bool IsValid()const{return func.IsValid()&&label!=UINT32_MAX;}
+    };//struct LabelHandle
+
     class Func;
     class EnumDef;
+    class ModuleImage;
+    class Arena;
+    class Parse;
+    class Context;
     struct PropertyMap;
     struct FuncMap;
 
@@ -70,14 +302,78 @@ namespace hgl::devil
     {
         OBJECT_LOGGER
 
-        ankerl::unordered_dense::map<std::string,PropertyMap *>   prop_map;       //属性映射表
-        ankerl::unordered_dense::map<std::string,FuncMap *>       func_map;       //函数映射表
-        ankerl::unordered_dense::map<std::string,Func *>          script_func;    //脚本函数表
-        ankerl::unordered_dense::map<std::string,EnumDef *>       enum_map;       //枚举映射表
+        StringMap<PropertyMap *>  prop_map;       //属性映射表
+        StringMap<FuncMap *>      func_map;       //函数映射表
+        StringMap<Func *>         script_func;    //脚本函数表
+        StringMap<EnumDef *>      enum_map;       //枚举映射表
+
+        bool native_thunk;                                                      //映射函数时是否使用按签名生成的呼叫入口
+
+        std::list<ModuleImage *> image_list;                                    //已载入的模块映像，其中的脚本函数直接引用映像数据
+        std::list<Arena *> arena_list;                                          //存放脚本函数的指令、量、比较式、参数块与字符串常量，每次编译或载入产生一到数个
+
+        std::string cache_path;                                                 //编译缓存目录，为空表示不使用缓存
+        uint64_t cache_max_bytes;                                               //编译缓存目录的容量上限
+
+        bool lazy_compile;                                                      //AddScript是否只索引函数，到首次用到时才编译
+        bool lazy_compiling;                                                    //正在处理延迟编译队列
+        std::vector<Func *> lazy_queue;                                         //待编译的延迟编译函数
+
+        int compile_threads;                                                    //编译函数体所用的线程数，0表示按CPU核心数
+        bool optimize;                                                          //编译函数体后是否做常量折叠、跳转重定向、死代码消除与尾呼叫消除
+        uint32_t inline_limit;                                                  //展开呼叫的脚本函数的最大指令数，0表示不展开
+        std::mutex compile_lock;                                                //多线程编译时保护模块中的脚本函数查找(可能触发延迟编译)
+        mutable std::recursive_mutex lazy_lock;                                 //保护延迟编译队列与Arena表，编译中查找呼叫的函数时在同一线程重入
+
+        friend class Context;
+
+        std::atomic<uint64_t> reload_epoch;                                     //热更新纪元，每次替换函数后递增
+        std::mutex reload_lock;                                                 //同一时间只允许一个热更新
+        std::mutex context_lock;
+        std::vector<Context *> context_list;                                    //使用本模块的Context，回收旧函数体时检查它们的纪元
+        std::vector<std::pair<Func *,uint64_t>> retired_list;                   //已被替换、等待回收函数体的旧版本及其被替换时的纪元
+
+        struct FuncSlot                                                         //句柄所指的函数
+        {
+            Func *func;                                                         //第一个版本，经GetLatest取得最新版本
+            StringMap<uint32_t> label_id;                                       //各版本中出现过的跳转标识的编号
+        };
+
+        std::vector<FuncSlot> func_slot_list;                                   //以FuncHandle::index为下标，函数只增不减，Clear时清空
+        uint32_t handle_generation;                                             //Clear次数，用于识别Clear之前解析的句柄
 
     private:
 
-        bool _MapFuncTyped(const char *,void *,void *,detail::BindType,std::initializer_list<detail::BindType>);
+        bool DeclareScript(Parse &,StringMap<Func *> &,std::vector<Func *> &,std::vector<size_t> &,bool);
+        bool IndexScript(const char *,int);
+        bool CompileLazyFunc();
+        bool CompileScripts(const std::vector<std::string_view> &,std::vector<std::vector<Func *>> &,bool=false);
+        Func *PrepareFunc(Func *);
+
+        void AddFuncSlot(Func *);
+        void IndexLabels(Func *);
+
+        void AttachContext(Context *);
+        void DetachContext(Context *);
+
+        bool LoadImage(ModuleImage *);
+        bool SaveImage(const std::vector<Func *> &,std::vector<uint8_t> &);
+
+        std::string GetCacheFilename(const char *,int);
+        bool LoadCache(const std::string &);
+        void SaveCache(const std::string &,const std::vector<Func *> &);
+
+        bool _MapFuncTyped(const char *,void *,void *,NativeThunk,detail::NativeCallable &&,detail::BindType,std::initializer_list<detail::BindType>);
+
+        template<typename T,typename F,typename R,typename... Args>
+        bool _MapCallable(const char *name,F &&func,R (*)(Args...))
+        {
+            detail::NativeCallable callable;
+
+            callable.Emplace(std::forward<F>(func));
+
+            return _MapFuncTyped(name,nullptr,nullptr,&detail::CallableThunk<T,R,Args...>,std::move(callable),detail::BindTypeOf<R>(),{detail::BindTypeOf<Args>()...});
+        }
 
     public: //事件
 
@@ -85,53 +381,110 @@ namespace hgl::devil
 
     public:
 
-        std::list<std::string> string_list;                           //字符串列表
+        static constexpr uint64_t DefaultCacheBytes=64*1024*1024;              ///<编译缓存目录的缺省容量上限
 
     public:
 
-        Module(){OnTrueFuncCall=nullptr;}
-        virtual ~Module()=default;
+        Module(){OnTrueFuncCall=nullptr;native_thunk=true;cache_max_bytes=DefaultCacheBytes;lazy_compile=false;lazy_compiling=false;compile_threads=0;optimize=true;inline_limit=DefaultInlineLimit;reload_epoch=0;handle_generation=0;}
+        virtual ~Module();
+
+        Func *GetScriptFunc(std::string_view);
+        Func *GetScriptFunc(const FuncHandle &);                                ///<按句柄取得脚本函数的最新版本，句柄无效时返回nullptr且不输出日志
+
+        FuncHandle GetFuncHandle(std::string_view);                             ///<解析脚本函数句柄，没有此函数时返回无效句柄
+        LabelHandle GetLabelHandle(const FuncHandle &,std::string_view);        ///<解析跳转标识句柄，函数中没有此标识时返回无效句柄
+        LabelHandle GetLabelHandle(std::string_view func_name,std::string_view label){return GetLabelHandle(GetFuncHandle(func_name),label);}
+        bool IsValid(const FuncHandle &)const;                                  ///<句柄是否仍可使用(Clear后失效)
+        bool IsValid(const LabelHandle &);                                      ///<跳转标识在函数的最新版本中是否仍然存在
+        FuncMap *GetFuncMap(std::string_view);
+        PropertyMap *GetPropertyMap(std::string_view);
+
+        int GetCallDepth(std::string_view,uint32_t *frame_bytes=nullptr);   ///<静态分析从指定脚本函数开始的最大呼叫深度，存在递归或函数不存在时返回-1
+        uint32_t GetMaxFrameSize()const;                                        ///<取得所有脚本函数中最大的局部变量帧字节数
+
+        size_t GetArenaBytes(size_t *reserved_bytes=nullptr)const;             ///<取得编译产物占用的字节数，reserved_bytes返回实际申请的内存字节数
+
+        bool SetNativeThunk(bool);                                              ///<之后映射的函数是否使用按签名生成的呼叫入口(缺省使用)，为false时使用汇编呼叫，平台不支持汇编呼叫时失败
+        bool GetNativeThunk()const{return native_thunk;}
+
+        void SetLazyCompile(bool use){lazy_compile=use;}                       ///<之后AddScript是否只索引函数名与函数体范围，函数在首次被GetScriptFunc取得时才编译
+        bool GetLazyCompile()const{return lazy_compile;}
+
+        void SetCompileThreads(int count){compile_threads=(count<0?0:count);}  ///<设置编译函数体所用的线程数，0表示按CPU核心数(缺省)，1表示单线程
+        int GetCompileThreads()const{return compile_threads;}
+
+        void SetOptimize(bool use){optimize=use;}                              ///<之后编译的函数体是否做常量折叠、跳转重定向、死代码消除与尾呼叫消除(缺省做，关闭后呼叫堆栈保留每一级呼叫)
+        bool GetOptimize()const{return optimize;}
 
-        Func *GetScriptFunc(const std::string &);
-        FuncMap *GetFuncMap(const std::string &);
-        PropertyMap *GetPropertyMap(const std::string &);
+        static constexpr uint32_t DefaultInlineLimit=8;                         ///<缺省展开的最大指令数
+
+        void SetInlineLimit(uint32_t count){inline_limit=count;}               ///<之后编译的函数中，呼叫的无参数、无局部变量、无返回值且不超过count条指令的脚本函数就地展开(展开处仍保留一条检查热更新的指令)，0表示不展开
+        uint32_t GetInlineLimit()const{return inline_limit;}
 
         virtual bool MapProperty(const char *,void *);                         ///<映射属性(真实变量的映射，在整个模块中全局有效)
+
         template<typename R,typename... Args>
-        bool MapFunc(const char *name,R (*func)(Args...))
+        bool MapFunc(const char *name,R (*func)(Args...))                      ///<映射C函数
         {
-            return _MapFuncTyped(name,nullptr,reinterpret_cast<void *>(func),detail::BindTypeOf<R>(),{detail::BindTypeOf<Args>()...});
+            detail::NativeCallable callable;
+
+            callable.Emplace(func);
+
+            return _MapFuncTyped(name,nullptr,reinterpret_cast<void *>(func),&detail::CallableThunk<R (*)(Args...),R,Args...>,std::move(callable),detail::BindTypeOf<R>(),{detail::BindTypeOf<Args>()...});
         }
 
         template<typename C,typename R,typename... Args>
-        bool MapFunc(const char *name,C *instance,R (C::*func)(Args...))
+        bool MapFunc(const char *name,C *instance,R (C::*func)(Args...))       ///<映射C++成员函数
         {
-            void *func_ptr=nullptr;
+            using Call=detail::MethodCall<C,decltype(func),R,Args...>;
 
-            static_assert(sizeof(func)==sizeof(func_ptr),"DevilScript MapFunc: member function pointer ABI is not supported.");
+            detail::NativeCallable callable;
 
-            std::memcpy(&func_ptr,&func,sizeof(func_ptr));
+            callable.Emplace(Call{instance,func});
 
-            return _MapFuncTyped(name,instance,func_ptr,detail::BindTypeOf<R>(),{detail::BindTypeOf<Args>()...});
+            return _MapFuncTyped(name,instance,detail::MethodAddress(func),&detail::CallableThunk<Call,R,Args...>,std::move(callable),detail::BindTypeOf<R>(),{detail::BindTypeOf<Args>()...});
         }
 
         template<typename C,typename R,typename... Args>
         bool MapFunc(const char *name,const C *instance,R (C::*func)(Args...) const)
         {
-            void *func_ptr=nullptr;
+            using Call=detail::MethodCall<const C,decltype(func),R,Args...>;
 
-            static_assert(sizeof(func)==sizeof(func_ptr),"DevilScript MapFunc: member function pointer ABI is not supported.");
+            detail::NativeCallable callable;
 
-            std::memcpy(&func_ptr,&func,sizeof(func_ptr));
+            callable.Emplace(Call{instance,func});
 
-            return _MapFuncTyped(name,const_cast<C *>(instance),func_ptr,detail::BindTypeOf<R>(),{detail::BindTypeOf<Args>()...});
+            return _MapFuncTyped(name,const_cast<C *>(instance),detail::MethodAddress(func),&detail::CallableThunk<Call,R,Args...>,std::move(callable),detail::BindTypeOf<R>(),{detail::BindTypeOf<Args>()...});
+        }
+
+        /**
+        * 映射任意可呼叫对象(lambda、std::function、仿函数)，对象被移动/复制到映射中保存
+        */
+        template<typename F,typename=std::enable_if_t<std::is_class_v<std::decay_t<F>>>>
+        bool MapFunc(const char *name,F &&func)
+        {
+            using T=std::decay_t<F>;
+
+            return _MapCallable<T>(name,std::forward<F>(func),static_cast<typename detail::CallableSignature<decltype(&T::operator())>::pointer>(nullptr));
         }
 
         virtual bool AddScript(const char *,int=-1);                           ///<添加脚本并编译
+        virtual bool AddScripts(const std::vector<std::string_view> &);         ///<添加多个脚本一起编译，脚本之间可以互相呼叫
+
+        virtual bool ReloadScript(const char *,int=-1);                        ///<热更新：以脚本中的函数替换同名的已有函数，运行中的Context无需停止
+        size_t ReclaimFunc();                                                   ///<释放已不被任何Context引用的旧版本函数体，返回释放的个数
 
         virtual bool AddEnum(const char *,EnumDef *);
 
-        virtual void Clear();                                                  ///<清除所有模块和映射
+        virtual bool SaveImage(std::vector<uint8_t> &);                        ///<将已编译的脚本函数保存为模块映像
+        virtual bool SaveImage(const char *);                                  ///<将已编译的脚本函数保存为模块映像文件
+        virtual bool LoadImage(const void *,size_t);                           ///<从内存载入模块映像(数据会被复制)
+        virtual bool LoadImage(const char *);                                  ///<以文件映射方式载入模块映像
+
+        bool SetCacheDirectory(const char *,uint64_t max_bytes=DefaultCacheBytes); ///<设置AddScript使用的编译缓存目录，nullptr表示关闭缓存
+        const std::string &GetCacheDirectory()const{return cache_path;}
+
+        virtual void Clear();                                                  ///<清除所有脚本函数与编译产物，使用本模块的Context全部停止(映射保留)
 
     public: //调试用函数
 
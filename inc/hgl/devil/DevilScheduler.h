@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <hgl/log/Log.h>
+
+namespace hgl::devil
+{
+    class Context;
+
+    /**
+    * 调度器单次tick的统计
+    */
+    struct SchedulerStats
+    {
+        uint64_t contexts       =0;     ///<本次运行的Context数量
+        uint64_t instructions   =0;     ///<本次执行的指令总数
+        uint64_t finished       =0;     ///<本次运行结束(进入dvsStop)的Context数量
+        uint64_t errors         =0;     ///<本次运行出错的Context数量
+        uint64_t steals         =0;     ///<本次工作窃取的次数
+        double   seconds        =0;     ///<本次耗时(秒)
+
+        double InstructionsPerSecond()const{return seconds>0?double(instructions)/seconds:0;}
+    };//struct SchedulerStats
+
+    /**
+    * 多线程工作窃取调度器<br>
+    * 持有一组Context，每次Tick将它们分到各工作线程的队列中，每个Context最多执行slice条指令。
+    * 自己队列空了的线程会从其它线程的队列窃取。<br>
+    * 处于dvsStop的Context和被宿主暂停(非指令预算用完)的Context不会被运行。<br>
+    * 同一Module可被多个线程上的Context共用，运行期间不会写入Module；映射的真实函数与属性需由宿主保证线程安全。
+    */
+    class Scheduler
+    {
+        OBJECT_LOGGER
+
+        struct Worker;
+
+        std::vector<Context *>                  context_list;
+        std::vector<std::unique_ptr<Worker>>    worker_list;
+
+        uint64_t                                slice;                  //每个Context每次tick最多执行的指令数
+
+        std::mutex                              tick_lock;
+        std::condition_variable                 tick_start;
+        std::condition_variable                 tick_done;
+        uint64_t                                tick_serial;            //tick序号，工作线程据此判断是否有新的tick
+        int                                     busy_workers;           //尚未完成本次tick的工作线程数量
+        bool                                    quit;
+
+        SchedulerStats                          stats;
+
+    private:
+
+        void WorkerProc(int);
+        void RunWorker(int,SchedulerStats &);
+        bool PopLocal(int,Context *&);
+        bool Steal(int,Context *&);
+
+    public:
+
+        explicit Scheduler(int thread_count=0,uint64_t slice=1024);      ///<thread_count为0表示使用全部硬件线程
+        ~Scheduler();
+
+        bool Add(Context *);                                            ///<增加一个Context
+        bool Remove(Context *);                                         ///<移除一个Context
+        void Clear();                                                   ///<移除所有Context
+
+        int GetThreadCount()const{return static_cast<int>(worker_list.size());}
+        int GetContextCount()const{return static_cast<int>(context_list.size());}
+
+        void SetSlice(uint64_t s){slice=(s?s:1);}                       ///<设置每个Context每次tick最多执行的指令数
+        uint64_t GetSlice()const{return slice;}
+
+        const SchedulerStats &Tick();                                   ///<运行一次所有Context，返回本次统计
+        const SchedulerStats &GetStats()const{return stats;}            ///<取得最近一次tick的统计
+    };//class Scheduler
+}//namespace hgl::devil
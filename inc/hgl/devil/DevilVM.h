@@ -3,6 +3,7 @@
 #include <hgl/devil/VM.h>
 #include <hgl/devil/DevilModule.h>
 #include <hgl/devil/DevilContext.h>
+#include <hgl/devil/DevilScheduler.h>
 
 namespace hgl::devil
 {
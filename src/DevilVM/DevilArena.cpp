@@ -0,0 +1,82 @@
+#include"DevilArena.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace hgl::devil
+{
+    namespace
+    {
+        constexpr size_t BlockHeaderSize=(sizeof(void *)*2+alignof(std::max_align_t)-1)/alignof(std::max_align_t)*alignof(std::max_align_t);
+    }//namespace
+
+    Arena::Arena()
+    {
+        block_list=nullptr;
+        cur=nullptr;
+        end=nullptr;
+        next_block_size=MinBlockSize;
+        used_bytes=0;
+        reserved_bytes=0;
+        block_count=0;
+        func_count=0;
+    }
+
+    /**
+    * 当前块放不下时申请新块，新块成为当前块，旧块剩余的空间不再使用
+    */
+    void *Arena::AllocBlock(size_t size,size_t align)
+    {
+        const size_t need=BlockHeaderSize+size+align;
+        const size_t block_size=std::max(need,next_block_size);
+
+        Block *block=static_cast<Block *>(std::malloc(block_size));
+
+        if(!block)
+            throw std::bad_alloc();
+
+        block->next=block_list;
+        block->size=block_size;
+        block_list=block;
+
+        cur=reinterpret_cast<uint8_t *>(block)+BlockHeaderSize;
+        end=reinterpret_cast<uint8_t *>(block)+block_size;
+
+        reserved_bytes+=block_size;
+        ++block_count;
+
+        if(next_block_size<MaxBlockSize)
+            next_block_size=std::min(next_block_size*2,MaxBlockSize);
+
+        return Alloc(size,align);
+    }
+
+    std::string_view Arena::CopyString(std::string_view str)
+    {
+        char *text=static_cast<char *>(Alloc(str.size()+1,1));
+
+        if(!str.empty())
+            memcpy(text,str.data(),str.size());
+
+        text[str.size()]=0;
+        return std::string_view(text,str.size());
+    }
+
+    void Arena::Clear()
+    {
+        while(block_list)
+        {
+            Block *next=block_list->next;
+
+            std::free(block_list);
+            block_list=next;
+        }
+
+        cur=nullptr;
+        end=nullptr;
+        next_block_size=MinBlockSize;
+        used_bytes=0;
+        reserved_bytes=0;
+        block_count=0;
+    }
+}//namespace hgl::devil
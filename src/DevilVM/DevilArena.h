@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string_view>
+#include <utility>
+
+namespace hgl::devil
+{
+    /**
+    * 编译产物使用的顺序分配器<br>
+    * 从按需增长的大块内存中依次切出对象，只能整体释放。其中的对象不执行析构函数，所以不得持有需要另外释放的资源<br>
+    * 非线程安全，多线程编译时每个线程使用自己的Arena
+    */
+    class Arena
+    {
+        struct Block
+        {
+            Block *next;
+            size_t size;                                                        ///<含本结构在内的字节数
+        };
+
+        Block *block_list;                                                      //最新的块在最前
+        uint8_t *cur;                                                           //当前块中下一个可用位置
+        uint8_t *end;                                                           //当前块结束位置
+
+        size_t next_block_size;                                                 //下一个块的大小，每次翻倍直到MaxBlockSize
+        size_t used_bytes;
+        size_t reserved_bytes;
+        uint32_t block_count;
+
+    private:
+
+        void *AllocBlock(size_t,size_t);
+
+    public:
+
+        static constexpr size_t MinBlockSize=4*1024;                            ///<第一个块的大小，单个函数体通常不超过这个大小
+        static constexpr size_t MaxBlockSize=64*1024;                           ///<块的最大大小，更大的单次分配使用独立的块
+
+        uint32_t func_count;                                                    ///<函数体存放在此的函数个数，为0时整个Arena可以释放(由Module维护)
+
+    public:
+
+        Arena();
+        ~Arena(){Clear();}
+
+        Arena(const Arena &)=delete;
+        Arena &operator=(const Arena &)=delete;
+
+        void *Alloc(size_t size,size_t align)                                   ///<分配指定大小与对齐(2的幂)的内存
+        {
+            uint8_t *p=reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(cur)+align-1)&~uintptr_t(align-1));
+
+            if(!cur||p>end||size>size_t(end-p))
+                return AllocBlock(size,align);
+
+            cur=p+size;
+            used_bytes+=size;
+            return p;
+        }
+
+        template<typename T,typename... Args>
+        T *New(Args &&...args)                                                  ///<创建一个对象，随Arena一起释放，不执行析构函数
+        {
+            return new(Alloc(sizeof(T),alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        template<typename T>
+        T *NewArray(size_t count)                                               ///<创建一个清零的数组
+        {
+            return count?new(Alloc(sizeof(T)*count,alignof(T))) T[count]():nullptr;
+        }
+
+        std::string_view CopyString(std::string_view);                          ///<复制一份字符串(结尾补0)
+
+        void Clear();                                                           ///<释放全部内存
+
+        size_t GetUsedBytes()const{return used_bytes;}                          ///<已分配出去的字节数
+        size_t GetReservedBytes()const{return reserved_bytes;}                  ///<向系统申请的字节数
+        uint32_t GetBlockCount()const{return block_count;}
+    };//class Arena
+}//namespace hgl::devil
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace hgl::devil
+{
+    class Command;
+    class CompInterface;
+    class Context;
+    class Func;
+    struct CallArg;
+    struct FuncMap;
+    union SystemFuncParam;
+
+    /**
+    * 字节码操作码
+    */
+    enum class OpCode:uint8_t
+    {
+        Nop,                //空指令
+        NativeCall,         //真实函数呼叫
+        ScriptCall,         //脚本函数呼叫
+        Goto,               //跳转
+        CompGoto,           //比较并跳转
+        Return,             //函数返回
+        Command,            //无法降级的指令，回退到Command::Run虚函数调用
+        CmpBranch,          //按操作数种类与类型特化的比较并跳转，不经过CompInterface与Value的虚函数
+        InlineCall,         //内联展开的脚本函数呼叫，被展开的函数被替换后才真正呼叫
+        TailCall,           //尾位置的脚本函数呼叫，被呼叫函数替换当前函数的运行状态
+        ReturnValue,        //带返回值的函数返回
+    };//enum class OpCode
+
+    /**
+    * 比较跳转指令的操作数种类
+    */
+    enum class OperandKind:uint8_t
+    {
+        Const,              //常量，直接存放在指令中
+        Property,           //属性映射，直接读取地址
+        Local,              //局部变量，读取帧中的偏移
+        Native,             //真实函数呼叫的返回值
+
+        None,               //其它量(如脚本函数呼叫)，无法特化
+    };//enum class OperandKind
+
+    union Operand           //比较跳转指令的操作数
+    {
+        uint64_t immediate;                             //常量，按自身类型存放在低位
+        const void *address;                            //属性地址
+        uint32_t offset;                                //局部变量在帧中的偏移
+        const void *native;                             //SystemFuncCallFixed<T>
+    };
+
+    enum CmpResult:uint8_t                              //比较结果，比较跳转指令的cond为比较式成立时的结果组合
+    {
+        crLess      =0x01,
+        crEqual     =0x02,
+        crGreater   =0x04,
+        crUnordered =0x08,                              //有NaN参与
+    };
+
+    using CmpFunc=uint8_t (*)(Context *,const Operand &,const Operand &);     ///<求出两个操作数的CmpResult
+
+    /**
+    * 字节码指令<br>
+    * 定长结构，每个Func的全部指令连续存放在Func::bytecode中，编号与Func::command一一对应
+    */
+    struct Instruction
+    {
+        OpCode op;
+
+        uint8_t cond;                                   //CmpBranch: 比较式成立的CmpResult组合；InlineCall: 为1时总是呼叫
+
+        int32_t index;                                  //跳转目标指令编号；InlineCall: 展开的函数体之后的指令编号，为-1时展开处在尾位置
+
+        union
+        {
+            struct
+            {
+                FuncMap *map;                           //真实函数映射
+                const SystemFuncParam *param;           //参数
+                int param_size;                         //参数字节数
+            }native;
+
+            struct
+            {
+                Func *func;                             //脚本函数
+                const CallArg *arg;                     //参数
+                uint32_t arg_count;
+            }script;
+
+            struct
+            {
+                Operand left;
+                Operand right;
+                CmpFunc func;                           //按两边的种类与类型特化的求值函数
+            }cmp;
+            CompInterface *comp;                        //比较
+            const CallArg *result;                      //ReturnValue: 按函数的返回类型转换的返回值
+            Command *cmd;                               //回退用指令
+        };
+    };//struct Instruction
+
+    using Bytecode=std::vector<Instruction>;
+
+    bool CompileCmpBranch(Instruction &,const CompInterface *);                 ///<将比较式降级为CmpBranch，两边有无法特化的量时返回false
+}//namespace hgl::devil
@@ -0,0 +1,262 @@
+#include <hgl/devil/DevilModule.h>
+#include"DevilFunc.h"
+#include"DevilImage.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+
+namespace hgl::devil
+{
+    namespace fs=std::filesystem;
+
+    namespace
+    {
+        constexpr const char CacheExt[]=".dvimg";
+        constexpr const char TempExt[]=".tmp";
+
+        constexpr auto StaleTempAge=std::chrono::minutes(10);                  //超过这个时间的临时文件视为其它进程写入中断后的残留
+
+        std::string ToHex(uint64_t value)
+        {
+            char buf[17];
+
+            std::snprintf(buf,sizeof(buf),"%016llx",static_cast<unsigned long long>(value));
+            return std::string(buf,16);
+        }
+
+        /**
+        * 生成映射函数与属性的签名文本，按名字排序以保证与映射顺序无关
+        */
+        std::string MakeBindingText(const StringMap<FuncMap *> &func_map,const StringMap<PropertyMap *> &prop_map)
+        {
+            std::vector<std::string_view> names;
+            std::string text;
+
+            text="v"+std::to_string(image::Version)+" p"+std::to_string(sizeof(void *))+" s"+std::to_string(sizeof(SystemFuncParam))+"\n";
+
+            names.reserve(func_map.size());
+            for(const auto &kv:func_map)
+                names.push_back(kv.first);
+
+            std::sort(names.begin(),names.end());
+
+            for(const std::string_view name:names)
+            {
+                const FuncMap *map=func_map.find(name)->second;
+
+                text+="f ";
+                text+=GetTokenName(map->result);
+                text.push_back(' ');
+                text+=name;
+                text.push_back('(');
+
+                for(const eTokenType type:map->param)
+                {
+                    text+=GetTokenName(type);
+                    text.push_back(',');
+                }
+
+                text+=")\n";
+            }
+
+            names.clear();
+            names.reserve(prop_map.size());
+            for(const auto &kv:prop_map)
+                names.push_back(kv.first);
+
+            std::sort(names.begin(),names.end());
+
+            for(const std::string_view name:names)
+            {
+                text+="p ";
+                text+=GetTokenName(prop_map.find(name)->second->type);
+                text.push_back(' ');
+                text+=name;
+                text.push_back('\n');
+            }
+
+            return text;
+        }
+
+        /**
+        * 生成同一目录下不会与其它进程、线程重复的临时文件名
+        */
+        std::string MakeTempFilename(const std::string &filename)
+        {
+            static std::atomic<uint64_t> counter{0};
+            static const uint64_t seed=(uint64_t(std::random_device{}())<<32)^std::random_device{}();
+
+            const uint64_t now=static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+            const std::string id=ToHex(seed)+ToHex(now)+ToHex(counter.fetch_add(1));
+
+            return filename+"."+ToHex(ankerl::unordered_dense::hash<std::string_view>{}(id))+TempExt;
+        }
+
+        /**
+        * 淘汰最久未使用的缓存文件，直到目录总大小不超过上限
+        */
+        void EvictCache(const fs::path &dir,uint64_t max_bytes)
+        {
+            struct Entry
+            {
+                fs::path path;
+                fs::file_time_type time;
+                uint64_t size;
+            };
+
+            std::vector<Entry> entries;
+            uint64_t total=0;
+            std::error_code ec;
+
+            const fs::file_time_type stale=fs::file_time_type::clock::now()-StaleTempAge;
+
+            for(fs::directory_iterator it(dir,ec),end;!ec&&it!=end;it.increment(ec))
+            {
+                const fs::path &path=it->path();
+                const fs::path ext=path.extension();
+
+                if(ext!=CacheExt&&ext!=TempExt)
+                    continue;
+
+                std::error_code file_ec;
+
+                const uint64_t size=it->file_size(file_ec);
+                const fs::file_time_type time=it->last_write_time(file_ec);
+
+                if(file_ec)                                                     //已被其它进程删除或替换
+                    continue;
+
+                if(ext==TempExt)
+                {
+                    if(time<stale)
+                        fs::remove(path,file_ec);
+
+                    continue;                                                   //写入中的临时文件不参与淘汰
+                }
+
+                entries.push_back({path,time,size});
+                total+=size;
+            }
+
+            if(total<=max_bytes)
+                return;
+
+            std::sort(entries.begin(),entries.end(),[](const Entry &a,const Entry &b){return a.time<b.time;});
+
+            for(const Entry &e:entries)
+            {
+                if(total<=max_bytes)
+                    break;
+
+                std::error_code file_ec;
+
+                if(fs::remove(e.path,file_ec))
+                    LogInfo("%s",("淘汰编译缓存: "+e.path.string()).c_str());
+
+                total-=e.size;                                                  //删除失败多半是已被其它进程删除，同样计为已释放
+            }
+        }
+    }//namespace
+
+    /**
+    * 设置编译缓存目录<br>
+    * 设置后AddScript以脚本内容与当前全部映射函数、属性的签名作为键，命中时直接载入上次编译出的模块映像
+    * @param path 缓存目录，不存在时会自动创建，nullptr或空串表示关闭缓存
+    * @param max_bytes 缓存目录的容量上限，超出时淘汰最久未使用的缓存，0表示不限制
+    * @return 是否设置成功
+    */
+    bool Module::SetCacheDirectory(const char *path,uint64_t max_bytes)
+    {
+        if(!path||!(*path))
+        {
+            cache_path.clear();
+            return(true);
+        }
+
+        std::error_code ec;
+
+        fs::create_directories(path,ec);
+
+        if(ec||!fs::is_directory(path,ec))
+        {
+            LogError("%s",("无法创建编译缓存目录: "+std::string(path)).c_str());
+            return(false);
+        }
+
+        cache_path=path;
+        cache_max_bytes=max_bytes;
+        return(true);
+    }
+
+    std::string Module::GetCacheFilename(const char *source,int source_length)
+    {
+        std::string binding=MakeBindingText(func_map,prop_map);
+
+        if(!optimize)                                                           //不优化或展开的指令数不同时编译出的指令不同
+            binding+="no-opt\n";
+
+        if(inline_limit!=DefaultInlineLimit)
+            binding+="inline "+std::to_string(inline_limit)+"\n";
+
+        const uint64_t source_hash=ankerl::unordered_dense::hash<std::string_view>{}(std::string_view(source,source_length));
+        const uint64_t binding_hash=ankerl::unordered_dense::hash<std::string_view>{}(binding);
+
+        return (fs::path(cache_path)/(ToHex(source_hash)+ToHex(binding_hash)+CacheExt)).string();
+    }
+
+    /**
+    * 尝试从编译缓存载入，缓存损坏或与当前映射不符时由映像校验拒绝，随后照常编译并覆盖该缓存
+    */
+    bool Module::LoadCache(const std::string &filename)
+    {
+        std::error_code ec;
+
+        if(!fs::is_regular_file(filename,ec))
+            return(false);
+
+        if(!LoadImage(filename.c_str()))
+            return(false);
+
+        fs::last_write_time(filename,fs::file_time_type::clock::now(),ec);    //更新使用时间，供淘汰时参考
+
+        LogInfo("%s",("命中编译缓存: "+filename).c_str());
+        return(true);
+    }
+
+    /**
+    * 将本次编译出的函数写入编译缓存<br>
+    * 先写入临时文件再改名，其它进程只会看到完整的缓存文件
+    */
+    void Module::SaveCache(const std::string &filename,const std::vector<Func *> &funcs)
+    {
+        std::vector<uint8_t> image_data;
+
+        if(!SaveImage(funcs,image_data))                                        //如呼叫了之前脚本中的函数，则无法独立缓存
+        {
+            LogInfo("%s",("脚本无法独立保存为映像，不写入编译缓存: "+filename).c_str());
+            return;
+        }
+
+        const std::string temp_filename=MakeTempFilename(filename);
+
+        if(!WriteImageFile(temp_filename.c_str(),image_data))
+            return;
+
+        std::error_code ec;
+
+        fs::rename(temp_filename,filename,ec);
+
+        if(ec)
+        {
+            LogError("%s",("写入编译缓存失败: "+filename).c_str());
+            fs::remove(temp_filename,ec);
+            return;
+        }
+
+        if(cache_max_bytes>0)
+            EvictCache(fs::path(cache_path),cache_max_bytes);
+    }
+}//namespace hgl::devil
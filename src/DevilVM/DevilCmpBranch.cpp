@@ -0,0 +1,195 @@
+#include"DevilCommand.h"
+#include <type_traits>
+
+namespace hgl::devil
+{
+    /**
+    * 按种类读取比较跳转指令的一个操作数，种类与类型在编译时确定，不经过Value的虚函数
+    */
+    template<OperandKind K,typename T> struct CmpOperand;
+
+    template<typename T> struct CmpOperand<OperandKind::Const,T>
+    {
+        static T Load(Context *,const Operand &op)
+        {
+            T value;
+
+            memcpy(&value,&op.immediate,sizeof(T));
+            return value;
+        }
+    };
+
+    template<typename T> struct CmpOperand<OperandKind::Property,T>
+    {
+        static T Load(Context *,const Operand &op)
+        {
+            return *static_cast<const T *>(op.address);
+        }
+    };
+
+    template<typename T> struct CmpOperand<OperandKind::Local,T>
+    {
+        static T Load(Context *context,const Operand &op)
+        {
+            return *reinterpret_cast<const T *>(context->GetLocalFrame()+op.offset);    //每次重新取帧，另一边的真实函数可能重入呼叫使帧栈扩大
+        }
+    };
+
+    template<typename T> struct CmpOperand<OperandKind::Native,T>
+    {
+        static T Load(Context *,const Operand &op)
+        {
+            SystemFuncParam result;
+
+            static_cast<const SystemFuncCallFixed<T> *>(op.native)->Call(&result);
+
+            return *reinterpret_cast<T *>(&result);
+        }
+    };
+
+    namespace
+    {
+        template<typename L,typename R> uint8_t Compare(L l,R r)
+        {
+            using T=std::common_type_t<L,R>;                                    //与直接比较相同的算术转换，写明以免有符号与无符号比较的警告
+
+            const T a=static_cast<T>(l);
+            const T b=static_cast<T>(r);
+
+            uint8_t result=0;
+
+            if(a< b)result|=crLess;
+            if(a==b)result|=crEqual;
+            if(a> b)result|=crGreater;
+
+            return(result?result:uint8_t(crUnordered));                                  //三者都不成立只能是有NaN参与
+        }
+
+        template<typename L,OperandKind LK,typename R,OperandKind RK>
+        uint8_t CmpEval(Context *context,const Operand &left,const Operand &right)
+        {
+            const L l=CmpOperand<LK,L>::Load(context,left);                     //与CompInterface::Comp一样先左后右
+
+            return Compare(l,CmpOperand<RK,R>::Load(context,right));
+        }
+
+        #define DEVIL_CMP_TYPES(proc)   proc(ttBool,    bool    )   \
+                                        proc(ttInt,     int     )   \
+                                        proc(ttUInt,    uint    )   \
+                                        proc(ttFloat,   float   )   \
+                                        proc(ttDouble,  double  )   \
+                                        proc(ttInt64,   int64   )   \
+                                        proc(ttUInt64,  uint64  )           //与CreateComp支持的类型一致
+
+        #define DEVIL_CMP_KINDS(proc)   proc(Const)     \
+                                        proc(Property)  \
+                                        proc(Local)     \
+                                        proc(Native)
+
+        template<typename L,OperandKind LK,typename R> CmpFunc SelectRightKind(OperandKind rk)
+        {
+            switch(rk)
+            {
+                #define DEVIL_CMP_RIGHT_KIND(kind)  case OperandKind::kind:return(&CmpEval<L,LK,R,OperandKind::kind>);
+
+                DEVIL_CMP_KINDS(DEVIL_CMP_RIGHT_KIND)
+
+                #undef DEVIL_CMP_RIGHT_KIND
+
+                default:return(nullptr);
+            }
+        }
+
+        template<typename L,OperandKind LK> CmpFunc SelectRightType(eTokenType rt,OperandKind rk)
+        {
+            switch(rt)
+            {
+                #define DEVIL_CMP_RIGHT_TYPE(tt,T)  case tt:return SelectRightKind<L,LK,T>(rk);
+
+                DEVIL_CMP_TYPES(DEVIL_CMP_RIGHT_TYPE)
+
+                #undef DEVIL_CMP_RIGHT_TYPE
+
+                default:return(nullptr);
+            }
+        }
+
+        template<typename L> CmpFunc SelectLeftKind(OperandKind lk,eTokenType rt,OperandKind rk)
+        {
+            switch(lk)
+            {
+                #define DEVIL_CMP_LEFT_KIND(kind)   case OperandKind::kind:return SelectRightType<L,OperandKind::kind>(rt,rk);
+
+                DEVIL_CMP_KINDS(DEVIL_CMP_LEFT_KIND)
+
+                #undef DEVIL_CMP_LEFT_KIND
+
+                default:return(nullptr);
+            }
+        }
+
+        CmpFunc SelectCmpFunc(eTokenType lt,OperandKind lk,eTokenType rt,OperandKind rk)
+        {
+            switch(lt)
+            {
+                #define DEVIL_CMP_LEFT_TYPE(tt,T)   case tt:return SelectLeftKind<T>(lk,rt,rk);
+
+                DEVIL_CMP_TYPES(DEVIL_CMP_LEFT_TYPE)
+
+                #undef DEVIL_CMP_LEFT_TYPE
+
+                default:return(nullptr);
+            }
+        }
+
+        #undef DEVIL_CMP_KINDS
+        #undef DEVIL_CMP_TYPES
+
+        uint8_t GetCmpCond(eTokenType op)                                       //比较符成立时的比较结果组合
+        {
+            switch(op)
+            {
+                case ttEqual:               return(crEqual);
+                case ttNotEqual:            return(crLess|crGreater|crUnordered);
+                case ttLessThan:            return(crLess);
+                case ttGreaterThan:         return(crGreater);
+                case ttLessThanOrEqual:     return(crLess|crEqual);
+                case ttGreaterThanOrEqual:  return(crGreater|crEqual);
+                default:                    return(0);
+            }
+        }
+    }//namespace
+
+    /**
+    * 比较式两边都是常量、属性、局部变量或真实函数呼叫时，降级为按种类与类型特化的CmpBranch<br>
+    * 常量直接存放在指令中，属性直接读取地址，每次比较只有一次间接呼叫(原来是比较式与两边的量共三次虚函数呼叫)
+    */
+    bool CompileCmpBranch(Instruction &ins,const CompInterface *comp)
+    {
+        eTokenType op;
+        const ValueInterface *left,*right;
+
+        if(!comp||!comp->GetOperands(op,left,right))
+            return(false);
+
+        Operand left_operand{};
+        Operand right_operand{};
+
+        const OperandKind lk=left->GetOperand(left_operand);
+        const OperandKind rk=right->GetOperand(right_operand);
+        const uint8_t cond=GetCmpCond(op);
+
+        const CmpFunc func=(cond?SelectCmpFunc(left->type,lk,right->type,rk):nullptr);
+
+        if(!func)
+            return(false);
+
+        ins.op=OpCode::CmpBranch;
+        ins.cond=cond;
+        ins.cmp.left=left_operand;
+        ins.cmp.right=right_operand;
+        ins.cmp.func=func;
+
+        return(true);
+    }
+}//namespace hgl::devil
@@ -1,35 +1,50 @@
 ﻿#include"DevilCommand.h"
 #include <hgl/devil/DevilContext.h>
 #include"DevilFunc.h"
+#include <cstring>
 
 namespace hgl
 {
 namespace devil
 {
+#if DEVIL_VM_ASM_NATIVE_CALL
 #if HGL_CPU == HGL_CPU_X86_32
     void *CallCDeclFunction(void *,const void *,int);                                           ///<呼叫C函数
     void *CallThiscallFunction(void *,const void *,const void *,int);                           ///<呼叫C++函数
 
-    bool FuncMap::Call(const SystemFuncParam *call_param,const int param_size,void *return_result)
+    static bool AsmCall(FuncMap *map,const SystemFuncParam *call_param,const int param_size,void *return_result)
     {
-        if(base)        //有this指针
-            *(void **)return_result=CallThiscallFunction(func,base,call_param,param_size);
+        if(map->base)        //有this指针
+            *(void **)return_result=CallThiscallFunction(map->func,map->base,call_param,param_size);
         else
-            *(void **)return_result=CallCDeclFunction(func,call_param,param_size);
+            *(void **)return_result=CallCDeclFunction(map->func,call_param,param_size);
 
         return(true);
     }
 #elif HGL_CPU == HGL_CPU_X86_64
     extern "C" void *CallX64(void *func,int argc,const void *argv, const void *argv_float);
 
-    bool FuncMap::Call(const SystemFuncParam *call_param,const int param_size,void *return_result)
+    static bool AsmCall(FuncMap *map,const SystemFuncParam *call_param,const int param_size,void *return_result)
     {
         //X86-64位情况下，this放入参数的第一个，在解析代码时已经确定，所以无需再次处理
-        *(void **)return_result=CallX64(func,param_size,call_param,call_param);
+        *(void **)return_result=CallX64(map->func,param_size,call_param,call_param);
 
         return(true);
     }
-#endif//
+#endif//HGL_CPU
+#endif//DEVIL_VM_ASM_NATIVE_CALL
+
+    bool FuncMap::Call(const SystemFuncParam *call_param,[[maybe_unused]] const int param_size,void *return_result)
+    {
+        if(thunk)
+            return thunk(callable,call_param,return_result);
+
+    #if DEVIL_VM_ASM_NATIVE_CALL
+        return AsmCall(this,call_param,param_size,return_result);
+    #else
+        return(false);              //没有汇编呼叫实现，映射时已强制使用thunk
+    #endif//DEVIL_VM_ASM_NATIVE_CALL
+    }
 }//namespace devil
 }//namespace hgl
 
@@ -58,18 +73,37 @@ namespace hgl
 {
 namespace devil
 {
-    ScriptFuncCall::ScriptFuncCall(Module *dm,Func *df)
+    ScriptFuncCall::ScriptFuncCall(Module *dm,Func *df,CallArg *a,uint32_t count)
     {
         module=dm;
         func=df;
+        arg=a;
+        arg_count=count;
+        tail=false;
     }
 
     bool ScriptFuncCall::Run(Context *context)
     {
-        context->ScriptFuncCall(func);
+        if(tail)
+            return context->ScriptFuncTailCall(func,arg,arg_count);
+
+        return context->ScriptFuncCall(func,arg,arg_count);     //呼叫堆栈溢出时返回false
+    }
+
+    bool ScriptFuncCall::Compile(Instruction &ins)
+    {
+        ins.op=(tail?OpCode::TailCall:OpCode::ScriptCall);
+        ins.script.func=func;
+        ins.script.arg=arg;
+        ins.script.arg_count=arg_count;
 
         return(true);
     }
+
+    bool ScriptFuncCall::Save(ImageWriter &writer)const
+    {
+        return writer.WriteScriptCall(func,arg,arg_count,tail);
+    }
 }//namespace devil
 }//namespace hgl
 
@@ -77,7 +111,7 @@ namespace hgl
 {
 namespace devil
 {
-    Goto::Goto(Module *dm,Func *df,const std::string &flag)
+    Goto::Goto(Module *dm,Func *df,std::string_view flag)
     {
         module=dm;
 
@@ -88,7 +122,7 @@ namespace devil
         index=-1;
     }
 
-    void Goto::UpdateGotoFlag()
+    bool Goto::UpdateGotoFlag()
     {
         {
             const auto it=func->goto_flag.find(name);
@@ -96,22 +130,41 @@ namespace devil
                 index=it->second;
         }                                       // 由于跳转标识有可能在这个GOTO之后定义，所以必须等这个函数解晰完了，再调用SetLine
 
-        if(index==-1)
-            LogError("%s",
-                     ("在函数<"+func->func_name+">没有找到跳转标识:"+name)
-                         .c_str());
+        if(index!=-1)
+            return(true);
+
+        LogError("%s",
+                 ("在函数<"+func->func_name+">没有找到跳转标识:"+std::string(name))
+                     .c_str());
+        return(false);
     }
 
     bool Goto::Run(Context *context)
     {
         #ifdef _DEBUG
             LogInfo("%s",
-                    ("在函数<"+func->func_name+">中跳转:"+name)
+                    ("在函数<"+func->func_name+">中跳转:"+std::string(name))
                         .c_str());
         #endif//_DEBUG
 
         return context->Goto(func,index);
     }
+
+    bool Goto::Compile(Instruction &ins)
+    {
+        if(index<0)                             //跳转标识未找到，保留原指令以便运行时报错
+            return(false);
+
+        ins.op=OpCode::Goto;
+        ins.index=index;
+
+        return(true);
+    }
+
+    bool Goto::Save(ImageWriter &writer)const
+    {
+        return writer.WriteGoto(name);
+    }
 }//namespace devil
 }//namespace hgl
 
@@ -128,12 +181,21 @@ namespace devil
         index=-1;
     }
 
-    CompGoto::~CompGoto()
+    bool CompGoto::IsConstant(bool &result)const
     {
-        delete comp;
+        eTokenType op;
+        const ValueInterface *left,*right;
+
+        if(!comp->GetOperands(op,left,right)
+         ||!left->IsConstant()
+         ||!right->IsConstant())
+            return(false);
+
+        result=comp->Comp(nullptr);                 //常量取值不需要Context
+        return(true);
     }
 
-    void CompGoto::UpdateGotoFlag()
+    bool CompGoto::UpdateGotoFlag()
     {
         {
             const auto it=func->goto_flag.find(else_flag);
@@ -141,20 +203,43 @@ namespace devil
                 index=it->second;
         }
 
-        if(index==-1)
-            LogError("%s",
-                     ("在函数<"+func->func_name+">没有找到跳转标识:"+else_flag).c_str());
+        if(index!=-1)
+            return(true);
+
+        LogError("%s",
+                 ("在函数<"+func->func_name+">没有找到跳转标识:"+std::string(else_flag)).c_str());
+        return(false);
     }
 
     bool CompGoto::Run(Context *context)
     {
-        if(comp->Comp())return(true);
+        if(comp->Comp(context))return(true);
+
+        if(context->GetState()!=dvsRun)     //比较式中的真实函数有可能暂停或终止
+            return(true);
 
         if(index==-1)           //不含else的if脚本，else_flag自动为end_flag
             return(false);
 
         return context->Goto(func,index);
     }
+
+    bool CompGoto::Compile(Instruction &ins)
+    {
+        if(!CompileCmpBranch(ins,comp))         //两边都是可特化的量时不经过虚函数
+        {
+            ins.op=OpCode::CompGoto;
+            ins.comp=comp;
+        }
+
+        ins.index=index;
+        return(true);
+    }
+
+    bool CompGoto::Save(ImageWriter &writer)const
+    {
+        return writer.WriteCompGoto(comp,else_flag);
+    }
 }//namespace devil
 }//namespace hgl
 
@@ -162,6 +247,65 @@ namespace hgl
 {
 namespace devil
 {
+    InlineCall::InlineCall(Module *dm,Func *f,Func *c,std::string_view flag,bool fw)
+    {
+        module=dm;
+        func=f;
+        callee=c;
+        forward=fw;
+        tail=false;
+        end_flag=flag;
+
+        index=-1;
+    }
+
+    bool InlineCall::UpdateGotoFlag()
+    {
+        index=func->FindGotoFlag(end_flag);
+
+        if(index!=-1)
+            return(true);
+
+        LogError("%s",
+                 ("在函数<"+func->func_name+">没有找到跳转标识:"+std::string(end_flag)).c_str());
+        return(false);
+    }
+
+    bool InlineCall::Run(Context *context)
+    {
+        if(!forward&&!callee->IsReplaced())
+            return(true);                       //继续执行展开的函数体
+
+        if(index<0)
+            return(false);
+
+        if(tail)
+            return context->ScriptFuncTailCall(callee,nullptr,0);
+
+        context->cur_state->index=index;        //返回到展开的函数体之后
+        return context->ScriptFuncCall(callee);
+    }
+
+    bool InlineCall::Compile(Instruction &ins)
+    {
+        if(index<0)
+            return(false);
+
+        ins.op=OpCode::InlineCall;
+        ins.cond=forward;
+        ins.index=(tail?-1:index);              //尾位置不再回到本函数
+        ins.script.func=callee;
+        ins.script.arg=nullptr;
+        ins.script.arg_count=0;
+
+        return(true);
+    }
+
+    bool InlineCall::Save(ImageWriter &writer)const
+    {
+        return writer.WriteInlineCall(callee,end_flag,forward||callee->IsReplaced(),tail);
+    }
+
     Return::Return(Module *dm)
     {
         module=dm;
@@ -171,6 +315,238 @@ namespace devil
     {
         return context->Return();
     }
+
+    bool Return::Compile(Instruction &ins)
+    {
+        ins.op=OpCode::Return;
+
+        return(true);
+    }
+
+    bool Return::Save(ImageWriter &writer)const
+    {
+        return writer.WriteReturn();
+    }
+
+    ReturnValue::ReturnValue(Module *dm,const CallArg &r)
+    {
+        module=dm;
+        result=r;
+    }
+
+    bool ReturnValue::Run(Context *context)
+    {
+        result.store(context,result.value,&context->return_value);
+
+        return context->Return();
+    }
+
+    bool ReturnValue::Compile(Instruction &ins)
+    {
+        ins.op=OpCode::ReturnValue;
+        ins.result=&result;
+
+        return(true);
+    }
+
+    bool ReturnValue::Save(ImageWriter &writer)const
+    {
+        return writer.WriteReturnValue(result.value);
+    }
+}//namespace devil
+}//namespace hgl
+
+namespace hgl
+{
+namespace devil
+{
+    Command *CreateSystemFuncCall(Arena &arena,FuncMap *map,SystemFuncParam *param,int param_count)
+    {
+        switch(map->result)
+        {
+            case ttVoid:    return(arena.New<SystemFuncCallFixed<void *  >>(map,param,param_count));
+
+            case ttBool:    return(arena.New<SystemFuncCallFixed<bool    >>(map,param,param_count));
+            case ttInt8:    return(arena.New<SystemFuncCallFixed<int8    >>(map,param,param_count));
+            case ttInt16:   return(arena.New<SystemFuncCallFixed<int16   >>(map,param,param_count));
+            case ttInt:     return(arena.New<SystemFuncCallFixed<int32   >>(map,param,param_count));
+            case ttUInt8:   return(arena.New<SystemFuncCallFixed<uint8   >>(map,param,param_count));
+            case ttUInt16:  return(arena.New<SystemFuncCallFixed<uint16  >>(map,param,param_count));
+            case ttUInt:    return(arena.New<SystemFuncCallFixed<uint32  >>(map,param,param_count));
+            case ttInt64:   return(arena.New<SystemFuncCallFixed<int64   >>(map,param,param_count));
+            case ttUInt64:  return(arena.New<SystemFuncCallFixed<uint64  >>(map,param,param_count));
+            case ttFloat:   return(arena.New<SystemFuncCallFixed<float   >>(map,param,param_count));
+            case ttDouble:  return(arena.New<SystemFuncCallFixed<double  >>(map,param,param_count));
+            case ttString:  return(arena.New<SystemFuncCallFixed<char *  >>(map,param,param_count));
+
+            default:        return(nullptr);
+        }
+    }
+
+    ValueInterface *CreateFuncMapValue(Arena &arena,Module *dm,FuncMap *map,Command *cmd)
+    {
+        switch(map->result)
+        {
+            case ttBool:    return(arena.New<ValueFuncMap<bool    >>(dm,cmd,ttBool     ));
+
+            case ttInt8:    return(arena.New<ValueFuncMap<int8    >>(dm,cmd,ttInt8     ));
+            case ttInt16:   return(arena.New<ValueFuncMap<int16   >>(dm,cmd,ttInt16    ));
+            case ttInt:     return(arena.New<ValueFuncMap<int32   >>(dm,cmd,ttInt      ));
+
+            case ttUInt8:   return(arena.New<ValueFuncMap<uint8   >>(dm,cmd,ttUInt8    ));
+            case ttUInt16:  return(arena.New<ValueFuncMap<uint16  >>(dm,cmd,ttUInt16   ));
+            case ttUInt:    return(arena.New<ValueFuncMap<uint32  >>(dm,cmd,ttUInt     ));
+
+            case ttInt64:   return(arena.New<ValueFuncMap<int64   >>(dm,cmd,ttInt64    ));
+            case ttUInt64:  return(arena.New<ValueFuncMap<uint64  >>(dm,cmd,ttUInt64   ));
+
+            case ttFloat:   return(arena.New<ValueFuncMap<float   >>(dm,cmd,ttFloat    ));
+            case ttDouble:  return(arena.New<ValueFuncMap<double  >>(dm,cmd,ttDouble   ));
+
+            case ttString:  return(arena.New<ValueFuncMap<char *  >>(dm,cmd,ttString   ));
+
+            default:        return(nullptr);
+        }
+    }
+
+    ValueInterface *CreatePropertyValue(Arena &arena,Module *dm,PropertyMap *dpm)
+    {
+        switch(dpm->type)
+        {
+            case ttBool:    return(arena.New<ValueProperty<bool    >>(dm,dpm,ttBool));
+
+            case ttInt8:    return(arena.New<ValueProperty<int8    >>(dm,dpm,ttInt8));
+            case ttInt16:   return(arena.New<ValueProperty<int16   >>(dm,dpm,ttInt16));
+            case ttInt:     return(arena.New<ValueProperty<int32   >>(dm,dpm,ttInt));
+            case ttInt64:   return(arena.New<ValueProperty<int64   >>(dm,dpm,ttInt64));
+
+            case ttUInt8:   return(arena.New<ValueProperty<uint8   >>(dm,dpm,ttUInt8));
+            case ttUInt16:  return(arena.New<ValueProperty<uint16  >>(dm,dpm,ttUInt16));
+            case ttUInt:    return(arena.New<ValueProperty<uint32  >>(dm,dpm,ttUInt));
+            case ttUInt64:  return(arena.New<ValueProperty<uint64  >>(dm,dpm,ttUInt64));
+
+            case ttFloat:   return(arena.New<ValueProperty<float   >>(dm,dpm,ttFloat));
+            case ttDouble:  return(arena.New<ValueProperty<double  >>(dm,dpm,ttDouble));
+
+            default:        return(nullptr);
+        }
+    }
+
+    ValueInterface *CreateConstValue(Arena &arena,Module *dm,eTokenType type,const void *data)
+    {
+        switch(type)
+        {
+            case ttBool:    return(arena.New<ValueBool>(dm,*static_cast<const uint8 *>(data)!=0));    //不信任原始数据中bool的取值
+
+            #define DEVIL_CONST_VALUE(tt,name,T)    case tt:{T value;memcpy(&value,data,sizeof(T));return(arena.New<name>(dm,value));}
+
+            DEVIL_CONST_VALUE(ttInt,    ValueInteger,   int     )
+            DEVIL_CONST_VALUE(ttUInt,   ValueUInteger,  uint    )
+            DEVIL_CONST_VALUE(ttFloat,  ValueFloat,     float   )
+            DEVIL_CONST_VALUE(ttInt64,  ValueInt64,     int64   )
+            DEVIL_CONST_VALUE(ttUInt64, ValueUInt64,    uint64  )
+            DEVIL_CONST_VALUE(ttDouble, ValueDouble,    double  )
+
+            #undef DEVIL_CONST_VALUE
+
+            default:        return(nullptr);
+        }
+    }
+
+    CompInterface *CreateComp(Arena &arena,eTokenType comp,ValueInterface *left,ValueInterface *right)
+    {
+        CompInterface *dci=nullptr;
+
+        #define DEVIL_COMP_FLAG(flag,func,_lt,_rt)  case flag:dci=arena.New<func<_lt,_rt>>(left,right);break;
+
+        #define DEVIL_COMP_CREATE(lt,_lt,rt,_rt)    if((left->type==lt)&&(right->type==rt)) \
+                                                        switch(comp)    \
+                                                        {   \
+                                                            DEVIL_COMP_FLAG(ttEqual             ,CompEqu       ,_lt,_rt)   \
+                                                            DEVIL_COMP_FLAG(ttNotEqual          ,CompNotEqu    ,_lt,_rt)   \
+                                                            DEVIL_COMP_FLAG(ttLessThan          ,CompLess      ,_lt,_rt)   \
+                                                            DEVIL_COMP_FLAG(ttGreaterThan       ,CompGreater   ,_lt,_rt)   \
+                                                            DEVIL_COMP_FLAG(ttLessThanOrEqual   ,CompLessEqu   ,_lt,_rt)   \
+                                                            DEVIL_COMP_FLAG(ttGreaterThanOrEqual,CompGreaterEqu,_lt,_rt)   \
+                                                            default:break;  \
+                                                        };
+
+        #define DEVIL_COMP_ARRAY(lt,_lt)    DEVIL_COMP_CREATE(lt,_lt,ttBool,    bool);  \
+                                            DEVIL_COMP_CREATE(lt,_lt,ttInt,     int);   \
+                                            DEVIL_COMP_CREATE(lt,_lt,ttUInt,    uint);  \
+                                            DEVIL_COMP_CREATE(lt,_lt,ttFloat,   float); \
+                                            DEVIL_COMP_CREATE(lt,_lt,ttDouble,  double);\
+                                            DEVIL_COMP_CREATE(lt,_lt,ttInt64,   int64); \
+                                            DEVIL_COMP_CREATE(lt,_lt,ttUInt64,  uint64);\
+
+        DEVIL_COMP_ARRAY(ttBool,    bool    )
+        DEVIL_COMP_ARRAY(ttInt,     int     )
+        DEVIL_COMP_ARRAY(ttUInt,    uint    )
+        DEVIL_COMP_ARRAY(ttFloat,   float   )
+        DEVIL_COMP_ARRAY(ttDouble,  double  )
+        DEVIL_COMP_ARRAY(ttInt64,   int64   )
+        DEVIL_COMP_ARRAY(ttUInt64,  uint64  )
+
+        #undef DEVIL_COMP_ARRAY
+        #undef DEVIL_COMP_FLAG
+        #undef DEVIL_COMP_CREATE
+
+        return(dci);
+    }
+
+    ValueInterface *CreateScriptCallValue(Arena &arena,Module *dm,Func *func,CallArg *arg,uint32_t arg_count)
+    {
+        switch(func->result_type)
+        {
+            #define DEVIL_SCRIPT_CALL_VALUE(tt,T)   case tt:return(arena.New<ValueScriptCall<T>>(dm,tt,func,arg,arg_count));
+
+            DEVIL_VALUE_TYPES(DEVIL_SCRIPT_CALL_VALUE)
+
+            #undef DEVIL_SCRIPT_CALL_VALUE
+
+            default:return(nullptr);
+        }
+    }
+
+    namespace
+    {
+        using StoreFunc=void (*)(Context *,ValueInterface *,void *);
+
+        template<typename T> StoreFunc SelectStore(eTokenType source)
+        {
+            switch(source)
+            {
+                #define DEVIL_STORE_SOURCE(tt,S)    case tt:return(&StoreValueAs<T,S>);
+
+                DEVIL_VALUE_TYPES(DEVIL_STORE_SOURCE)
+
+                #undef DEVIL_STORE_SOURCE
+
+                default:return(nullptr);
+            }
+        }
+    }//namespace
+
+    bool InitCallArg(CallArg &arg,eTokenType type,ValueInterface *value)
+    {
+        if(!value||(type==ttString)!=(value->type==ttString))                   //字符串与数值不能互相转换
+            return(false);
+
+        arg.value=value;
+
+        switch(type)
+        {
+            #define DEVIL_STORE_TARGET(tt,T)    case tt:arg.store=SelectStore<T>(value->type);break;
+
+            DEVIL_VALUE_TYPES(DEVIL_STORE_TARGET)
+
+            #undef DEVIL_STORE_TARGET
+
+            default:arg.store=nullptr;break;
+        }
+
+        return arg.store!=nullptr;
+    }
 }//namespace devil
 }//namespace hgl
 
@@ -3,9 +3,24 @@
 #include <string>
 #include <hgl/type/Str.Number.h>
 #include <vector>
+#include <cstring>
+#include <type_traits>
+#include <hgl/devil/DevilContext.h>
+#include <hgl/devil/DevilModule.h>
 #include"as_tokenizer.h"
+#include"DevilArena.h"
+#include"DevilBytecode.h"
+#include"DevilImage.h"
 #include<hgl/log/Log.h>
 
+#ifndef DEVIL_VM_ASM_NATIVE_CALL                                           //是否有汇编实现的真实函数呼叫(x86-32，或MSVC下以MicrosoftCallX64.asm实现的x86-64)
+    #if HGL_CPU == HGL_CPU_X86_32 || (HGL_CPU == HGL_CPU_X86_64 && defined(_MSC_VER))
+        #define DEVIL_VM_ASM_NATIVE_CALL    1
+    #else
+        #define DEVIL_VM_ASM_NATIVE_CALL    0
+    #endif//
+#endif//DEVIL_VM_ASM_NATIVE_CALL
+
 namespace hgl::devil
 {
     using namespace angle_script;
@@ -16,6 +31,15 @@ namespace hgl::devil
     class ValueInterface;
     template<typename T> class ValueProperty;
     template<typename T> class ScriptValue;
+    template<typename T> class SystemFuncCallFixed;
+
+    constexpr uint32_t MaxScriptParamCount=16;                                 ///<脚本函数最多的参数个数
+
+    struct CallArg                                                              //脚本函数呼叫的一个参数，或带返回值的return
+    {
+        ValueInterface *value;
+        void (*store)(Context *,ValueInterface *,void *);                       //按参数(返回值)类型转换后写入8字节的槽
+    };
 
     union SystemFuncParam          //函数参数
     {
@@ -48,6 +72,8 @@ namespace hgl::devil
         ValueInterface *value;     //变量
     };//union SystemFuncParam
 
+    static_assert(sizeof(SystemFuncParam)==detail::NativeArgStride,"SystemFuncParam must match the native thunk argument stride.");
+
     struct FuncMap                 //真实函数映射
     {
         void *base;                     //基地址
@@ -58,10 +84,23 @@ namespace hgl::devil
 
         std::vector<eTokenType> param;        //参数类型
 
+        NativeThunk thunk;              //按签名生成的呼叫入口，为nullptr时使用汇编呼叫
+        detail::NativeCallable callable;    //thunk呼叫的对象(函数指针、成员函数或lambda等)
+
         FuncMap()
         {
             base=0;
             func=0;
+            thunk=nullptr;
+        }
+
+        bool ThisInParam()const                                     //this指针是否需要放在参数列表的第一个(仅x86-64汇编呼叫)
+        {
+        #if DEVIL_VM_ASM_NATIVE_CALL && HGL_CPU == HGL_CPU_X86_64
+            return base&&!thunk;
+        #else
+            return(false);
+        #endif//
         }
 
         bool Call(const SystemFuncParam *,const int,void *);
@@ -82,14 +121,14 @@ namespace hgl::devil
         virtual ~Command()=default;
 
         virtual bool Run(Context *)=0;
-    };
 
-    template<typename T> class FuncCall:public Command                                    //函数呼叫
-    {
-    public:
+        virtual bool Compile(Instruction &){return(false);}                                 ///<降级为字节码指令，返回false表示保留为Command运行
 
-        T result;                                                                                   //返回值
+        virtual bool Save(ImageWriter &)const{return(false);}                               ///<写入模块映像，返回false表示无法保存
+    };
 
+    template<typename T> class FuncCall:public Command                                    //函数呼叫(T为返回值类型，返回值由调用者在自己的栈上接收)
+    {
     public:
 
         virtual ~FuncCall()=default;
@@ -117,13 +156,19 @@ namespace hgl::devil
         }
 
         virtual ~ValueInterface()=default;
+
+        virtual bool IsConstant()const{return(false);}                                              ///<是否编译期常量
+
+        virtual OperandKind GetOperand(Operand &)const{return(OperandKind::None);}                  ///<取得作为比较跳转指令操作数的种类与内容
+
+        virtual int32_t Save(ImageWriter &)const{return(-1);}                                       ///<写入模块映像，返回量序号，-1表示无法保存
     };
 
     template<typename T> class Value:public ValueInterface                                //变量
     {
     public:
 
-        virtual T &GetValue()=0;
+        virtual T GetValue(Context *)=0;                                                            //运行期只读，不得修改模块中的数据
 
         void SetValue(T &){};
 
@@ -139,14 +184,18 @@ namespace hgl::devil
 
         virtual ~CompInterface()=default;
 
-        virtual bool Comp()=0;
+        virtual bool Comp(Context *)=0;
+
+        virtual bool GetOperands(eTokenType &,const ValueInterface *&,const ValueInterface *&)const{return(false);}   ///<取得比较符与两边的量
+
+        virtual int32_t Save(ImageWriter &)const{return(-1);}                                       ///<写入模块映像，返回比较式序号，-1表示无法保存
     };
 
     #ifdef OPER_OVER
     #undef OPER_OVER
     #endif//
 
-    #define OPER_OVER(name,oper)    template<typename T1,typename T2> class name:public CompInterface  \
+    #define OPER_OVER(name,oper,tt) template<typename T1,typename T2> class name:public CompInterface  \
                                     {   \
                                         Value<T1> *left;   \
                                         Value<T2> *right;  \
@@ -159,24 +208,31 @@ namespace hgl::devil
                                             right=(Value<T2> *)r;  \
                                         }   \
                                         \
-                                        ~name() \
+                                        bool Comp(Context *context) override \
+                                        {   \
+                                            return(left->GetValue(context) oper right->GetValue(context));  \
+                                        }   \
+                                        \
+                                        bool GetOperands(eTokenType &op,const ValueInterface *&l,const ValueInterface *&r)const override    \
                                         {   \
-                                            delete left;    \
-                                            delete right;   \
+                                            op=tt;  \
+                                            l=left; \
+                                            r=right;    \
+                                            return(true);   \
                                         }   \
                                         \
-                                        bool Comp() override \
+                                        int32_t Save(ImageWriter &writer)const override \
                                         {   \
-                                            return(left->GetValue() oper right->GetValue());    \
+                                            return writer.AddComp(tt,left,right);   \
                                         }   \
                                     };
 
-    OPER_OVER(CompEqu,         ==);
-    OPER_OVER(CompNotEqu,      !=);
-    OPER_OVER(CompLessEqu,     <=);
-    OPER_OVER(CompGreaterEqu,  >=);
-    OPER_OVER(CompLess,        < );
-    OPER_OVER(CompGreater,     > );
+    OPER_OVER(CompEqu,         ==, ttEqual);
+    OPER_OVER(CompNotEqu,      !=, ttNotEqual);
+    OPER_OVER(CompLessEqu,     <=, ttLessThanOrEqual);
+    OPER_OVER(CompGreaterEqu,  >=, ttGreaterThanOrEqual);
+    OPER_OVER(CompLess,        < , ttLessThan);
+    OPER_OVER(CompGreater,     > , ttGreaterThan);
 
     #undef OPER_OVER
 
@@ -184,102 +240,119 @@ namespace hgl::devil
     #define DEVIL_VALUE
     #endif//DEVIL_VALUE
 
-    #define DEVIL_VALUE(name,T,tt,proc) class name:public Value<T>     \
-                                        {   \
-                                            T value;    \
-                                            \
-                                        public: \
+    #define DEVIL_VALUE(name,T,tt)  class name:public Value<T>     \
+                                    {   \
+                                        T value;    \
                                         \
-                                            T &GetValue() override{return value;}    \
-                                            \
-                                        public: \
+                                    public: \
+                                    \
+                                        T GetValue(Context *) override{return value;}   \
+                                        bool IsConstant()const override{return(true);}  \
+                                        OperandKind GetOperand(Operand &op)const override{op.immediate=0;memcpy(&op.immediate,&value,sizeof(T));return(OperandKind::Const);}  \
+                                        int32_t Save(ImageWriter &writer)const override{return writer.AddConstValue(tt,&value,sizeof(T));}   \
                                         \
-                                            name(Module *dm,const char *str):Value<T>(dm,tt) \
-                                            {   \
-                                                proc(str,value);    \
-                                            }   \
-                                        };
-
-    DEVIL_VALUE(ValueInteger,   int,    ttInt,      hgl::stoi);              //真实数值,有符号整数
-    DEVIL_VALUE(ValueUInteger,  uint,   ttUInt,     hgl::stou);              //真实数值,无符号整数
-    DEVIL_VALUE(ValueFloat,     float,  ttFloat,    hgl::stof);              //真实数值,浮点数
-    DEVIL_VALUE(ValueBool,      bool,   ttBool ,    hgl::stob);              //真实数值,布尔型
-    DEVIL_VALUE(ValueInt64,     int64,  ttInt64,    hgl::stoi);
-    DEVIL_VALUE(ValueUInt64,    uint64, ttUInt64,   hgl::stou);
-    DEVIL_VALUE(ValueDouble,    double, ttDouble,   hgl::stof);
+                                    public: \
+                                    \
+                                        name(Module *dm,T v):Value<T>(dm,tt),value(v){}     /*数值由解析器直接从源码中转换好*/ \
+                                    };
+
+    DEVIL_VALUE(ValueInteger,   int,    ttInt);                 //真实数值,有符号整数
+    DEVIL_VALUE(ValueUInteger,  uint,   ttUInt);                //真实数值,无符号整数
+    DEVIL_VALUE(ValueFloat,     float,  ttFloat);               //真实数值,浮点数
+    DEVIL_VALUE(ValueBool,      bool,   ttBool);                //真实数值,布尔型
+    DEVIL_VALUE(ValueInt64,     int64,  ttInt64);
+    DEVIL_VALUE(ValueUInt64,    uint64, ttUInt64);
+    DEVIL_VALUE(ValueDouble,    double, ttDouble);
 
     #undef DEVIL_VALUE
 
     template<typename T> class ValueProperty:public Value<T>                              //变量：真实属性映射
     {
+        PropertyMap *map;
         T *address;
 
     public:
 
         ValueProperty(Module *dm,PropertyMap *dpm,eTokenType type):Value<T>(dm,type)
         {
+            map=dpm;
             address=(T *)(dpm->address);
         }
 
-        T &GetValue() override
+        T GetValue(Context *) override
         {
             return *address;
         }
+
+        OperandKind GetOperand(Operand &op)const override
+        {
+            op.address=address;
+            return(OperandKind::Property);
+        }
+
+        int32_t Save(ImageWriter &writer)const override
+        {
+            return writer.AddPropertyValue(this->type,map);
+        }
     };
 
     template<typename T> class ValueFuncMap:public Value<T>                               //变量: 函数映射
     {
-        Command *cmd;
+        SystemFuncCallFixed<T> *cmd;
 
     public:
 
         ValueFuncMap(Module *dm,Command *dfc,eTokenType type):Value<T>(dm,type)
         {
-            cmd=dfc;
+            cmd=static_cast<SystemFuncCallFixed<T> *>(dfc);
         }
 
-        ~ValueFuncMap()
+        T GetValue(Context *) override
         {
-            delete cmd;
+            SystemFuncParam result;                 //返回值放在栈上，多个线程同时运行时不会互相覆盖
+
+            cmd->Call(&result);
+
+            return *reinterpret_cast<T *>(&result);
         }
 
-        T &GetValue() override
+        OperandKind GetOperand(Operand &op)const override
         {
-            cmd->Run(nullptr);
+            op.native=cmd;
+            return(OperandKind::Native);
+        }
 
-            return ((FuncCall<T> *)cmd)->result;
+        int32_t Save(ImageWriter &writer)const override
+        {
+            return cmd->SaveValue(writer,this->type);
         }
     };
 
-    template<typename T> class ScriptValue:public Value<T>                                //变量：脚本变量
+    template<typename T> class ScriptValue:public Value<T>                                //变量：脚本变量，存放在Context的局部变量帧中
     {
-        std::string func_name;
-        std::string value_name;
-
-        T value;
+        uint32_t offset;                                                                            //在局部变量帧中的偏移
 
     public:
 
-        ScriptValue()
+        ScriptValue(Module *dm,eTokenType tt,uint32_t off):Value<T>(dm,tt)
         {
-            func_name="null";
-            value_name="null";
+            offset=off;
         }
 
-        ScriptValue(Module *dm,const std::string &fn,const std::string &vn,eTokenType tt):Value<T>(dm,tt)
+        T GetValue(Context *context) override
         {
-            func_name=fn;
-            value_name=vn;
+            return *reinterpret_cast<T *>(context->GetLocalFrame()+offset);
         }
 
-        T &GetValue() override
+        OperandKind GetOperand(Operand &op)const override
         {
-            return value;
+            op.offset=offset;
+            return(OperandKind::Local);
         }
 
-        void SetValue(T &v)
+        int32_t Save(ImageWriter &writer)const override
         {
-            value=v;
+            return writer.AddScriptValue(this->type,offset);
         }
     };
 //--------------------------------------------------------------------------------------------------
@@ -296,7 +369,7 @@ namespace hgl::devil
     {
         FuncMap *func;             //真实函数映射
 
-        SystemFuncParam *param;
+        SystemFuncParam *param;    //参数块位于Arena或映像中，不由本指令释放
         int param_size;
 
     public:
@@ -309,14 +382,36 @@ namespace hgl::devil
             param_size=pc*sizeof(SystemFuncParam);
         }
 
-        ~SystemFuncCallFixed()
+        bool Call(void *result) const
         {
-            delete[] param;
+            return func->Call(param,param_size,result);
         }
 
         bool Run(Context *) override
         {
-            return func->Call(param,param_size,&(this->result));
+            SystemFuncParam result;
+
+            return Call(&result);
+        }
+
+        bool Compile(Instruction &ins) override
+        {
+            ins.op=OpCode::NativeCall;
+            ins.native.map=func;
+            ins.native.param=param;
+            ins.native.param_size=param_size;
+
+            return(true);
+        }
+
+        bool Save(ImageWriter &writer)const override
+        {
+            return writer.WriteNativeCall(func,param,param_size/sizeof(SystemFuncParam));
+        }
+
+        int32_t SaveValue(ImageWriter &writer,eTokenType type)const                                 ///<作为量(取返回值)写入模块映像
+        {
+            return writer.AddNativeCallValue(type,func,param,param_size/sizeof(SystemFuncParam));
         }
     };
 
@@ -340,36 +435,50 @@ namespace hgl::devil
         Module *module;
         Func *func;
 
+        CallArg *arg;                                                                               //参数，位于Arena中
+        uint32_t arg_count;
+
+        bool tail;                                                                                  //尾呼叫：被呼叫函数替换当前函数的运行状态，不再返回本函数
+
     public:
 
-        ScriptFuncCall(Module *,Func *);
+        ScriptFuncCall(Module *,Func *,CallArg *arg=nullptr,uint32_t arg_count=0);
+
+        Func *GetFunc()const{return func;}                                                          ///<取得呼叫的脚本函数
+        CallArg *GetArg()const{return arg;}
+        uint32_t GetArgCount()const{return arg_count;}
+
+        bool IsTail()const{return tail;}
+        void SetTail(bool t){tail=t;}                                                               ///<设置是否为尾呼叫，须在CompileBytecode之前
 
         bool Run(Context *) override;
+        bool Compile(Instruction &) override;
+        bool Save(ImageWriter &)const override;
     };
 
     class Goto:public Command                                                             //跳转
     {
-        OBJECT_LOGGER
-
         Module *module;
         Func *func;
-        std::string name;
+        std::string_view name;                                                                      //位于Arena或映像中
 
         int index;
 
     public:
 
-        Goto(Module *,Func *,const std::string &);
+        Goto(Module *,Func *,std::string_view);
 
-        void UpdateGotoFlag();
+        std::string_view GetFlag()const{return name;}                                               ///<取得跳转标识名称
+        void SetFlag(std::string_view flag){name=flag;}                                             ///<改变跳转标识名称(位于Arena中)，须在UpdateGotoFlag之前
+        bool UpdateGotoFlag();                                                                      ///<按名字取得跳转位置，没有找到返回false
 
         bool Run(Context *) override;
+        bool Compile(Instruction &) override;
+        bool Save(ImageWriter &)const override;
     };
 
     class CompGoto:public Command                                                         //比较并跳转
     {
-        OBJECT_LOGGER
-
         Module *module;
         CompInterface *comp;
         Func *func;
@@ -378,16 +487,52 @@ namespace hgl::devil
 
     public:
 
-        std::string else_flag;
+        std::string_view else_flag;                                                                 //位于Arena或映像中
 
     public:
 
         CompGoto(Module *,CompInterface *dci,Func *);
-        ~CompGoto();
 
-        void UpdateGotoFlag();
+        CompInterface *GetComp()const{return comp;}
+        bool IsConstant(bool &)const;                                                               ///<比较式两边都是常量时求出比较结果
+        bool UpdateGotoFlag();                                                                      ///<按名字取得跳转位置，没有找到返回false
+
+        bool Run(Context *) override;
+        bool Compile(Instruction &) override;
+        bool Save(ImageWriter &)const override;
+    };
+
+    /**
+    * 内联展开的脚本函数呼叫，位于展开的函数体之前<br>
+    * 被展开的函数没有被热更新替换时直接继续执行展开的函数体，否则呼叫最新版本并跳过展开的函数体
+    */
+    class InlineCall:public Command
+    {
+        Module *module;
+        Func *func;                                                                                 //展开所在的函数
+        Func *callee;                                                                               //被展开的函数
+        bool forward;                                                                               //总是呼叫(映像写出时被展开的函数已被替换)
+        bool tail;                                                                                  //展开处在尾位置，呼叫时以尾呼叫替换所在函数
+
+        int index;
+
+    public:
+
+        std::string_view end_flag;                                                                  //展开的函数体结束处的跳转标识，位于Arena或映像中
+
+    public:
+
+        InlineCall(Module *,Func *,Func *,std::string_view,bool forward=false);
+
+        Func *GetCallee()const{return callee;}
+        bool UpdateGotoFlag();                                                                      ///<按名字取得跳转位置，没有找到返回false
+
+        bool IsTail()const{return tail;}
+        void SetTail(bool t){tail=t;}                                                               ///<设置展开处是否在尾位置，须在CompileBytecode之前
 
         bool Run(Context *) override;
+        bool Compile(Instruction &) override;
+        bool Save(ImageWriter &)const override;
     };
 
     class Return:public Command                                                           //函数返回
@@ -399,6 +544,22 @@ namespace hgl::devil
         Return(Module *);
 
         bool Run(Context *) override;
+        bool Compile(Instruction &) override;
+        bool Save(ImageWriter &)const override;
+    };
+
+    class ReturnValue:public Command                                                      //带返回值的函数返回
+    {
+        Module *module;
+        CallArg result;                                                                             //按函数的返回类型转换
+
+    public:
+
+        ReturnValue(Module *,const CallArg &);
+
+        bool Run(Context *) override;
+        bool Compile(Instruction &) override;
+        bool Save(ImageWriter &)const override;
     };
 
     class SystemValueEqu:public Command                                                   //真实变量赋值
@@ -410,12 +571,116 @@ namespace hgl::devil
         bool Run(Context *) override;
     };
 
-    class ScriptValueEqu:public Command                                                   //脚本变量赋值
+    #define DEVIL_VALUE_TYPES(proc)     proc(ttBool,    bool    )   \
+                                        proc(ttString,  char *  )   \
+                                        proc(ttInt,     int     )   \
+                                        proc(ttUInt,    uint    )   \
+                                        proc(ttInt8,    int8    )   \
+                                        proc(ttUInt8,   uint8   )   \
+                                        proc(ttInt16,   int16   )   \
+                                        proc(ttUInt16,  uint16  )   \
+                                        proc(ttInt64,   int64   )   \
+                                        proc(ttUInt64,  uint64  )   \
+                                        proc(ttFloat,   float   )   \
+                                        proc(ttDouble,  double  )                                   //脚本中可用的数据类型与对应的C++类型
+
+    template<typename T> struct ValueTokenType;                                                     //C++类型对应的脚本数据类型
+
+    #define DEVIL_VALUE_TOKEN_TYPE(tt,T)    template<> struct ValueTokenType<T>{static constexpr eTokenType value=tt;};
+
+    DEVIL_VALUE_TYPES(DEVIL_VALUE_TOKEN_TYPE)
+
+    #undef DEVIL_VALUE_TOKEN_TYPE
+
+    template<typename T,typename S> T LoadValueAs(Context *context,ValueInterface *value)  //取得一个量并转换为T类型
+    {
+        if constexpr(std::is_same_v<T,S>)
+            return static_cast<Value<S> *>(value)->GetValue(context);
+        else
+        if constexpr(std::is_arithmetic_v<T>&&std::is_arithmetic_v<S>)
+            return static_cast<T>(static_cast<Value<S> *>(value)->GetValue(context));
+        else
+            return T();                                                                             //字符串与数值间不可赋值，解析时已经拒绝
+    }
+
+    template<typename T,typename S> void StoreValueAs(Context *context,ValueInterface *value,void *target)   //取得一个量转换为T类型写入target
+    {
+        *static_cast<T *>(target)=LoadValueAs<T,S>(context,value);
+    }
+
+    template<typename T> class ValueScriptCall:public Value<T>                            //变量：脚本函数呼叫的返回值
+    {
+        Func *func;
+        CallArg *arg;
+        uint32_t arg_count;
+
+    public:
+
+        ValueScriptCall(Module *dm,eTokenType tt,Func *f,CallArg *a,uint32_t count):Value<T>(dm,tt)
+        {
+            func=f;
+            arg=a;
+            arg_count=count;
+        }
+
+        T GetValue(Context *context) override
+        {
+            if(!context->CallFunc(func,arg,arg_count))                                             //在当前呼叫堆栈之上运行到函数返回
+                return T();
+
+            T value;
+
+            memcpy(&value,&context->return_value,sizeof(T));
+            return value;
+        }
+
+        int32_t Save(ImageWriter &writer)const override
+        {
+            return writer.AddScriptCallValue(this->type,func,arg,arg_count);
+        }
+    };
+
+    template<typename T> class ScriptValueEqu:public Command                              //脚本变量赋值
     {
+        uint32_t offset;                                                                            //目标变量在局部变量帧中的偏移
+        ValueInterface *value;
+        T (*load)(Context *,ValueInterface *);
+
     public:
 
-        ScriptValueEqu(Module *);
+        ScriptValueEqu(uint32_t off,ValueInterface *v,T (*l)(Context *,ValueInterface *))
+        {
+            offset=off;
+            value=v;
+            load=l;
+        }
+
+        void Assign(uint8_t *frame,Context *context)                                                //frame为局部变量帧，常量赋值时可直接写入初始帧
+        {
+            *reinterpret_cast<T *>(frame+offset)=load(context,value);
+        }
 
-        bool Run(Context *) override;
+        bool Run(Context *context) override
+        {
+            const T result=load(context,value);                                                     //先求值，量中的脚本函数呼叫可能扩大帧栈
+
+            *reinterpret_cast<T *>(context->GetLocalFrame()+offset)=result;
+            return(true);
+        }
+
+        bool Save(ImageWriter &writer)const override
+        {
+            return writer.WriteAssign(ValueTokenType<T>::value,offset,value);
+        }
     };
+
+    //以下创建的指令、量与比较式都分配在Arena中，随Arena一起释放，创建失败时已创建的部分同样留在Arena中
+
+    Command *       CreateSystemFuncCall(Arena &,FuncMap *,SystemFuncParam *,int);                 ///<按返回类型创建真实函数呼叫，返回类型无法支持时返回nullptr
+    ValueInterface *CreateFuncMapValue(Arena &,Module *,FuncMap *,Command *);                       ///<以真实函数呼叫的返回值作为量，返回类型无法支持时返回nullptr
+    ValueInterface *CreatePropertyValue(Arena &,Module *,PropertyMap *);                            ///<创建读取属性映射的量，类型无法支持时返回nullptr
+    ValueInterface *CreateConstValue(Arena &,Module *,eTokenType,const void *);                     ///<按类型从原始数据创建常量，类型无法支持时返回nullptr
+    CompInterface * CreateComp(Arena &,eTokenType,ValueInterface *,ValueInterface *);               ///<创建比较式，类型或比较符无法支持时返回nullptr
+    ValueInterface *CreateScriptCallValue(Arena &,Module *,Func *,CallArg *,uint32_t);             ///<以脚本函数呼叫的返回值作为量，函数没有返回值时返回nullptr
+    bool            InitCallArg(CallArg &,eTokenType,ValueInterface *);                             ///<设置按指定类型传递的参数，类型无法转换时返回false
 }//namespace hgl::devil
@@ -5,24 +5,165 @@
 #include"DevilFunc.h"
 #include <cstdint>
 #include <cstring>
+#include <algorithm>
 
 namespace hgl::devil
 {
+    /**
+    * 公开方法在取得、使用函数引用期间进入纪元保护，嵌套时只有最外层生效
+    */
+    class Context::EpochScope
+    {
+        Context *context;
+
+    public:
+
+        explicit EpochScope(Context *c):context(c){context->EnterEpoch();}
+        ~EpochScope(){context->LeaveEpoch();}
+    };//class Context::EpochScope
+
+    Context::~Context()
+    {
+        SetModule(nullptr);
+    }
+
+    void Context::SetModule(Module *dm)
+    {
+        if(module==dm)
+            return;
+
+        if(module)
+            module->DetachContext(this);
+
+        module=dm;
+
+        if(module)
+            module->AttachContext(this);
+    }
+
+    /**
+    * 公布当前纪元，之后被替换的函数在本Context离开前不会被回收<br>
+    * 已公布的纪元不晚于当前纪元时不需要再次公布，也就不需要屏障(除第一次进入外的常见情况)
+    */
+    void Context::EnterEpoch()
+    {
+        if(pin_depth++>0||!module)
+            return;
+
+        const uint64_t epoch=module->reload_epoch.load();
+
+        if(epoch<pin_epoch.load(std::memory_order_relaxed))
+        {
+            pin_epoch.store(epoch);
+            std::atomic_thread_fence(std::memory_order_seq_cst);               //先公布纪元，再取得函数引用
+        }
+    }
+
+    /**
+    * 离开时如果呼叫堆栈中已没有被替换的函数，就把公布的纪元推进到当前纪元<br>
+    * 没有在运行的函数时同样公布当前纪元而不是清除，下次进入时就不必再经过屏障；代价是之后的热更新替换下的函数要等本Context再次进入、离开后才能回收
+    */
+    void Context::LeaveEpoch()
+    {
+        if(--pin_depth>0||!module)
+            return;
+
+        const uint64_t epoch=module->reload_epoch.load(std::memory_order_acquire);
+
+        for(uint32_t i=0;i<run_depth;i++)
+            if(run_state[i].func->IsReplaced())
+                return;                                                         //仍在执行旧版本，保持原来的纪元
+
+        pin_epoch.store(epoch,std::memory_order_release);
+    }
+
+    /**
+    * 当前函数已被热更新替换时，在跳转处尝试换到新版本继续执行
+    * @param index 旧版本中的跳转目标
+    * @return 是否已换到新版本(cur_state已更新)
+    */
+    bool Context::RemapFrame(int index)
+    {
+        Func *old_func=cur_state->func;
+        Func *new_func=old_func->GetLatest();
+
+        if(new_func==old_func
+         ||new_func->state!=FuncState::Ready
+         ||!new_func->SameFrameLayout(old_func))                               //局部变量布局不同时只能执行完旧版本
+            return(false);
+
+        for(const auto &kv:old_func->goto_flag)
+        {
+            if(kv.second!=index)
+                continue;
+
+            const int new_index=new_func->FindGotoFlag(kv.first);
+
+            if(new_index<0)
+                continue;
+
+            cur_state->func=new_func;
+            cur_state->index=new_index;
+            return(true);
+        }
+
+        return(false);
+    }
+
     void Context::ClearStack()
     {
-        run_state.clear();
+        run_depth=0;
+        frame_top=0;
     }
 
-    bool Context::RunContext()
+    bool Context::RunContext(uint64_t budget)
+    {
+        bool result;
+
+        run_budget=budget;
+        budget_overrun=0;
+        budget_out=false;
+
+        switch(dispatch_mode)
+        {
+            case ddmCommand:    result=RunCommand();break;
+            case ddmThreaded:   result=RunThreaded();break;
+            default:            result=RunBytecode();break;
+        }
+
+        if(!result&&stop_depth==0)                          //最外层运行出错，放弃整个呼叫堆栈，嵌套呼叫由CallFunc恢复
+        {
+            ClearStack();
+            cur_state=nullptr;
+            State=dvsStop;
+        }
+
+        retired_count=budget-run_budget+budget_overrun;
+        return(result);
+    }
+
+    bool Context::BudgetOut()
+    {
+        State=dvsPause;                     //指令预算用完，以暂停状态返回，可由Run/RunFor继续
+        budget_out=true;
+        return(true);
+    }
+
+    bool Context::RunCommand()
     {
         while(true)
         {
             while(cur_state->index<
                                     static_cast<int>(cur_state->func->command.size()))
             {
+                if(run_budget==0)
+                    return BudgetOut();
+
+                --run_budget;
+
                 ScriptFuncRunState *sfrs=cur_state;                     //cmd->run有可能更改cur_state，所以这里保存，以保证sfrs->index++正确
 
-                                Command *cmd=sfrs->func->command[sfrs->index++].get();   //cmd->run有可能更改index,所以这里先加
+                                Command *cmd=sfrs->func->command[sfrs->index++];   //cmd->run有可能更改index,所以这里先加
 
                 #ifdef _DEBUG
                 LogInfo("%s",
@@ -43,6 +184,9 @@ namespace hgl::devil
                 }
                 else
                 {
+                    if(run_depth<=stop_depth)  //最外层函数中的return，运行结束
+                        return(true);
+
                     LogError("%s",
                              ("run error,func: "+sfrs->func->func_name+",code index: "
                               +std::to_string(sfrs->index-1)).c_str());
@@ -59,14 +203,615 @@ namespace hgl::devil
         }
     }
 
-    void Context::ScriptFuncCall(Func *func)
+    bool Context::RunBytecode()
+    {
+        SystemFuncParam result;                                             //语句中的真实函数呼叫，返回值直接丢弃
+
+        const Bytecode *code=&(cur_state->func->bytecode);
+
+        while(true)
+        {
+            if(cur_state->index>=static_cast<int>(code->size()))            //当前函数运行完毕
+            {
+                if(!Return())                                               //返回上一级调用函数失败表示运行结束了
+                    return(true);
+
+                code=&(cur_state->func->bytecode);
+                continue;
+            }
+
+            if(run_budget==0)
+                return BudgetOut();
+
+            --run_budget;
+
+            const Instruction &ins=(*code)[cur_state->index++];
+
+            #ifdef _DEBUG
+            LogInfo("%s",
+                ("run to func: \""+cur_state->func->func_name+"\" line: "
+                 +std::to_string(cur_state->index-1)).c_str());
+            #endif//
+
+            switch(ins.op)
+            {
+                case OpCode::Nop:           break;
+
+                case OpCode::NativeCall:    if(!ins.native.map->Call(ins.native.param,ins.native.param_size,&result))
+                                                return RunError();
+
+                                            break;
+
+                case OpCode::ScriptCall:    if(!ScriptFuncCall(ins.script.func,ins.script.arg,ins.script.arg_count))
+                                                return RunError();
+
+                                            code=&(cur_state->func->bytecode);
+                                            break;
+
+                case OpCode::TailCall:      if(!ScriptFuncTailCall(ins.script.func,ins.script.arg,ins.script.arg_count))
+                                                return RunError();
+
+                                            code=&(cur_state->func->bytecode);
+                                            break;
+
+                case OpCode::Goto:          cur_state->index=ins.index;
+
+                                            if(cur_state->func->IsReplaced()&&RemapFrame(ins.index))
+                                                code=&(cur_state->func->bytecode);
+
+                                            break;
+
+                case OpCode::CompGoto:      if(ins.comp->Comp(this))
+                                                break;
+
+                                            if(State!=dvsRun)               //比较式中的真实函数有可能暂停或终止
+                                                return(true);
+
+                                            if(ins.index<0)
+                                                return RunError();
+
+                                            cur_state->index=ins.index;
+
+                                            if(cur_state->func->IsReplaced()&&RemapFrame(ins.index))
+                                                code=&(cur_state->func->bytecode);
+
+                                            break;
+
+                case OpCode::CmpBranch:     if(ins.cmp.func(this,ins.cmp.left,ins.cmp.right)&ins.cond)
+                                                break;
+
+                                            if(State!=dvsRun)
+                                                return(true);
+
+                                            if(ins.index<0)
+                                                return RunError();
+
+                                            cur_state->index=ins.index;
+
+                                            if(cur_state->func->IsReplaced()&&RemapFrame(ins.index))
+                                                code=&(cur_state->func->bytecode);
+
+                                            break;
+
+                case OpCode::Return:        if(!Return())
+                                                return(true);
+
+                                            code=&(cur_state->func->bytecode);
+                                            break;
+
+                case OpCode::ReturnValue:   ins.result->store(this,ins.result->value,&return_value);
+
+                                            if(!Return())
+                                                return(true);
+
+                                            code=&(cur_state->func->bytecode);
+                                            break;
+
+                case OpCode::InlineCall:    if(!ins.cond&&!ins.script.func->IsReplaced())
+                                                break;                              //继续执行展开的函数体
+
+                                            if(ins.index<0)
+                                            {
+                                                if(!ScriptFuncTailCall(ins.script.func,nullptr,0))
+                                                    return RunError();
+                                            }
+                                            else
+                                            {
+                                                cur_state->index=ins.index;
+
+                                                if(!ScriptFuncCall(ins.script.func))
+                                                    return RunError();
+                                            }
+
+                                            code=&(cur_state->func->bytecode);
+                                            break;
+
+                case OpCode::Command:       if(!ins.cmd->Run(this))
+                                            {
+                                                if(run_depth<=stop_depth)
+                                                    return(true);
+
+                                                return RunError();
+                                            }
+
+                                            code=&(cur_state->func->bytecode);     //指令有可能更改cur_state
+                                            break;
+            }
+
+            if(State!=dvsRun)               //暂停或退出
+                return(true);
+        }
+    }
+
+#if defined(DEVIL_VM_THREADED_DISPATCH)&&(defined(__GNUC__)||defined(__clang__))
+    /**
+    * 直接线索分派：每个指令处理段结尾直接跳到下一条指令的处理段，不回到中心循环<br>
+    * 指令编号保存在局部的ip中，只在可能离开当前函数或调用外部代码前写回cur_state
+    */
+    bool Context::RunThreaded()
+    {
+        static void * const dispatch_table[]=          //顺序必须与OpCode一致
+        {
+            &&op_nop,
+            &&op_native_call,
+            &&op_script_call,
+            &&op_goto,
+            &&op_comp_goto,
+            &&op_return,
+            &&op_command,
+            &&op_cmp_branch,
+            &&op_inline_call,
+            &&op_tail_call,
+            &&op_return_value,
+        };
+
+        SystemFuncParam result;
+
+        const Instruction *code;
+        const Instruction *end;
+        const Instruction *ip;
+        const Instruction *ins;
+        bool pass;                                  //比较式的结果
+
+        #define DEVIL_LOAD_FUNC()   code=cur_state->func->bytecode.data();              \
+                                    end=code+cur_state->func->bytecode.size();          \
+                                    ip=code+cur_state->index;
+
+        #define DEVIL_SAVE_INDEX()  cur_state->index=static_cast<int>(ip-code);
+
+        #define DEVIL_REMAP()       if(cur_state->func->IsReplaced()                    \
+                                     &&RemapFrame(static_cast<int>(ip-code)))           \
+                                    {                                                   \
+                                        DEVIL_LOAD_FUNC();                              \
+                                    }
+
+        #define DEVIL_DISPATCH()    if(ip>=end)goto func_end;                           \
+                                    if(run_budget==0)goto budget_out;                   \
+                                    --run_budget;                                       \
+                                    ins=ip++;                                           \
+                                    goto *dispatch_table[static_cast<int>(ins->op)];
+
+        DEVIL_LOAD_FUNC();
+        DEVIL_DISPATCH();
+
+    op_nop:
+        DEVIL_DISPATCH();
+
+    op_native_call:
+        DEVIL_SAVE_INDEX();
+
+        if(!ins->native.map->Call(ins->native.param,ins->native.param_size,&result))
+            return RunError();
+
+        if(State!=dvsRun)                   //真实函数中有可能暂停或终止
+            return(true);
+
+        DEVIL_DISPATCH();
+
+    op_script_call:
+        DEVIL_SAVE_INDEX();
+
+        if(!ScriptFuncCall(ins->script.func,ins->script.arg,ins->script.arg_count))
+            return RunError();
+
+        DEVIL_LOAD_FUNC();
+        DEVIL_DISPATCH();
+
+    op_tail_call:
+        DEVIL_SAVE_INDEX();
+
+        if(!ScriptFuncTailCall(ins->script.func,ins->script.arg,ins->script.arg_count))
+            return RunError();
+
+        DEVIL_LOAD_FUNC();
+        DEVIL_DISPATCH();
+
+    op_goto:
+        ip=code+ins->index;
+        DEVIL_REMAP();
+        DEVIL_DISPATCH();
+
+    op_comp_goto:
+        pass=ins->comp->Comp(this);
+
+        if(State!=dvsRun)                       //比较式中的真实函数有可能暂停或终止
+            goto comp_break;
+
+        if(!pass)
+        {
+            if(ins->index<0)
+            {
+                DEVIL_SAVE_INDEX();
+                return RunError();
+            }
+
+            ip=code+ins->index;
+            DEVIL_REMAP();
+        }
+
+        DEVIL_DISPATCH();
+
+    op_cmp_branch:
+        pass=ins->cmp.func(this,ins->cmp.left,ins->cmp.right)&ins->cond;
+
+        if(State!=dvsRun)
+            goto comp_break;
+
+        if(!pass)
+        {
+            if(ins->index<0)
+            {
+                DEVIL_SAVE_INDEX();
+                return RunError();
+            }
+
+            ip=code+ins->index;
+            DEVIL_REMAP();
+        }
+
+        DEVIL_DISPATCH();
+
+    op_return:
+        if(!Return())
+            return(true);
+
+        DEVIL_LOAD_FUNC();
+        DEVIL_DISPATCH();
+
+    op_return_value:
+        ins->result->store(this,ins->result->value,&return_value);
+
+        if(!Return())
+            return(true);
+
+        if(State!=dvsRun)                       //返回值中的真实函数有可能暂停
+            return(true);
+
+        DEVIL_LOAD_FUNC();
+        DEVIL_DISPATCH();
+
+    op_inline_call:
+        if(!ins->cond&&!ins->script.func->IsReplaced())
+        {
+            DEVIL_DISPATCH();                   //继续执行展开的函数体
+        }
+
+        if(ins->index<0)                        //展开处在尾位置
+        {
+            DEVIL_SAVE_INDEX();
+
+            if(!ScriptFuncTailCall(ins->script.func,nullptr,0))
+                return RunError();
+        }
+        else
+        {
+            ip=code+ins->index;
+            DEVIL_SAVE_INDEX();
+
+            if(!ScriptFuncCall(ins->script.func))
+                return RunError();
+        }
+
+        DEVIL_LOAD_FUNC();
+        DEVIL_DISPATCH();
+
+    op_command:
+        DEVIL_SAVE_INDEX();
+
+        if(!ins->cmd->Run(this))
+        {
+            if(run_depth<=stop_depth)
+                return(true);
+
+            return RunError();
+        }
+
+        if(State!=dvsRun)
+            return(true);
+
+        DEVIL_LOAD_FUNC();                  //指令有可能更改cur_state
+        DEVIL_DISPATCH();
+
+    func_end:                               //当前函数运行完毕
+        if(!Return())
+            return(true);
+
+        DEVIL_LOAD_FUNC();
+        DEVIL_DISPATCH();
+
+    budget_out:
+        DEVIL_SAVE_INDEX();
+        return BudgetOut();
+
+    comp_break:
+        if(cur_state)                           //终止时cur_state已被清除
+            DEVIL_SAVE_INDEX();
+
+        return(true);
+
+        #undef DEVIL_DISPATCH
+        #undef DEVIL_REMAP
+        #undef DEVIL_SAVE_INDEX
+        #undef DEVIL_LOAD_FUNC
+    }
+#else
+    bool Context::RunThreaded()
+    {
+        return RunBytecode();               //编译器不支持标签地址，使用switch分派
+    }
+#endif//DEVIL_VM_THREADED_DISPATCH
+
+    bool Context::RunError()
+    {
+        LogError("%s",
+                 ("run error,func: "+cur_state->func->func_name+",code index: "
+                  +std::to_string(cur_state->index-1)).c_str());
+        return(false);
+    }
+
+    /**
+    * 参数在呼叫者的帧中求值，求值时可能呼叫其它脚本函数，所以先存放在C++栈上，压入新帧后再写入
+    */
+    bool Context::ScriptFuncCall(Func *func,const CallArg *arg,uint32_t arg_count)
+    {
+        if(!arg_count)
+            return ScriptFuncCall(func);
+
+        uint64_t arg_value[MaxScriptParamCount];
+
+        for(uint32_t i=0;i<arg_count;i++)
+            arg[i].store(this,arg[i].value,arg_value+i);
+
+        return ScriptFuncCall(func,arg_value);
+    }
+
+    bool Context::ScriptFuncCall(Func *func,const uint64_t *arg_value)
+    {
+        func=func->GetLatest();                         //呼叫指令可能指向已被热更新替换的旧版本
+
+        if(run_depth>=max_call_depth)
+        {
+            LogError("%s",
+                     ("呼叫堆栈溢出，最大呼叫深度: "+std::to_string(max_call_depth)
+                      +"，呼叫函数: "+func->func_name).c_str());
+            return(false);
+        }
+
+        ScriptFuncRunState *state=&run_state[run_depth];
+
+        state->func=func;
+        state->index=0;
+        state->frame=frame_top;
+
+        const uint32_t size=func->frame_size;           //已按8字节对齐
+
+        if(size)
+        {
+            const size_t need=(frame_top+size)/sizeof(uint64_t);
+
+            if(need>frame_stack.size())                 //未用SetMaxCallDepth预分配时，仅在首次达到新的深度时扩大
+                frame_stack.resize(std::max(need,frame_stack.size()*2));
+
+            uint8_t *frame=reinterpret_cast<uint8_t *>(frame_stack.data())+frame_top;
+
+            memcpy(frame,func->frame_init.data(),size);
+
+            if(arg_value)
+                for(const ScriptValueSlot &param:func->param_list)
+                    memcpy(frame+param.offset,arg_value++,GetValueSize(param.type));
+
+            frame_top+=size;
+        }
+
+        ++run_depth;
+        cur_state=state;
+        return(true);
+    }
+
+    /**
+    * 尾呼叫：呼叫之后当前函数直接返回，所以先在当前帧中求出参数，再弹出当前函数，由被呼叫函数占用它的运行状态与帧<br>
+    * 呼叫堆栈深度不变，连续呼叫下一个函数的脚本(状态A呼叫状态B呼叫状态C...)不会耗尽呼叫堆栈。被呼叫函数返回时直接回到当前函数的呼叫者
+    */
+    bool Context::ScriptFuncTailCall(Func *func,const CallArg *arg,uint32_t arg_count)
+    {
+        uint64_t arg_value[MaxScriptParamCount];
+
+        for(uint32_t i=0;i<arg_count;i++)
+            arg[i].store(this,arg[i].value,arg_value+i);
+
+        --run_depth;                                    //当前函数一定在本次运行的堆栈中(run_depth>stop_depth)，被替换后深度不变
+        frame_top=run_state[run_depth].frame;
+
+        return ScriptFuncCall(func,arg_count?arg_value:nullptr);
+    }
+
+    /**
+    * 在当前呼叫堆栈之上呼叫脚本函数，运行到它返回后恢复呼叫前的状态<br>
+    * 用于量中的脚本函数呼叫与宿主的Invoke，可以在运行中(真实函数内)重入。期间执行的指令计入外层的指令预算与执行数
+    * @param budget 最多执行的指令数，量中的呼叫为外层剩余的预算，只有宿主的呼叫不限制
+    * @return 是否正常返回，函数中途暂停、终止或预算用完时放弃执行并返回false
+    */
+    bool Context::CallFunc(Func *func,const uint64_t *arg_value,uint64_t budget)
     {
-        ScriptFuncRunState state;
-        state.func=func;
-        state.index=0;
+        const uint32_t base_depth=run_depth;
+        const uint32_t base_frame=frame_top;
+        const uint32_t saved_stop_depth=stop_depth;
+        ScriptFuncRunState *saved_state=cur_state;
+        const VMState saved_vm_state=State;
+        const uint64_t saved_budget=run_budget;
+        const uint64_t saved_retired=retired_count;
+        const uint64_t saved_overrun=budget_overrun;
+        const bool saved_budget_out=budget_out;
+
+        if(!ScriptFuncCall(func,arg_value))
+            return(false);
+
+        return_value=0;                                     //没有执行带返回值的return时返回0
+        stop_depth=base_depth;
+        State=dvsRun;
+
+        bool result=RunContext(budget);
+
+        const uint64_t used=retired_count;
+        const bool exhausted=budget_out;
+
+        stop_depth=saved_stop_depth;
+
+        if(run_depth<base_depth)                            //被Stop清空了呼叫堆栈
+            return(false);
+
+        if(run_depth>base_depth)                            //出错或中途暂停，无法在嵌套呼叫中继续
+        {
+            if(exhausted)
+                LogError("%s",("指令预算在脚本函数被呼叫期间用完，已放弃执行: "+func->func_name).c_str());
+            else
+            if(result)
+                LogError("%s",("脚本函数在被呼叫期间暂停，已放弃执行: "+func->func_name).c_str());
 
-        run_state.push_back(state);
-        cur_state=&run_state[run_state.size()-1];
+            run_depth=base_depth;
+            frame_top=base_frame;
+            result=false;
+        }
+
+        cur_state=saved_state;
+        State=saved_vm_state;
+        budget_overrun=saved_overrun;
+
+        if(saved_budget>=used)
+            run_budget=saved_budget-used;
+        else
+        {
+            budget_overrun+=used-saved_budget;              //宿主的呼叫不受外层预算限制，超出部分另外计数
+            run_budget=0;
+        }
+
+        retired_count=saved_retired;
+        budget_out=saved_budget_out;
+
+        return(result);
+    }
+
+    /**
+    * 在空的呼叫堆栈上呼叫脚本函数并运行到它返回，是CallFunc在宿主直接呼叫时的简化<br>
+    * 只保存、恢复宿主可以读取的执行数与预算状态
+    */
+    bool Context::RunFunc(Func *func,const uint64_t *arg_value)
+    {
+        const uint64_t saved_retired=retired_count;
+        const bool saved_budget_out=budget_out;
+
+        if(!ScriptFuncCall(func,arg_value))
+            return(false);
+
+        return_value=0;
+        stop_depth=0;
+        State=dvsRun;
+
+        bool result=RunContext(UINT64_MAX);
+
+        if(run_depth>0)                                     //出错或中途暂停
+        {
+            if(result)
+                LogError("%s",("脚本函数在被呼叫期间暂停，已放弃执行: "+func->func_name).c_str());
+
+            ClearStack();
+            cur_state=nullptr;
+            State=dvsStop;
+            result=false;
+        }
+
+        retired_count=saved_retired;
+        budget_out=saved_budget_out;
+
+        return(result);
+    }
+
+    bool Context::CallFunc(Func *func,const CallArg *arg,uint32_t arg_count)
+    {
+        uint64_t arg_value[MaxScriptParamCount];
+
+        for(uint32_t i=0;i<arg_count;i++)                   //在呼叫者的帧中求值
+            arg[i].store(this,arg[i].value,arg_value+i);
+
+        return CallFunc(func,arg_count?arg_value:nullptr,run_budget);
+    }
+
+    /**
+    * 设置最大呼叫深度，并预先分配呼叫堆栈与局部变量帧栈，之后的函数呼叫与返回不再分配内存
+    * @param depth 最大呼叫深度
+    * @param frame_bytes 预分配的局部变量帧字节数，0表示按深度乘以模块中最大的帧估算
+    * @return 是否设置成功，当前呼叫深度已超出时失败
+    */
+    bool Context::SetMaxCallDepth(uint32_t depth,uint32_t frame_bytes)
+    {
+        if(depth==0||depth<run_depth)
+        {
+            LogError("%s",
+                     ("最大呼叫深度不正确: "+std::to_string(depth)
+                      +"，当前呼叫深度: "+std::to_string(run_depth)).c_str());
+            return(false);
+        }
+
+        if(depth!=max_call_depth)
+        {
+            auto new_state=std::make_unique<ScriptFuncRunState[]>(depth);
+
+            std::copy(run_state.get(),run_state.get()+run_depth,new_state.get());
+
+            run_state=std::move(new_state);
+            max_call_depth=depth;
+            cur_state=(run_depth?&run_state[run_depth-1]:nullptr);
+        }
+
+        if(frame_bytes==0&&module)
+            frame_bytes=static_cast<uint32_t>(std::min<uint64_t>(uint64_t(depth)*module->GetMaxFrameSize(),UINT32_MAX));
+
+        const size_t need=(size_t(frame_bytes)+sizeof(uint64_t)-1)/sizeof(uint64_t);
+
+        if(need>frame_stack.size())
+            frame_stack.resize(need);
+
+        return(true);
+    }
+
+    /**
+    * 按从指定函数开始的呼叫图静态分析结果设置最大呼叫深度
+    */
+    bool Context::SetMaxCallDepth(const char *func_name)
+    {
+        EpochScope scope(this);
+
+        if(!module||!func_name)
+            return(false);
+
+        uint32_t frame_bytes=0;
+
+        const int depth=module->GetCallDepth(func_name,&frame_bytes);
+
+        if(depth<=0)
+            return(false);
+
+        return SetMaxCallDepth(static_cast<uint32_t>(depth),frame_bytes);
     }
 
     bool Context::Goto(Func *func,int index)
@@ -82,6 +827,10 @@ namespace hgl::devil
         if(cur_state->func==func)
         {
             cur_state->index=index;     //跳转
+
+            if(func->IsReplaced())
+                RemapFrame(index);
+
             return(true);
         }
         else
@@ -97,6 +846,8 @@ namespace hgl::devil
 
     bool Context::Goto(const char *func_name,const char *flag)
     {
+        EpochScope scope(this);
+
         ClearStack();
 
         Func *func;
@@ -105,7 +856,8 @@ namespace hgl::devil
 
         if(func)
         {
-            ScriptFuncCall(func);
+            if(!ScriptFuncCall(func))
+                return(false);
         }
         else
         {
@@ -121,25 +873,43 @@ namespace hgl::devil
 
     bool Context::Return()
     {
-        if(run_state.empty())
+        if(run_depth<=stop_depth)
             return(false);
 
-        run_state.pop_back();                                                                //删除最后一个，即当前函数
+        --run_depth;                                                                         //删除最后一个，即当前函数
+        frame_top=run_state[run_depth].frame;                                               //弹出局部变量帧
 
-        if(!run_state.empty())                              //检查堆栈中还有没有数据
+        if(run_depth>stop_depth)                            //检查堆栈中还有没有本次运行的函数
         {
-            cur_state=&run_state[run_state.size()-1];       //退到上一级函数
+            cur_state=&run_state[run_depth-1];              //退到上一级函数
 
             return(true);
         }
         else
+        {
+            cur_state=(run_depth?&run_state[run_depth-1]:nullptr);     //嵌套呼叫时回到呼叫者，由CallFunc恢复状态
+            State=dvsStop;                                  //最外层函数返回，运行结束
             return(false);
+        }
     }
 
     bool Start(Func *,const va_list &);
 
+    bool Context::EnterFunc(Func *func)
+    {
+        ClearStack();
+
+        if(!ScriptFuncCall(func))
+            return(false);
+
+        State=dvsRun;
+        return(true);
+    }
+
     bool Context::Start(const char *func_name)
     {
+        EpochScope scope(this);
+
         ClearStack();
 
         Func *func;
@@ -148,7 +918,8 @@ namespace hgl::devil
 
         if(func)
         {
-            ScriptFuncCall(func);
+            if(!ScriptFuncCall(func))
+                return(false);
         }
         else
         {
@@ -162,13 +933,56 @@ namespace hgl::devil
         return RunContext();
     }
 
+    /**
+    * 从指定函数开始运行，可变参数按函数声明的参数类型依次读取(整数按int/int64，浮点数按double，字符串按char *传入)
+    */
     bool Context::Start(Func *func,...)
     {
+        EpochScope scope(this);
+
         if(!func)
             return(false);
 
+        uint64_t arg_value[MaxScriptParamCount];
+
+        {
+            const Func *latest=func->GetLatest();
+            va_list va;
+
+            va_start(va,func);
+
+            for(size_t i=0;i<latest->param_list.size();i++)
+            {
+                #define DEVIL_VA_ARG(T,V)   {const T value=static_cast<T>(va_arg(va,V));memcpy(arg_value+i,&value,sizeof(T));}break;
+
+                switch(latest->param_list[i].type)
+                {
+                    case ttBool:    DEVIL_VA_ARG(bool,      int)
+                    case ttInt:     DEVIL_VA_ARG(int,       int)
+                    case ttInt8:    DEVIL_VA_ARG(int8,      int)
+                    case ttInt16:   DEVIL_VA_ARG(int16,     int)
+                    case ttUInt:    DEVIL_VA_ARG(uint,      uint)
+                    case ttUInt8:   DEVIL_VA_ARG(uint8,     uint)
+                    case ttUInt16:  DEVIL_VA_ARG(uint16,    uint)
+                    case ttInt64:   DEVIL_VA_ARG(int64,     int64)
+                    case ttUInt64:  DEVIL_VA_ARG(uint64,    uint64)
+                    case ttFloat:   DEVIL_VA_ARG(float,     double)
+                    case ttDouble:  DEVIL_VA_ARG(double,    double)
+                    case ttString:  DEVIL_VA_ARG(char *,    char *)
+                    default:        break;
+                }
+
+                #undef DEVIL_VA_ARG
+            }
+
+            va_end(va);
+        }
+
         ClearStack();
-        ScriptFuncCall(func);
+
+        if(!ScriptFuncCall(func,arg_value))
+            return(false);
+
         State=dvsRun;
 
         return RunContext();
@@ -176,6 +990,8 @@ namespace hgl::devil
 
     bool Context::StartFlag(const char *func_name,const char *goto_flag)
     {
+        EpochScope scope(this);
+
         Func *func;
 
         func=module->GetScriptFunc(func_name);
@@ -190,11 +1006,16 @@ namespace hgl::devil
 
     bool Context::StartFlag(Func *func,const char *goto_flag)
     {
+        EpochScope scope(this);
+
         if(!func)
             return(false);
 
         ClearStack();
-        ScriptFuncCall(func);
+
+        if(!ScriptFuncCall(func))
+            return(false);
+
         State=dvsRun;
 
         if(Goto(goto_flag))
@@ -210,9 +1031,11 @@ namespace hgl::devil
 
     bool Context::Run(const char *func_name)
     {
-        if(!run_state.empty())
+        EpochScope scope(this);
+
+        if(run_depth>0)
         {
-            cur_state=&run_state[run_state.size()-1];       //取最后一个
+            cur_state=&run_state[run_depth-1];       //取最后一个
 
             if(cur_state->func)
             {
@@ -244,13 +1067,99 @@ namespace hgl::devil
         return RunContext();
     }
 
+    /**
+    * 准备从指定函数开始运行，但并不执行，之后可由Run/RunFor运行
+    */
+    bool Context::Prepare(const char *func_name)
+    {
+        EpochScope scope(this);
+
+        ClearStack();
+
+        Func *func=module->GetScriptFunc(func_name);
+
+        if(!func)
+        {
+            LogError("%s",
+                     ("没有找到起始函数: "+std::string(func_name)).c_str());
+            return(false);
+        }
+
+        if(!ScriptFuncCall(func))
+            return(false);
+
+        State=dvsRun;
+
+        return(true);
+    }
+
+    /**
+    * 以指令预算运行虚拟机，用于协作式分时
+    * @param max_instructions 本次最多执行的指令数量
+    * @return 是否运行正常。预算用完时状态为dvsPause(IsBudgetExhausted()为true)，再次调用RunFor/Run即可继续
+    */
+    bool Context::RunFor(uint64_t max_instructions)
+    {
+        EpochScope scope(this);
+
+        retired_count=0;
+
+        if(run_depth==0)
+        {
+            LogError("%s","RunFor时呼叫堆栈中没有函数");
+            return(false);
+        }
+
+        if(max_instructions==0)
+            return(true);
+
+        cur_state=&run_state[run_depth-1];
+        State=dvsRun;
+
+        return RunContext(max_instructions);
+    }
+
+    /**
+    * 运行虚拟机直到脚本结束/暂停或到达指定时间
+    * @param deadline 截止时间
+    * @param slice 每检查一次时间之间执行的指令数量
+    */
+    bool Context::RunUntil(const std::chrono::steady_clock::time_point &deadline,uint32_t slice)
+    {
+        EpochScope scope(this);
+
+        uint64_t total=0;
+
+        if(slice==0)
+            slice=1;
+
+        do
+        {
+            if(!RunFor(slice))
+            {
+                retired_count+=total;
+                return(false);
+            }
+
+            total+=retired_count;
+        }
+        while(IsBudgetExhausted()
+            &&std::chrono::steady_clock::now()<deadline);
+
+        retired_count=total;
+        return(true);
+    }
+
     void Context::Pause()
     {
         State=dvsPause;
+        budget_out=false;
     }
 
     void Context::Stop()
     {
+        EpochScope scope(this);
+
         State=dvsStop;
         ClearStack();
 
@@ -259,13 +1168,15 @@ namespace hgl::devil
 
     bool Context::Goto(const char *flag)
     {
+        EpochScope scope(this);
+
         if(!cur_state)
         {
 //          PutError(u"跳转时，虚拟机的当前运行函数不存在！");
 //          return(false);
 
-            if(!run_state.empty())
-                cur_state=&run_state[run_state.size()-1];       //取最后一个
+            if(run_depth>0)
+                cur_state=&run_state[run_depth-1];       //取最后一个
             else
             {
                 LogError("%s","跳转时，虚拟机的当前运行函数不存在！呼叫堆栈中也没有函数！");
@@ -290,8 +1201,181 @@ namespace hgl::devil
         return Goto(cur_state->func,index);
     }
 
+    namespace
+    {
+        template<typename T> void StoreScriptArg(const detail::ScriptArg &arg,uint64_t *target)
+        {
+            const T value=arg.To<T>();
+
+            memcpy(target,&value,sizeof(T));
+        }
+
+        /**
+        * 将宿主传入的参数按脚本函数的参数类型写入参数槽，字符串与数值不能互相转换
+        */
+        bool ConvertScriptArg(const detail::ScriptArg &arg,eTokenType type,uint64_t *target)
+        {
+            if((arg.type==detail::BindType::String)!=(type==ttString)
+             ||arg.type==detail::BindType::Void)
+                return(false);
+
+            switch(type)
+            {
+                #define DEVIL_SCRIPT_ARG(tt,T)  case tt:StoreScriptArg<T>(arg,target);return(true);
+
+                DEVIL_VALUE_TYPES(DEVIL_SCRIPT_ARG)
+
+                #undef DEVIL_SCRIPT_ARG
+
+                default:return(false);
+            }
+        }
+
+        template<typename T> void LoadScriptResult(uint64_t value,detail::ScriptArg &result)
+        {
+            T v;
+
+            memcpy(&v,&value,sizeof(T));
+
+            result=detail::ScriptArg::From(v);
+        }
+    }//namespace
+
+    /**
+    * 以句柄呼叫脚本函数，句柄无效时返回false且不输出日志
+    * @param handle 函数句柄
+    * @param arg 参数，个数须与函数声明一致
+    * @param arg_count 参数个数
+    * @param result 返回值，函数没有返回值时type为BindType::Void，可为nullptr
+    */
+    bool Context::Invoke(const FuncHandle &handle,const detail::ScriptArg *arg,uint32_t arg_count,detail::ScriptArg *result)
+    {
+        EpochScope scope(this);
+
+        Func *func=(module?module->GetScriptFunc(handle):nullptr);
+
+        if(!func)
+            return(false);
+
+        if(arg_count!=func->param_list.size())
+        {
+            LogError("%s",("呼叫脚本函数<"+func->func_name+">的参数个数不正确，需要"+std::to_string(func->param_list.size())+"个").c_str());
+            return(false);
+        }
+
+        uint64_t arg_value[MaxScriptParamCount];
+
+        for(uint32_t i=0;i<arg_count;i++)
+        {
+            if(!ConvertScriptArg(arg[i],func->param_list[i].type,arg_value+i))
+            {
+                LogError("%s",("呼叫脚本函数<"+func->func_name+">的第"+std::to_string(i+1)+"个参数类型无法转换").c_str());
+                return(false);
+            }
+        }
+
+        if(run_depth==0)                                    //没有在运行的函数时不需要保存、恢复呼叫堆栈
+        {
+            if(!RunFunc(func,arg_value))
+                return(false);
+        }
+        else
+        if(!CallFunc(func,arg_value,UINT64_MAX))
+            return(false);
+
+        if(result)
+        {
+            switch(func->result_type)
+            {
+                #define DEVIL_SCRIPT_RESULT(tt,T)   case tt:LoadScriptResult<T>(return_value,*result);break;
+
+                DEVIL_VALUE_TYPES(DEVIL_SCRIPT_RESULT)
+
+                #undef DEVIL_SCRIPT_RESULT
+
+                default:result->type=detail::BindType::Void;break;
+            }
+        }
+
+        return(true);
+    }
+
+    /**
+    * 以句柄开始运行，句柄无效(模块已清空)或函数编译失败时返回false，不做字符串查找也不输出日志
+    */
+    bool Context::Start(const FuncHandle &handle)
+    {
+        EpochScope scope(this);
+
+        Func *func=module->GetScriptFunc(handle);
+
+        if(!func||!EnterFunc(func))
+            return(false);
+
+        return RunContext();
+    }
+
+    bool Context::Prepare(const FuncHandle &handle)
+    {
+        EpochScope scope(this);
+
+        Func *func=module->GetScriptFunc(handle);
+
+        if(!func)
+            return(false);
+
+        return EnterFunc(func);
+    }
+
+    bool Context::StartFlag(const LabelHandle &handle)
+    {
+        EpochScope scope(this);
+
+        Func *func=module->GetScriptFunc(handle.func);
+
+        if(!func||!EnterFunc(func))
+            return(false);
+
+        if(!Goto(handle))
+            return(false);
+
+        return RunContext();
+    }
+
+    /**
+    * 以句柄跳转，当前帧可能执行的是旧版本，按该版本自己的编号表取得指令位置
+    */
+    bool Context::Goto(const LabelHandle &handle)
+    {
+        EpochScope scope(this);
+
+        if(!cur_state)
+        {
+            if(run_depth>0)
+                cur_state=&run_state[run_depth-1];
+            else
+                return(false);
+        }
+
+        Func *func=cur_state->func;
+
+        if(!module->IsValid(handle.func)
+         ||handle.func.index!=func->slot
+         ||handle.label>=func->label_index.size())
+            return(false);
+
+        const int index=func->label_index[handle.label];
+
+        if(index<0)                                                             //此版本中没有这个跳转标识
+            return(false);
+
+        return Goto(func,index);
+    }
+
     bool Context::GetCurrentState(std::string &func_name,int &func_line)
     {
+        EpochScope scope(this);
+
         if(!cur_state)return(false);
 
         func_name=cur_state->func->func_name;
@@ -300,14 +1384,26 @@ namespace hgl::devil
         return(true);
     }
 
+    /**
+    * 保存呼叫堆栈：每一级的函数名、指令编号与参数、局部变量帧<br>
+    * 字符串局部变量保存的是指针，只能在同一进程中、模块未清空时恢复
+    */
     bool Context::SaveState(std::vector<uint8_t> &out_bytes)
     {
+        EpochScope scope(this);
+
+        if(run_depth>UINT8_MAX                          //保存格式中深度只有一个字节
+         ||stop_depth>0)                                //嵌套呼叫中的状态无法恢复
+            return(false);
+
         ByteWriter writer(out_bytes);
         writer.reset();
-        writer.u8(static_cast<uint8_t>(run_state.size()));
+        writer.u8(static_cast<uint8_t>(run_depth));
 
-        for(const auto &state : run_state)
+        for(uint32_t i=0;i<run_depth;i++)
         {
+            const ScriptFuncRunState &state=run_state[i];
+
             if(!state.func)
                 return(false);
 
@@ -315,6 +1411,19 @@ namespace hgl::devil
                 return(false);
 
             writer.i32(static_cast<int32_t>(state.index));
+
+            const uint32_t size=state.func->frame_size;                    //参数与局部变量，已按8字节对齐
+            const uint8_t *frame=reinterpret_cast<const uint8_t *>(frame_stack.data())+state.frame;
+
+            writer.i32(static_cast<int32_t>(size));
+
+            for(uint32_t offset=0;offset<size;offset+=sizeof(int32_t))
+            {
+                int32_t word;
+
+                memcpy(&word,frame+offset,sizeof(int32_t));
+                writer.i32(word);
+            }
         }
 
         return(true);
@@ -322,6 +1431,8 @@ namespace hgl::devil
 
     bool Context::LoadState(const std::vector<uint8_t> &in_bytes)
     {
+        EpochScope scope(this);
+
         ClearStack();
         cur_state=nullptr;
 
@@ -341,17 +1452,46 @@ namespace hgl::devil
             if(!reader.i32(index))
                 return(false);
 
-            ScriptFuncRunState sfrs;
-            sfrs.func=module->GetScriptFunc(name);
-            if(!sfrs.func)
+            int32_t size=0;
+            if(!reader.i32(size))
+                return(false);
+
+            Func *func=module->GetScriptFunc(name);
+            if(!func)
                 return(false);
-            sfrs.index=index;
 
-            run_state.push_back(sfrs);
+            if(!ScriptFuncCall(func))
+                return(false);
+
+            if(static_cast<uint32_t>(size)!=cur_state->func->frame_size)  //函数的局部变量布局已改变(如被热更新)
+            {
+                LogError("%s",("恢复状态时函数的局部变量布局不一致: "+name).c_str());
+                ClearStack();
+                cur_state=nullptr;
+                return(false);
+            }
+
+            uint8_t *frame=reinterpret_cast<uint8_t *>(frame_stack.data())+cur_state->frame;
+
+            for(int32_t offset=0;offset<size;offset+=sizeof(int32_t))
+            {
+                int32_t word;
+
+                if(!reader.i32(word))
+                {
+                    ClearStack();
+                    cur_state=nullptr;
+                    return(false);
+                }
+
+                memcpy(frame+offset,&word,sizeof(int32_t));
+            }
+
+            cur_state->index=index;
         }
 
-        if(!run_state.empty())
-            cur_state=&run_state[run_state.size()-1];
+        if(run_depth>0)
+            cur_state=&run_state[run_depth-1];
 
         return(true);
     }
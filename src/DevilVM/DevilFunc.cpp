@@ -5,27 +5,30 @@ namespace hgl
 {
 namespace devil
 {
-    bool Func::AddGotoFlag(const std::string &name)
+    bool Func::AddGotoFlag(std::string_view name,bool inner)
     {
         int count=static_cast<int>(command.size());
 
         if(goto_flag.find(name)==goto_flag.end())
         {
-            goto_flag.emplace(name,count);
+            goto_flag.emplace(std::string(name),count);
 
-            LogInfo("%s",(":"+name).c_str());
+            if(inner)
+                inner_flag.emplace(name);
+
+            LogInfo("%s",(":"+std::string(name)).c_str());
 
             return(true);
         }
         else
         {
-            LogInfo("%s",("添加跳转标识符失败，这个标识符重复了:"+name).c_str());
+            LogInfo("%s",("添加跳转标识符失败，这个标识符重复了:"+std::string(name)).c_str());
 
             return(false);
         }
     }
 
-    int Func::FindGotoFlag(const std::string &name)
+    int Func::FindGotoFlag(std::string_view name)
     {
         int index;
 
@@ -36,74 +39,366 @@ namespace devil
         return -1;
     }
 
-    void Func::AddGotoCommand(const std::string &name)
+    bool Func::SameSignature(const Func *other)const
+    {
+        if(result_type!=other->result_type
+         ||param_list.size()!=other->param_list.size())
+            return(false);
+
+        for(size_t i=0;i<param_list.size();i++)
+            if(param_list[i].type!=other->param_list[i].type)
+                return(false);
+
+        return(true);
+    }
+
+    bool Func::SameFrameLayout(const Func *other)const
+    {
+        if(frame_size!=other->frame_size
+         ||script_value_list.size()!=other->script_value_list.size())
+            return(false);
+
+        for(const auto &kv:other->script_value_list)
+        {
+            const auto it=script_value_list.find(kv.first);
+
+            if(it==script_value_list.end()
+             ||it->second.type!=kv.second.type
+             ||it->second.offset!=kv.second.offset)
+                return(false);
+        }
+
+        return(true);
+    }
+
+    void Func::ReleaseBody()
+    {
+        bytecode.clear();
+        bytecode.shrink_to_fit();
+        command.clear();
+        command.shrink_to_fit();
+        goto_flag.clear();
+        inner_flag.clear();
+        label_index.clear();
+        label_index.shrink_to_fit();
+        script_value_list.clear();
+        value_call_list.clear();
+        value_call_list.shrink_to_fit();
+        frame_init.clear();
+        frame_init.shrink_to_fit();
+        lazy_source.reset();
+        lazy_body=std::string_view();
+
+        if(arena)
+        {
+            --arena->func_count;                                            //指令等随Arena整体释放
+            arena=nullptr;
+        }
+
+        for(Arena *a:inline_arena)
+            --a->func_count;
+
+        inline_arena.clear();
+        inline_arena.shrink_to_fit();
+    }
+
+    void Func::AddGotoCommand(std::string_view name)
     {
         #ifdef _DEBUG
-        command.emplace_back(std::make_unique<Goto>(module,this,name));
+        command.emplace_back(arena->New<Goto>(module,this,arena->CopyString(name)));
         const int index=static_cast<int>(command.size()-1);
 
         LogInfo("%s",
-            (std::to_string(index)+"\tgoto "+name+";")
+            (std::to_string(index)+"\tgoto "+std::string(name)+";")
                 .c_str());
         #else
-        command.emplace_back(std::make_unique<Goto>(module,this,name));
+        command.emplace_back(arena->New<Goto>(module,this,arena->CopyString(name)));
         #endif//_DEBUG
     }
 
     void Func::AddReturn()
     {
         #ifdef _DEBUG
-        command.emplace_back(std::make_unique<Return>(module));
+        command.emplace_back(arena->New<Return>(module));
         const int index=static_cast<int>(command.size()-1);
 
         LogInfo("%s",(std::to_string(index)+"\treturn;")
             .c_str());
         #else
-        command.emplace_back(std::make_unique<Return>(module));
+        command.emplace_back(arena->New<Return>(module));
+        #endif//_DEBUG
+    }
+
+    bool Func::AddReturnValue(ValueInterface *value)
+    {
+        if(result_type==ttVoid)
+        {
+            LogError("%s",("函数<"+func_name+">没有声明返回类型，return不能带返回值").c_str());
+            return(false);
+        }
+
+        CallArg result;
+
+        if(!InitCallArg(result,result_type,value))
+        {
+            LogError("%s",("函数<"+func_name+">的返回值类型无法转换").c_str());
+            return(false);
+        }
+
+        command.emplace_back(arena->New<ReturnValue>(module,result));
+
+        #ifdef _DEBUG
+        LogInfo("%s",(std::to_string(command.size()-1)+"\treturn value;").c_str());
         #endif//_DEBUG
+
+        return(true);
     }
 
-    void Func::AddScriptFuncCall(Func *script_func)
+    void Func::AddScriptFuncCall(Func *script_func,CallArg *arg,uint32_t arg_count)
     {
         #ifdef _DEBUG
-        command.emplace_back(std::make_unique<ScriptFuncCall>(module,script_func));
+        command.emplace_back(arena->New<ScriptFuncCall>(module,script_func,arg,arg_count));
         const int index=static_cast<int>(command.size()-1);
 
         LogInfo("%s",
             (std::to_string(index)+"\t call "+script_func->func_name)
                 .c_str());
         #else
-        command.emplace_back(std::make_unique<ScriptFuncCall>(module,script_func));
+        command.emplace_back(arena->New<ScriptFuncCall>(module,script_func,arg,arg_count));
         #endif//
     }
 
-    ValueInterface *Func::AddValue(eTokenType type,const std::string &name)
+    void Func::UpdateGotoFlag()
+    {
+        for(Command *cmd:command)
+        {
+            if(auto *goto_cmd=dynamic_cast<Goto *>(cmd))
+                goto_cmd->UpdateGotoFlag();
+            else
+            if(auto *comp_goto_cmd=dynamic_cast<CompGoto *>(cmd))
+                comp_goto_cmd->UpdateGotoFlag();
+            else
+            if(auto *inline_cmd=dynamic_cast<InlineCall *>(cmd))
+                inline_cmd->UpdateGotoFlag();
+        }
+    }
+
+    void Func::CompileBytecode()
+    {
+        const int count=static_cast<int>(command.size());
+
+        bytecode.clear();
+        bytecode.resize(count);
+
+        for(int i=0;i<count;i++)
+        {
+            Instruction &ins=bytecode[i];
+
+            ins.op=OpCode::Nop;
+            ins.index=-1;
+
+            if(!command[i])
+                continue;
+
+            if(!command[i]->Compile(ins))
+            {
+                ins.op=OpCode::Command;
+                ins.cmd=command[i];
+            }
+        }
+    }
+
+    bool Func::AddValue(eTokenType type,std::string_view name)
     {
         if(script_value_list.find(name)!=script_value_list.end())
         {
-            LogError("%s",("添加变量失败，变量名称重复:"+name).c_str());
+            LogError("%s",("添加变量失败，变量名称重复:"+std::string(name)).c_str());
 
-            return(nullptr);
+            return(false);
         }
 
-        if(type==ttBool     )return(new ScriptValue<bool       >(module,func_name,name,type));else
-        if(type==ttString   )return(new ScriptValue<std::string>(module,func_name,name,type));else
-        if(type==ttInt      )return(new ScriptValue<int        >(module,func_name,name,type));else
-        if(type==ttUInt     )return(new ScriptValue<uint       >(module,func_name,name,type));else
-        if(type==ttInt8     )return(new ScriptValue<int8       >(module,func_name,name,type));else
-        if(type==ttUInt8    )return(new ScriptValue<uint8      >(module,func_name,name,type));else
-        if(type==ttInt16    )return(new ScriptValue<int16      >(module,func_name,name,type));else
-        if(type==ttUInt16   )return(new ScriptValue<uint16     >(module,func_name,name,type));else
-        if(type==ttInt64    )return(new ScriptValue<int64      >(module,func_name,name,type));else
-        if(type==ttUInt64   )return(new ScriptValue<uint64     >(module,func_name,name,type));else
-        if(type==ttFloat    )return(new ScriptValue<float      >(module,func_name,name,type));else
-        if(type==ttDouble   )return(new ScriptValue<double     >(module,func_name,name,type));else
+        const uint32_t size=GetValueSize(type);
+
+        if(!size)
         {
             LogError("%s",
-                     ("变量类型无法识别,name="+name+",id="
+                     ("变量类型无法识别,name="+std::string(name)+",id="
                       +std::to_string(type)).c_str());
+            return(false);
+        }
+
+        const uint32_t offset=AllocValue(size);
+
+        script_value_list.emplace(std::string(name),ScriptValueSlot{type,offset});
+
+        LogInfo("%s",(std::string(GetTokenName(type))+" "+std::string(name)+"; //frame+"+std::to_string(offset)).c_str());
+
+        return(true);
+    }
+
+    uint32_t Func::AllocValue(uint32_t size)
+    {
+        const uint32_t offset=(value_bytes+size-1)/size*size;              //按自身大小对齐
+
+        value_bytes=offset+size;
+        frame_size=(value_bytes+7)&~7u;
+        frame_init.resize(frame_size,0);
+
+        return offset;
+    }
+
+    /**
+    * 参数与局部变量一样存放在帧中，只按类型依次分配，所以呼叫者在函数体编译之前就能知道参数的位置
+    */
+    bool Func::AddParam(eTokenType type,std::string_view name)
+    {
+        if(param_list.size()>=MaxScriptParamCount)
+        {
+            LogError("%s",("函数<"+func_name+">的参数过多，最多"+std::to_string(MaxScriptParamCount)+"个").c_str());
+            return(false);
+        }
+
+        if(param_list.size()!=script_value_list.size()
+         ||!AddValue(type,name))
+            return(false);
+
+        param_list.push_back(script_value_list.find(name)->second);
+        return(true);
+    }
+
+    ValueInterface *Func::CreateValue(std::string_view name)
+    {
+        const auto it=script_value_list.find(name);
+
+        if(it==script_value_list.end())
+            return(nullptr);
+
+        return CreateScriptValue(*arena,module,it->second.type,it->second.offset);
+    }
+
+    namespace
+    {
+        template<typename T> ScriptValueEqu<T> *CreateAssign(Arena &arena,uint32_t offset,ValueInterface *value)
+        {
+            switch(value->type)
+            {
+                #define DEVIL_ASSIGN_SOURCE(tt,S)   case tt:return(arena.New<ScriptValueEqu<T>>(offset,value,&LoadValueAs<T,S>));
+
+                DEVIL_VALUE_TYPES(DEVIL_ASSIGN_SOURCE)
+
+                #undef DEVIL_ASSIGN_SOURCE
+
+                default:return(nullptr);
+            }
+        }
+
+        template<typename T> bool AssignValue(Func *func,uint32_t offset,ValueInterface *value,bool init)
+        {
+            ScriptValueEqu<T> *cmd=CreateAssign<T>(*func->arena,offset,value);
+
+            if(!cmd)
+                return(false);
+
+            if(init)                                        //常量直接写入初始帧，不产生指令
+            {
+                cmd->Assign(func->frame_init.data(),nullptr);
+            }
+            else
+                func->AddCommand(cmd);
+
+            return(true);
+        }
+    }//namespace
+
+    uint32_t GetValueSize(eTokenType type)
+    {
+        switch(type)
+        {
+            #define DEVIL_VALUE_SIZE(tt,T)  case tt:return sizeof(T);
+
+            DEVIL_VALUE_TYPES(DEVIL_VALUE_SIZE)
+
+            #undef DEVIL_VALUE_SIZE
+
+            default:return(0);
+        }
+    }
+
+    ValueInterface *CreateScriptValue(Arena &arena,Module *module,eTokenType type,uint32_t offset)
+    {
+        switch(type)
+        {
+            #define DEVIL_VALUE_CREATE(tt,T)    case tt:return(arena.New<ScriptValue<T>>(module,tt,offset));
+
+            DEVIL_VALUE_TYPES(DEVIL_VALUE_CREATE)
+
+            #undef DEVIL_VALUE_CREATE
+
+            default:return(nullptr);
+        }
+    }
+
+    Command *CreateScriptValueAssign(Arena &arena,eTokenType type,uint32_t offset,ValueInterface *value)
+    {
+        if((type==ttString)!=(value->type==ttString))                  //字符串与数值不能互相赋值
             return(nullptr);
+
+        switch(type)
+        {
+            #define DEVIL_ASSIGN_TARGET(tt,T)   case tt:return CreateAssign<T>(arena,offset,value);
+
+            DEVIL_VALUE_TYPES(DEVIL_ASSIGN_TARGET)
+
+            #undef DEVIL_ASSIGN_TARGET
+
+            default:return(nullptr);
+        }
+    }
+
+    /**
+    * 增加局部变量赋值
+    * @param name 变量名称
+    * @param value 所赋的量(位于本函数的Arena中)
+    * @param declare 是否是变量定义时的初始化
+    */
+    bool Func::AddAssign(std::string_view name,ValueInterface *value,bool declare)
+    {
+        const auto it=script_value_list.find(name);
+
+        if(it==script_value_list.end()||!value)
+        {
+            LogError("%s",("赋值失败，没有找到变量:"+std::string(name)).c_str());
+            return(false);
+        }
+
+        const ScriptValueSlot &slot=it->second;
+
+        if((slot.type==ttString)!=(value->type==ttString))
+        {
+            LogError("%s",("赋值失败，字符串与数值不能互相赋值:"+std::string(name)).c_str());
+            return(false);
+        }
+
+        //定义在所有指令与跳转标识之前的常量初始化永远只会执行一次，可直接写入初始帧
+        const bool init=declare&&value->IsConstant()&&command.empty()&&goto_flag.empty();
+
+        bool result;
+
+        switch(slot.type)
+        {
+            #define DEVIL_ASSIGN_TARGET(tt,T)   case tt:result=AssignValue<T>(this,slot.offset,value,init);break;
+
+            DEVIL_VALUE_TYPES(DEVIL_ASSIGN_TARGET)
+
+            #undef DEVIL_ASSIGN_TARGET
+
+            default:result=false;break;
         }
+
+        if(!result)
+            LogError("%s",("赋值失败，类型无法转换:"+std::string(name)).c_str());
+
+        return(result);
     }
 }//namespace devil
 }//namespace hgl
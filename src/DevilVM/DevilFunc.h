@@ -2,15 +2,33 @@
 
 #include "DevilCommand.h"
 #include <string>
+#include <string_view>
 #include <hgl/log/Log.h>
 #include <absl/container/inlined_vector.h>
+#include <atomic>
 #include <memory>
+#include <vector>
 #include <ankerl/unordered_dense.h>
 
 namespace hgl::devil
 {
     class Module;
 
+    struct ScriptValueSlot                                                  //脚本局部变量槽
+    {
+        eTokenType type;                                                    //数据类型
+        uint32_t offset;                                                    //在局部变量帧中的字节偏移
+    };
+
+    enum class FuncState:uint8_t
+    {
+        Ready,                                                              //已编译
+        Pending,                                                            //延迟编译，尚未用到
+        Queued,                                                             //已排入延迟编译队列
+        Compiling,                                                          //正在延迟编译，同一次编译中呼叫它的函数(包括它自己)可以直接引用
+        Failed,                                                             //延迟编译失败(或呼叫的函数编译失败)，不可执行
+    };//enum class FuncState
+
     /**
     * 虚拟机内脚本函数定义
     */
@@ -20,25 +38,59 @@ namespace hgl::devil
 
         Module *module;
 
+        uint32_t value_bytes;                                               //局部变量已分配字节数
+
     public:
 
         std::string func_name;
 
-        absl::InlinedVector<std::unique_ptr<Command>, 8> command;
+        Arena *arena;                                                       //函数体(指令、量、比较式、参数块)所在的Arena，由Module持有
+        std::vector<Arena *> inline_arena;                                  //内联展开的函数体所在的其它Arena(展开时直接引用其中的指令，各计一个函数计数)
+
+        absl::InlinedVector<Command *, 8> command;
+
+        Bytecode bytecode;                                                  //由command降级而来的连续字节码
+
+        StringMap<int> goto_flag;
+        ankerl::unordered_dense::set<std::string,StringHash,std::equal_to<>> inner_flag;   //if/else自动生成的跳转标识，只供本函数的比较跳转使用，优化后清除
+
+        uint32_t slot;                                                      //在模块中的编号(FuncHandle::index)，同名的各版本相同
+        std::vector<int> label_index;                                       //以模块分配的跳转标识编号(LabelHandle::label)为下标的指令编号，-1表示此版本中没有
 
-        ankerl::unordered_dense::map<std::string,int> goto_flag;
+        StringMap<ScriptValueSlot> script_value_list;                       //局部变量表
 
-        ankerl::unordered_dense::map<std::string,ValueInterface *> script_value_list;
+        eTokenType result_type;                                             //返回类型，ttVoid表示没有返回值
+        std::vector<ScriptValueSlot> param_list;                            //参数，依次位于局部变量帧的最前面，声明时即已确定
+        std::vector<Func *> value_call_list;                                //在量中呼叫的脚本函数(不在字节码中)，供呼叫深度分析
+
+        uint32_t frame_size;                                                //局部变量帧字节数(8字节对齐)
+        std::vector<uint8_t> frame_init;                                    //局部变量帧初始值，函数呼叫时复制到Context的帧栈中
+
+        std::atomic<FuncState> state;                                       //Ready在函数完全编译后以release发布，其它线程以acquire读取
+        std::shared_ptr<const std::string> lazy_source;                     //延迟编译时保留的整段脚本源码，编译后释放
+        std::string_view lazy_body;                                         //函数名之后到函数体结束的源码
+
+        std::atomic<Func *> replaced;                                       //热更新后替换此函数的最新版本
+        Func *prev_version;                                                 //被此函数替换的上一版本
 
     public:
 
-        Func(Module *dvm,const std::string &name){module=dvm;func_name=name;}
+        Func(Module *dvm,const std::string &name):replaced(nullptr){module=dvm;func_name=name;arena=nullptr;slot=UINT32_MAX;result_type=ttVoid;frame_size=0;value_bytes=0;state=FuncState::Ready;prev_version=nullptr;}
+
+        bool IsReplaced()const{return replaced.load(std::memory_order_relaxed)!=nullptr;}
+        Func *GetLatest(){Func *f=replaced.load(std::memory_order_acquire);return f?f:this;}   ///<取得最新版本，呼叫与启动都经由此处，旧版本只供已在执行的帧使用
+        const Func *GetLatest()const{const Func *f=replaced.load(std::memory_order_acquire);return f?f:this;}
 
-        bool AddGotoFlag(const std::string &);      //增加跳转旗标
-        int FindGotoFlag(const std::string &);      //查找跳转旗标
+        bool SameSignature(const Func *)const;                              ///<参数与返回类型是否相同(热更新不能改变，呼叫者按声明编译)
+        bool SameFrameLayout(const Func *)const;                            ///<局部变量帧布局是否完全相同(热更新时执行中的帧可以直接换到新版本)
+        void ReleaseBody();                                                 ///<旧版本不再被任何Context引用后释放函数体，函数对象保留供呼叫指令转发(所在Arena的函数计数减1)
 
-        void AddGotoCommand(const std::string &);   //增加跳转指令
+        bool AddGotoFlag(std::string_view,bool inner=false);   //增加跳转旗标(inner为自动生成的标识)
+        int FindGotoFlag(std::string_view);         //查找跳转旗标
+
+        void AddGotoCommand(std::string_view);      //增加跳转指令
         void AddReturn();                           //增加返回指令
+        bool AddReturnValue(ValueInterface *);      //增加带返回值的返回指令
 
         int AddCommand(Command *cmd)           //直接增加指令
         {
@@ -46,8 +98,23 @@ namespace hgl::devil
             return static_cast<int>(command.size()-1);
         }
 
-        void AddScriptFuncCall(Func *);        //增加脚本函数呼叫
+        void AddScriptFuncCall(Func *,CallArg *arg=nullptr,uint32_t arg_count=0);  //增加脚本函数呼叫
+
+        void Optimize();                       //常量折叠、跳转重定向与死代码消除，须在解析跳转位置之前
+        void UpdateGotoFlag();                 //按名字解析全部跳转指令的跳转位置
+        void CompileBytecode();                //将command降级为字节码
 
-        ValueInterface *AddValue(eTokenType,const std::string &);          //增加一个变量
+        int Inline(uint32_t);                  //展开呼叫的小函数(不超过指定指令数)，返回展开的呼叫数，展开后已重新解析跳转并生成字节码
+
+        uint32_t AllocValue(uint32_t);                                      //在局部变量帧中按自身大小对齐分配，返回偏移
+        bool AddValue(eTokenType,std::string_view);                         //增加一个局部变量
+        bool AddParam(eTokenType,std::string_view);                         //增加一个参数(须在所有局部变量之前)
+        bool HasValue(std::string_view name)const{return script_value_list.find(name)!=script_value_list.end();}
+        ValueInterface *CreateValue(std::string_view);                      //创建一个读取局部变量的量，没有这个变量返回nullptr
+        bool AddAssign(std::string_view,ValueInterface *,bool);             //增加局部变量赋值
     };//class Func
+
+    uint32_t        GetValueSize(eTokenType);                                                   ///<取得数据类型的字节数，无法识别返回0
+    ValueInterface *CreateScriptValue(Arena &,Module *,eTokenType,uint32_t);                    ///<创建读取局部变量帧中指定偏移的量
+    Command *       CreateScriptValueAssign(Arena &,eTokenType,uint32_t,ValueInterface *);      ///<创建局部变量赋值，类型无法转换时返回nullptr
 }//namespace hgl::devil
@@ -0,0 +1,1309 @@
+#include"DevilImage.h"
+#include"DevilFunc.h"
+#include <hgl/devil/DevilModule.h>
+#include <cstring>
+#include <cstdio>
+#include <memory>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif//_WIN32
+
+namespace hgl::devil
+{
+    namespace
+    {
+        uint64_t ImageChecksum(const uint8_t *data,size_t size)                //FNV-1a 64，每次处理8字节
+        {
+            uint64_t hash=0xcbf29ce484222325ull;
+            size_t i=0;
+
+            for(;i+8<=size;i+=8)
+            {
+                uint64_t word;
+
+                memcpy(&word,data+i,8);
+
+                hash^=word;
+                hash*=0x100000001b3ull;
+                hash^=hash>>29;                                                 //乘法只向高位扩散，折回低位使每个字节都影响结果
+            }
+
+            for(;i<size;i++)
+            {
+                hash^=data[i];
+                hash*=0x100000001b3ull;
+            }
+
+            return hash;
+        }
+
+        template<typename T>
+        void AppendSection(std::vector<uint8_t> &out,image::Section &section,const T *data,size_t count)
+        {
+            out.resize((out.size()+7)&~size_t(7),0);                           //各段8字节对齐，参数块可直接当作SystemFuncParam使用
+
+            section.offset=static_cast<uint32_t>(out.size());
+            section.count=static_cast<uint32_t>(count);
+
+            const uint8_t *p=reinterpret_cast<const uint8_t *>(data);
+
+            out.insert(out.end(),p,p+count*sizeof(T));
+        }
+    }//namespace
+
+    ImageWriter::ImageWriter(const std::vector<Func *> &funcs,const StringMap<FuncMap *> &func_map,const StringMap<PropertyMap *> &prop_map)
+    {
+        string_pool.push_back('\0');                                           //偏移0为空字符串
+
+        for(const auto &kv:func_map)
+            bind_name.emplace(kv.second,kv.first);
+
+        for(const auto &kv:prop_map)
+            bind_name.emplace(kv.second,kv.first);
+
+        for(size_t i=0;i<funcs.size();i++)
+            func_index.emplace(funcs[i],static_cast<uint32_t>(i));
+    }
+
+    uint32_t ImageWriter::AddString(std::string_view str)
+    {
+        const auto it=string_index.find(str);
+
+        if(it!=string_index.end())
+            return it->second;
+
+        const uint32_t offset=static_cast<uint32_t>(string_pool.size());
+
+        string_pool.append(str);
+        string_pool.push_back('\0');
+
+        string_index.emplace(std::string(str),offset);
+        return offset;
+    }
+
+    int32_t ImageWriter::AddNative(const FuncMap *map)
+    {
+        {
+            const auto it=bind_index.find(map);
+
+            if(it!=bind_index.end())
+                return it->second;
+        }
+
+        const auto it=bind_name.find(map);
+
+        if(it==bind_name.end()||map->param.size()>UINT8_MAX)
+            return(-1);
+
+        image::NativeRecord rec{};
+
+        rec.name=AddString(it->second);
+        rec.first_param_type=static_cast<uint32_t>(param_type_list.size());
+        rec.result=static_cast<uint8_t>(map->result);
+        rec.param_count=static_cast<uint8_t>(map->param.size());
+
+        for(const eTokenType type:map->param)
+            param_type_list.push_back(static_cast<uint8_t>(type));
+
+        const int32_t index=static_cast<int32_t>(native_list.size());
+
+        native_list.push_back(rec);
+        bind_index.emplace(map,index);
+        return index;
+    }
+
+    int32_t ImageWriter::AddProperty(const PropertyMap *map)
+    {
+        {
+            const auto it=bind_index.find(map);
+
+            if(it!=bind_index.end())
+                return it->second;
+        }
+
+        const auto it=bind_name.find(map);
+
+        if(it==bind_name.end())
+            return(-1);
+
+        const int32_t index=static_cast<int32_t>(property_list.size());
+
+        property_list.push_back(image::PropertyRecord{AddString(it->second),static_cast<uint32_t>(map->type)});
+        bind_index.emplace(map,index);
+        return index;
+    }
+
+    /**
+    * 写出一个参数块，字符串参数转为字符串池中的偏移
+    * @param param_count 参数块中的参数个数(可能包含x64汇编呼叫所需的this)
+    */
+    bool ImageWriter::AddParam(const FuncMap *map,const SystemFuncParam *param,int param_count,uint32_t &first,uint32_t &count)
+    {
+        const int skip=map->ThisInParam()?1:0;                                  //this在载入时按目标模块的映射重新放置
+
+        if(param_count-skip!=static_cast<int>(map->param.size()))
+            return(false);
+
+        first=static_cast<uint32_t>(param_list.size());
+        count=static_cast<uint32_t>(map->param.size());
+
+        for(uint32_t i=0;i<count;i++)
+        {
+            const SystemFuncParam &p=param[skip+i];
+
+            if(map->param[i]==ttString)
+                param_list.push_back(AddString(p.str?p.str:""));
+            else
+                param_list.push_back(p.ui64);
+        }
+
+        return(true);
+    }
+
+    /**
+    * 写出脚本函数呼叫的参数，各参数的量先全部写出(其中可能还有呼叫)，量序号再连续存放
+    */
+    bool ImageWriter::AddArgs(const CallArg *arg,uint32_t arg_count,uint32_t &first)
+    {
+        uint32_t index[MaxScriptParamCount];
+
+        if(arg_count>MaxScriptParamCount)
+            return(false);
+
+        for(uint32_t i=0;i<arg_count;i++)
+        {
+            const int32_t value=arg[i].value->Save(*this);
+
+            if(value<0)
+                return(false);
+
+            index[i]=value;
+        }
+
+        first=static_cast<uint32_t>(arg_list.size());
+        arg_list.insert(arg_list.end(),index,index+arg_count);
+        return(true);
+    }
+
+    bool ImageWriter::WriteFunc(const Func *func)
+    {
+        image::FuncRecord rec{};
+
+        rec.name=AddString(func->func_name);
+        rec.frame_size=func->frame_size;
+        rec.frame_init=static_cast<uint32_t>(frame_list.size());
+        rec.first_label=static_cast<uint32_t>(label_list.size());
+        rec.label_count=static_cast<uint32_t>(func->goto_flag.size());
+        rec.first_command=static_cast<uint32_t>(command_list.size());
+        rec.command_count=static_cast<uint32_t>(func->command.size());
+        rec.first_param_type=static_cast<uint32_t>(param_type_list.size());
+        rec.result=static_cast<uint8_t>(func->result_type);
+        rec.param_count=static_cast<uint8_t>(func->param_list.size());
+
+        for(const ScriptValueSlot &param:func->param_list)
+            param_type_list.push_back(static_cast<uint8_t>(param.type));
+
+        frame_list.insert(frame_list.end(),func->frame_init.begin(),func->frame_init.end());
+        frame_list.resize(rec.frame_init+rec.frame_size,0);
+
+        for(const auto &kv:func->goto_flag)
+            label_list.push_back(image::LabelRecord{AddString(kv.first),kv.second});
+
+        for(size_t i=0;i<func->command.size();i++)
+        {
+            const Command *cmd=func->command[i];
+
+            if(!cmd||!cmd->Save(*this))
+            {
+                LogError("%s",("函数<"+func->func_name+">的第"+std::to_string(i)+"条指令无法写入映像").c_str());
+                return(false);
+            }
+        }
+
+        func_list.push_back(rec);
+        return(true);
+    }
+
+    bool ImageWriter::WriteNativeCall(const FuncMap *map,const SystemFuncParam *param,int param_count)
+    {
+        image::CommandRecord rec{};
+
+        const int32_t native=AddNative(map);
+
+        if(native<0||!AddParam(map,param,param_count,rec.b,rec.c))
+            return(false);
+
+        rec.kind=uint8_t(image::CommandKind::NativeCall);
+        rec.a=native;
+
+        command_list.push_back(rec);
+        return(true);
+    }
+
+    bool ImageWriter::WriteScriptCall(const Func *func,const CallArg *arg,uint32_t arg_count,bool tail)
+    {
+        const auto it=func_index.find(func->GetLatest());
+
+        if(it==func_index.end())
+            return(false);
+
+        image::CommandRecord rec{};
+
+        if(!AddArgs(arg,arg_count,rec.b))
+            return(false);
+
+        rec.kind=uint8_t(image::CommandKind::ScriptCall);
+        rec.type=tail;
+        rec.a=it->second;
+        rec.c=arg_count;
+
+        command_list.push_back(rec);
+        return(true);
+    }
+
+    bool ImageWriter::WriteGoto(std::string_view flag)
+    {
+        image::CommandRecord rec{};
+
+        rec.kind=uint8_t(image::CommandKind::Goto);
+        rec.a=AddString(flag);
+
+        command_list.push_back(rec);
+        return(true);
+    }
+
+    bool ImageWriter::WriteCompGoto(const CompInterface *comp,std::string_view else_flag)
+    {
+        const int32_t index=comp->Save(*this);
+
+        if(index<0)
+            return(false);
+
+        image::CommandRecord rec{};
+
+        rec.kind=uint8_t(image::CommandKind::CompGoto);
+        rec.a=index;
+        rec.b=AddString(else_flag);
+
+        command_list.push_back(rec);
+        return(true);
+    }
+
+    /**
+    * @param forward 被展开的函数已被替换，载入后展开的函数体不再有效，总是呼叫最新版本
+    * @param tail 展开处在尾位置
+    */
+    bool ImageWriter::WriteInlineCall(const Func *callee,std::string_view end_flag,bool forward,bool tail)
+    {
+        const auto it=func_index.find(callee->GetLatest());
+
+        if(it==func_index.end())
+            return(false);
+
+        image::CommandRecord rec{};
+
+        rec.kind=uint8_t(image::CommandKind::InlineCall);
+        rec.type=tail;
+        rec.a=it->second;
+        rec.b=AddString(end_flag);
+        rec.c=forward;
+
+        command_list.push_back(rec);
+        return(true);
+    }
+
+    bool ImageWriter::WriteReturn()
+    {
+        image::CommandRecord rec{};
+
+        rec.kind=uint8_t(image::CommandKind::Return);
+
+        command_list.push_back(rec);
+        return(true);
+    }
+
+    bool ImageWriter::WriteReturnValue(const ValueInterface *value)
+    {
+        const int32_t index=value->Save(*this);
+
+        if(index<0)
+            return(false);
+
+        image::CommandRecord rec{};
+
+        rec.kind=uint8_t(image::CommandKind::ReturnValue);
+        rec.a=index;
+
+        command_list.push_back(rec);
+        return(true);
+    }
+
+    bool ImageWriter::WriteAssign(eTokenType type,uint32_t offset,const ValueInterface *value)
+    {
+        const int32_t index=value->Save(*this);
+
+        if(index<0)
+            return(false);
+
+        image::CommandRecord rec{};
+
+        rec.kind=uint8_t(image::CommandKind::Assign);
+        rec.type=static_cast<uint8_t>(type);
+        rec.a=offset;
+        rec.b=index;
+
+        command_list.push_back(rec);
+        return(true);
+    }
+
+    int32_t ImageWriter::AddConstValue(eTokenType type,const void *data,size_t size)
+    {
+        if(size>sizeof(image::ValueRecord::data))
+            return(-1);
+
+        image::ValueRecord rec{};
+
+        rec.kind=uint8_t(image::ValueKind::Constant);
+        rec.type=static_cast<uint8_t>(type);
+        memcpy(rec.data,data,size);
+
+        value_list.push_back(rec);
+        return static_cast<int32_t>(value_list.size()-1);
+    }
+
+    int32_t ImageWriter::AddPropertyValue(eTokenType type,const PropertyMap *map)
+    {
+        const int32_t index=AddProperty(map);
+
+        if(index<0)
+            return(-1);
+
+        image::ValueRecord rec{};
+
+        rec.kind=uint8_t(image::ValueKind::Property);
+        rec.type=static_cast<uint8_t>(type);
+        rec.a=index;
+
+        value_list.push_back(rec);
+        return static_cast<int32_t>(value_list.size()-1);
+    }
+
+    int32_t ImageWriter::AddScriptValue(eTokenType type,uint32_t offset)
+    {
+        image::ValueRecord rec{};
+
+        rec.kind=uint8_t(image::ValueKind::Local);
+        rec.type=static_cast<uint8_t>(type);
+        rec.a=offset;
+
+        value_list.push_back(rec);
+        return static_cast<int32_t>(value_list.size()-1);
+    }
+
+    int32_t ImageWriter::AddNativeCallValue(eTokenType type,const FuncMap *map,const SystemFuncParam *param,int param_count)
+    {
+        image::ValueRecord rec{};
+
+        const int32_t native=AddNative(map);
+
+        if(native<0||!AddParam(map,param,param_count,rec.data[0],rec.data[1]))
+            return(-1);
+
+        rec.kind=uint8_t(image::ValueKind::NativeCall);
+        rec.type=static_cast<uint8_t>(type);
+        rec.a=native;
+
+        value_list.push_back(rec);
+        return static_cast<int32_t>(value_list.size()-1);
+    }
+
+    int32_t ImageWriter::AddScriptCallValue(eTokenType type,const Func *func,const CallArg *arg,uint32_t arg_count)
+    {
+        const auto it=func_index.find(func->GetLatest());
+
+        if(it==func_index.end())
+            return(-1);
+
+        image::ValueRecord rec{};
+
+        if(!AddArgs(arg,arg_count,rec.data[0]))
+            return(-1);
+
+        rec.kind=uint8_t(image::ValueKind::ScriptCall);
+        rec.type=static_cast<uint8_t>(type);
+        rec.a=it->second;
+        rec.data[1]=arg_count;
+
+        value_list.push_back(rec);
+        return static_cast<int32_t>(value_list.size()-1);
+    }
+
+    int32_t ImageWriter::AddComp(eTokenType op,const ValueInterface *left,const ValueInterface *right)
+    {
+        const int32_t l=left->Save(*this);
+        const int32_t r=right->Save(*this);
+
+        if(l<0||r<0)
+            return(-1);
+
+        comp_list.push_back(image::CompRecord{static_cast<uint32_t>(op),static_cast<uint32_t>(l),static_cast<uint32_t>(r)});
+        return static_cast<int32_t>(comp_list.size()-1);
+    }
+
+    bool ImageWriter::Finish(std::vector<uint8_t> &out)
+    {
+        image::Header header{};
+
+        memcpy(header.magic,image::Magic,sizeof(header.magic));
+        header.version      =image::Version;
+        header.endian       =image::EndianMark;
+        header.pointer_size =sizeof(void *);
+        header.param_size   =sizeof(SystemFuncParam);
+
+        out.assign(sizeof(image::Header),0);
+
+        AppendSection(out,header.section[image::siNative],      native_list.data(),     native_list.size());
+        AppendSection(out,header.section[image::siProperty],    property_list.data(),   property_list.size());
+        AppendSection(out,header.section[image::siFunc],        func_list.data(),       func_list.size());
+        AppendSection(out,header.section[image::siLabel],       label_list.data(),      label_list.size());
+        AppendSection(out,header.section[image::siCommand],     command_list.data(),    command_list.size());
+        AppendSection(out,header.section[image::siValue],       value_list.data(),      value_list.size());
+        AppendSection(out,header.section[image::siComp],        comp_list.data(),       comp_list.size());
+        AppendSection(out,header.section[image::siParam],       param_list.data(),      param_list.size());
+        AppendSection(out,header.section[image::siParamType],   param_type_list.data(), param_type_list.size());
+        AppendSection(out,header.section[image::siFrame],       frame_list.data(),      frame_list.size());
+        AppendSection(out,header.section[image::siString],      string_pool.data(),     string_pool.size());
+        AppendSection(out,header.section[image::siArg],         arg_list.data(),        arg_list.size());
+
+        if(out.size()>UINT32_MAX)                                               //段偏移只有32位
+        {
+            LogError("%s","模块映像过大");
+            return(false);
+        }
+
+        header.file_size=out.size();
+        header.checksum=ImageChecksum(out.data()+sizeof(image::Header),out.size()-sizeof(image::Header));
+
+        memcpy(out.data(),&header,sizeof(header));
+        return(true);
+    }
+}//namespace hgl::devil
+
+namespace hgl::devil
+{
+    ModuleImage::~ModuleImage()
+    {
+        if(!data)
+            return;
+
+        if(mapped)
+        {
+        #ifdef _WIN32
+            UnmapViewOfFile(data);
+        #else
+            munmap(data,size);
+        #endif//_WIN32
+        }
+        else
+            delete[] reinterpret_cast<uint64_t *>(data);
+    }
+
+    /**
+    * 以写时复制方式映射文件，载入时对参数块的重定位只修改本进程的页面，不会写回文件
+    */
+    bool ModuleImage::Map(const char *filename)
+    {
+        if(data||!filename)
+            return(false);
+
+    #ifdef _WIN32
+        HANDLE file=CreateFileA(filename,GENERIC_READ,FILE_SHARE_READ,nullptr,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,nullptr);
+
+        if(file==INVALID_HANDLE_VALUE)
+            return(false);
+
+        LARGE_INTEGER file_size;
+
+        if(!GetFileSizeEx(file,&file_size)||file_size.QuadPart<=0)
+        {
+            CloseHandle(file);
+            return(false);
+        }
+
+        HANDLE map=CreateFileMappingA(file,nullptr,PAGE_WRITECOPY,0,0,nullptr);
+
+        CloseHandle(file);                                                      //映射对象与视图会保持对文件的引用
+
+        if(!map)
+            return(false);
+
+        void *view=MapViewOfFile(map,FILE_MAP_COPY,0,0,0);
+
+        CloseHandle(map);
+
+        if(!view)
+            return(false);
+
+        size=static_cast<size_t>(file_size.QuadPart);
+    #else
+        const int fd=open(filename,O_RDONLY);
+
+        if(fd<0)
+            return(false);
+
+        struct stat st;
+
+        if(fstat(fd,&st)!=0||st.st_size<=0)
+        {
+            close(fd);
+            return(false);
+        }
+
+        void *view=mmap(nullptr,static_cast<size_t>(st.st_size),PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+
+        close(fd);
+
+        if(view==MAP_FAILED)
+            return(false);
+
+        size=static_cast<size_t>(st.st_size);
+    #endif//_WIN32
+
+        data=static_cast<uint8_t *>(view);
+        mapped=true;
+        return(true);
+    }
+
+    bool ModuleImage::Copy(const void *source,size_t length)
+    {
+        if(data||!source||!length)
+            return(false);
+
+        data=reinterpret_cast<uint8_t *>(new uint64_t[(length+7)/8]);          //保证8字节对齐
+        size=length;
+        mapped=false;
+
+        memcpy(data,source,length);
+        return(true);
+    }
+}//namespace hgl::devil
+
+namespace hgl::devil
+{
+    namespace
+    {
+        /**
+        * 按映像重建脚本函数<br>
+        * 不经过切分与语法分析，指令直接由定长记录构造，参数块与字符串在映像中原地使用
+        */
+        class ImageLoader
+        {
+            OBJECT_LOGGER
+
+            Module *module;
+            Arena *arena;                                                       //载入的指令等都分配在此
+            uint8_t *data;
+            const image::Header *header;
+
+            const char *strings;
+            uint32_t string_size;
+
+            std::vector<FuncMap *> natives;
+            std::vector<PropertyMap *> properties;
+            std::vector<Func *> funcs;
+
+            std::vector<bool> value_used;                                       //每个量、比较式与参数槽只能被引用一次，防止参数块被重复重定位
+            std::vector<bool> comp_used;
+            std::vector<bool> param_used;
+
+        private:
+
+            template<typename T> const T *GetSection(image::SectionIndex index)const
+            {
+                return reinterpret_cast<const T *>(data+header->section[index].offset);
+            }
+
+            uint32_t GetCount(image::SectionIndex index)const{return header->section[index].count;}
+
+            const char *GetString(uint32_t offset)const{return offset<string_size?strings+offset:nullptr;}
+
+            bool CheckHeader(size_t size)
+            {
+                if(size<sizeof(image::Header))
+                    return(false);
+
+                header=reinterpret_cast<const image::Header *>(data);
+
+                if(memcmp(header->magic,image::Magic,sizeof(image::Magic))!=0
+                 ||header->version!=image::Version
+                 ||header->endian!=image::EndianMark
+                 ||header->pointer_size!=sizeof(void *)
+                 ||header->param_size!=sizeof(SystemFuncParam)
+                 ||header->file_size!=size)
+                {
+                    LogError("%s","模块映像的格式、版本或平台不匹配");
+                    return(false);
+                }
+
+                constexpr size_t record_size[image::siCount]=
+                {
+                    sizeof(image::NativeRecord),
+                    sizeof(image::PropertyRecord),
+                    sizeof(image::FuncRecord),
+                    sizeof(image::LabelRecord),
+                    sizeof(image::CommandRecord),
+                    sizeof(image::ValueRecord),
+                    sizeof(image::CompRecord),
+                    sizeof(SystemFuncParam),
+                    sizeof(uint8_t),
+                    sizeof(uint8_t),
+                    sizeof(char),
+                    sizeof(uint32_t)
+                };
+
+                for(int i=0;i<image::siCount;i++)
+                {
+                    const image::Section &sec=header->section[i];
+
+                    if(sec.offset<sizeof(image::Header)
+                     ||sec.offset%8
+                     ||sec.offset>size
+                     ||uint64_t(sec.count)*record_size[i]>size-sec.offset)
+                    {
+                        LogError("%s","模块映像的段越界");
+                        return(false);
+                    }
+                }
+
+                if(header->checksum!=ImageChecksum(data+sizeof(image::Header),size-sizeof(image::Header)))
+                {
+                    LogError("%s","模块映像校验失败");
+                    return(false);
+                }
+
+                strings=GetSection<char>(image::siString);
+                string_size=GetCount(image::siString);
+
+                if(!string_size||strings[string_size-1]!='\0')                  //最后一个字符串必须结束于池内
+                    return(false);
+
+                return(true);
+            }
+
+            bool BindNatives()
+            {
+                const image::NativeRecord *rec=GetSection<image::NativeRecord>(image::siNative);
+                const uint8_t *types=GetSection<uint8_t>(image::siParamType);
+                const uint32_t type_count=GetCount(image::siParamType);
+
+                natives.resize(GetCount(image::siNative));
+
+                for(uint32_t i=0;i<natives.size();i++,rec++)
+                {
+                    const char *name=GetString(rec->name);
+
+                    if(!name)
+                        return(false);
+
+                    FuncMap *map=module->GetFuncMap(name);
+
+                    if(!map)
+                    {
+                        LogError("%s",("模块映像所需的真实函数没有映射: "+std::string(name)).c_str());
+                        return(false);
+                    }
+
+                    bool match=(map->result==rec->result
+                              &&map->param.size()==rec->param_count
+                              &&uint64_t(rec->first_param_type)+rec->param_count<=type_count);
+
+                    for(uint32_t p=0;match&&p<rec->param_count;p++)
+                        match=(map->param[p]==types[rec->first_param_type+p]);
+
+                    if(!match)
+                    {
+                        LogError("%s",("模块映像中真实函数的签名与当前映射不一致: "+std::string(name)).c_str());
+                        return(false);
+                    }
+
+                    natives[i]=map;
+                }
+
+                return(true);
+            }
+
+            bool BindProperties()
+            {
+                const image::PropertyRecord *rec=GetSection<image::PropertyRecord>(image::siProperty);
+
+                properties.resize(GetCount(image::siProperty));
+
+                for(uint32_t i=0;i<properties.size();i++,rec++)
+                {
+                    const char *name=GetString(rec->name);
+
+                    if(!name)
+                        return(false);
+
+                    PropertyMap *map=module->GetPropertyMap(name);
+
+                    if(!map)
+                    {
+                        LogError("%s",("模块映像所需的属性没有映射: "+std::string(name)).c_str());
+                        return(false);
+                    }
+
+                    if(map->type!=rec->type)
+                    {
+                        LogError("%s",("模块映像中属性的类型与当前映射不一致: "+std::string(name)).c_str());
+                        return(false);
+                    }
+
+                    properties[i]=map;
+                }
+
+                return(true);
+            }
+
+            static bool CheckLocal(const Func *func,uint32_t type,uint32_t offset)  //局部变量必须完整位于帧内且按自身大小对齐
+            {
+                const uint32_t size=GetValueSize(eTokenType(type));
+
+                return size&&offset%size==0&&uint64_t(offset)+size<=func->frame_size;
+            }
+
+            /**
+            * 创建真实函数呼叫，参数块中的字符串偏移就地改写为指针
+            */
+            Command *CreateNativeCall(uint32_t native,uint32_t first,uint32_t count)
+            {
+                if(native>=natives.size())
+                    return(nullptr);
+
+                FuncMap *map=natives[native];
+
+                if(count!=map->param.size()||uint64_t(first)+count>param_used.size())
+                    return(nullptr);
+
+                for(uint32_t i=first;i<first+count;i++)
+                {
+                    if(param_used[i])
+                        return(nullptr);
+
+                    param_used[i]=true;
+                }
+
+                SystemFuncParam *param=reinterpret_cast<SystemFuncParam *>(data+header->section[image::siParam].offset)+first;
+
+                for(uint32_t i=0;i<count;i++)
+                {
+                    if(map->param[i]!=ttString)
+                        continue;
+
+                    const char *str=GetString(static_cast<uint32_t>(param[i].ui64));
+
+                    if(!str||param[i].ui64>UINT32_MAX)
+                        return(nullptr);
+
+                    param[i].str=const_cast<char *>(str);
+                }
+
+                if(!map->ThisInParam())
+                    return CreateSystemFuncCall(*arena,map,count?param:nullptr,count);
+
+                SystemFuncParam *with_this=arena->NewArray<SystemFuncParam>(count+1);  //x64汇编呼叫需要把this放在最前面，只能复制一份
+
+                with_this[0].void_pointer=map->base;
+                memcpy(with_this+1,param,count*sizeof(SystemFuncParam));
+
+                return CreateSystemFuncCall(*arena,map,with_this,count+1);
+            }
+
+            /**
+            * 创建脚本函数呼叫的参数，按被呼叫函数的参数类型转换
+            */
+            CallArg *CreateArgs(Func *func,const Func *callee,uint32_t first,uint32_t count)
+            {
+                if(count!=callee->param_list.size()
+                 ||uint64_t(first)+count>GetCount(image::siArg))
+                    return(nullptr);
+
+                const uint32_t *index=GetSection<uint32_t>(image::siArg)+first;
+                CallArg *arg=arena->NewArray<CallArg>(count);
+
+                for(uint32_t i=0;i<count;i++)
+                    if(!InitCallArg(arg[i],callee->param_list[i].type,CreateValue(func,index[i])))
+                        return(nullptr);
+
+                return arg;
+            }
+
+            ValueInterface *CreateValue(Func *func,uint32_t index)
+            {
+                if(index>=value_used.size()||value_used[index])
+                    return(nullptr);
+
+                value_used[index]=true;
+
+                const image::ValueRecord &rec=GetSection<image::ValueRecord>(image::siValue)[index];
+
+                switch(image::ValueKind(rec.kind))
+                {
+                    case image::ValueKind::Constant:
+                        return CreateConstValue(*arena,module,eTokenType(rec.type),rec.data);
+
+                    case image::ValueKind::Property:
+                        if(rec.a>=properties.size()||properties[rec.a]->type!=rec.type)
+                            return(nullptr);
+
+                        return CreatePropertyValue(*arena,module,properties[rec.a]);
+
+                    case image::ValueKind::Local:
+                        if(!CheckLocal(func,rec.type,rec.a))
+                            return(nullptr);
+
+                        return CreateScriptValue(*arena,module,eTokenType(rec.type),rec.a);
+
+                    case image::ValueKind::NativeCall:
+                    {
+                        Command *cmd=CreateNativeCall(rec.a,rec.data[0],rec.data[1]);
+
+                        if(!cmd)
+                            return(nullptr);
+
+                        FuncMap *map=natives[rec.a];
+
+                        return (map->result==rec.type?CreateFuncMapValue(*arena,module,map,cmd):nullptr);
+                    }
+
+                    case image::ValueKind::ScriptCall:
+                    {
+                        if(rec.a>=funcs.size())
+                            return(nullptr);
+
+                        Func *callee=funcs[rec.a];
+
+                        if(callee->result_type!=rec.type||callee->result_type==ttVoid)
+                            return(nullptr);
+
+                        CallArg *arg=CreateArgs(func,callee,rec.data[0],rec.data[1]);
+
+                        if(!arg&&rec.data[1])
+                            return(nullptr);
+
+                        func->value_call_list.push_back(callee);
+                        return CreateScriptCallValue(*arena,module,callee,arg,rec.data[1]);
+                    }
+
+                    default:return(nullptr);
+                }
+            }
+
+            CompInterface *CreateComp(Func *func,uint32_t index)
+            {
+                if(index>=comp_used.size()||comp_used[index])
+                    return(nullptr);
+
+                comp_used[index]=true;
+
+                const image::CompRecord &rec=GetSection<image::CompRecord>(image::siComp)[index];
+
+                ValueInterface *left=CreateValue(func,rec.left);
+                ValueInterface *right=(left?CreateValue(func,rec.right):nullptr);
+
+                return (right?devil::CreateComp(*arena,eTokenType(rec.op),left,right):nullptr);
+            }
+
+            Command *CreateCommand(Func *func,const image::CommandRecord &rec)
+            {
+                switch(image::CommandKind(rec.kind))
+                {
+                    case image::CommandKind::NativeCall:
+                        return CreateNativeCall(rec.a,rec.b,rec.c);
+
+                    case image::CommandKind::ScriptCall:
+                    {
+                        if(rec.a>=funcs.size()||rec.type>1)
+                            return(nullptr);
+
+                        CallArg *arg=CreateArgs(func,funcs[rec.a],rec.b,rec.c);
+
+                        if(!arg&&rec.c)
+                            return(nullptr);
+
+                        ScriptFuncCall *cmd=arena->New<ScriptFuncCall>(module,funcs[rec.a],arg,rec.c);
+
+                        cmd->SetTail(rec.type!=0);
+                        return(cmd);
+                    }
+
+                    case image::CommandKind::Goto:
+                    {
+                        const char *flag=GetString(rec.a);
+
+                        if(!flag)
+                            return(nullptr);
+
+                        Goto *cmd=arena->New<Goto>(module,func,flag);              //跳转标识名直接使用映像中的字符串
+
+                        return cmd->UpdateGotoFlag()?cmd:nullptr;
+                    }
+
+                    case image::CommandKind::CompGoto:
+                    {
+                        const char *flag=GetString(rec.b);
+                        CompInterface *comp=(flag?CreateComp(func,rec.a):nullptr);
+
+                        if(!comp)
+                            return(nullptr);
+
+                        CompGoto *cmd=arena->New<CompGoto>(module,comp,func);
+
+                        cmd->else_flag=flag;
+
+                        return cmd->UpdateGotoFlag()?cmd:nullptr;
+                    }
+
+                    case image::CommandKind::InlineCall:
+                    {
+                        const char *flag=GetString(rec.b);
+
+                        if(!flag||rec.a>=funcs.size()||rec.c>1||rec.type>1)
+                            return(nullptr);
+
+                        InlineCall *cmd=arena->New<InlineCall>(module,func,funcs[rec.a],flag,rec.c!=0);
+
+                        cmd->SetTail(rec.type!=0);
+
+                        return cmd->UpdateGotoFlag()?cmd:nullptr;
+                    }
+
+                    case image::CommandKind::Return:
+                        return(arena->New<Return>(module));
+
+                    case image::CommandKind::ReturnValue:
+                    {
+                        CallArg result;
+
+                        if(func->result_type==ttVoid
+                         ||!InitCallArg(result,func->result_type,CreateValue(func,rec.a)))
+                            return(nullptr);
+
+                        return(arena->New<ReturnValue>(module,result));
+                    }
+
+                    case image::CommandKind::Assign:
+                    {
+                        if(!CheckLocal(func,rec.type,rec.a))
+                            return(nullptr);
+
+                        ValueInterface *value=CreateValue(func,rec.b);
+
+                        if(!value)
+                            return(nullptr);
+
+                        return CreateScriptValueAssign(*arena,eTokenType(rec.type),rec.a,value);
+                    }
+
+                    default:return(nullptr);
+                }
+            }
+
+            /**
+            * 载入返回类型与参数表，须在载入任何函数的指令之前完成，呼叫指令按被呼叫函数的参数类型创建
+            */
+            bool LoadSignature(Func *func,const image::FuncRecord &rec)
+            {
+                if((rec.result!=ttVoid&&!GetValueSize(eTokenType(rec.result)))
+                 ||rec.param_count>MaxScriptParamCount
+                 ||uint64_t(rec.first_param_type)+rec.param_count>GetCount(image::siParamType))
+                    return(false);
+
+                func->result_type=eTokenType(rec.result);
+
+                const uint8_t *type=GetSection<uint8_t>(image::siParamType)+rec.first_param_type;
+
+                for(uint32_t i=0;i<rec.param_count;i++)
+                {
+                    const uint32_t size=GetValueSize(eTokenType(type[i]));
+
+                    if(!size)
+                        return(false);
+
+                    func->param_list.push_back(ScriptValueSlot{eTokenType(type[i]),func->AllocValue(size)});
+                }
+
+                return(true);
+            }
+
+            bool LoadFunc(Func *func,const image::FuncRecord &rec)
+            {
+                if(rec.frame_size%8
+                 ||uint64_t(rec.frame_init)+rec.frame_size>GetCount(image::siFrame)
+                 ||uint64_t(rec.first_label)+rec.label_count>GetCount(image::siLabel)
+                 ||uint64_t(rec.first_command)+rec.command_count>GetCount(image::siCommand))
+                    return(false);
+
+                const uint8_t *frame=GetSection<uint8_t>(image::siFrame)+rec.frame_init;
+
+                func->frame_size=rec.frame_size;
+                func->frame_init.assign(frame,frame+rec.frame_size);
+
+                for(const ScriptValueSlot &param:func->param_list)                 //参数须完整位于帧内
+                    if(!CheckLocal(func,param.type,param.offset))
+                        return(false);
+
+                const image::LabelRecord *label=GetSection<image::LabelRecord>(image::siLabel)+rec.first_label;
+
+                for(uint32_t i=0;i<rec.label_count;i++,label++)
+                {
+                    const char *name=GetString(label->name);
+
+                    if(!name||label->index<0||uint32_t(label->index)>rec.command_count)  //可以跳到函数结尾
+                        return(false);
+
+                    if(!func->goto_flag.emplace(name,label->index).second)
+                        return(false);
+                }
+
+                const image::CommandRecord *cmd_rec=GetSection<image::CommandRecord>(image::siCommand)+rec.first_command;
+
+                func->command.reserve(rec.command_count);
+
+                for(uint32_t i=0;i<rec.command_count;i++,cmd_rec++)
+                {
+                    Command *cmd=CreateCommand(func,*cmd_rec);
+
+                    if(!cmd)
+                    {
+                        LogError("%s",("模块映像中函数<"+func->func_name+">的第"+std::to_string(i)+"条指令无效").c_str());
+                        return(false);
+                    }
+
+                    func->AddCommand(cmd);
+                }
+
+                func->CompileBytecode();
+                return(true);
+            }
+
+        public:
+
+            ImageLoader(Module *dm,Arena *a,uint8_t *image_data)
+            {
+                module=dm;
+                arena=a;
+                data=image_data;
+                header=nullptr;
+                strings=nullptr;
+                string_size=0;
+            }
+
+            ~ImageLoader()
+            {
+                for(Func *func:funcs)                                           //没有被取走说明载入失败
+                    delete func;
+            }
+
+            bool Load(size_t size)
+            {
+                if(!CheckHeader(size)
+                 ||!BindNatives()
+                 ||!BindProperties())
+                    return(false);
+
+                value_used.assign(GetCount(image::siValue),false);
+                comp_used.assign(GetCount(image::siComp),false);
+                param_used.assign(GetCount(image::siParam),false);
+
+                const image::FuncRecord *rec=GetSection<image::FuncRecord>(image::siFunc);
+                const uint32_t count=GetCount(image::siFunc);
+
+                funcs.reserve(count);
+
+                for(uint32_t i=0;i<count;i++)                                   //先建立全部函数，指令中按序号引用
+                {
+                    const char *name=GetString(rec[i].name);
+
+                    if(!name||!*name)
+                        return(false);
+
+                    Func *func=new Func(module,name);
+
+                    func->arena=arena;
+                    ++arena->func_count;
+
+                    funcs.push_back(func);
+                }
+
+                for(uint32_t i=0;i<count;i++)
+                    if(!LoadSignature(funcs[i],rec[i]))
+                        return(false);
+
+                for(uint32_t i=0;i<count;i++)
+                    if(!LoadFunc(funcs[i],rec[i]))
+                        return(false);
+
+                return(true);
+            }
+
+            std::vector<Func *> Release(){return std::move(funcs);}
+        };//class ImageLoader
+    }//namespace
+
+    /**
+    * 将数据写为文件，失败时删除不完整的文件
+    */
+    bool WriteImageFile(const char *filename,const std::vector<uint8_t> &image_data)
+    {
+        FILE *fp=fopen(filename,"wb");
+
+        if(!fp)
+        {
+            LogError("%s",("无法创建模块映像文件: "+std::string(filename)).c_str());
+            return(false);
+        }
+
+        const bool result=(fwrite(image_data.data(),1,image_data.size(),fp)==image_data.size());
+
+        if(fclose(fp)!=0||!result)
+        {
+            LogError("%s",("写入模块映像文件失败: "+std::string(filename)).c_str());
+            remove(filename);
+            return(false);
+        }
+
+        return(true);
+    }
+
+    bool Module::SaveImage(const std::vector<Func *> &funcs,std::vector<uint8_t> &out)
+    {
+        ImageWriter writer(funcs,func_map,prop_map);
+
+        for(Func *func:funcs)
+            if(!writer.WriteFunc(func))
+                return(false);
+
+        return writer.Finish(out);
+    }
+
+    /**
+    * 将当前模块中所有已编译的脚本函数保存为模块映像<br>
+    * 真实函数与属性只按名字与签名记录，载入映像的模块需要有相同的映射
+    * @param out 输出的映像数据
+    * @return 是否保存成功，存在无法保存的指令时返回false
+    */
+    bool Module::SaveImage(std::vector<uint8_t> &out)
+    {
+        std::vector<Func *> funcs;
+
+        funcs.reserve(script_func.size());
+
+        for(const auto &kv:script_func)
+        {
+            Func *func=GetScriptFunc(kv.first);                                 //延迟编译的函数需先编译，热更新过的函数取最新版本
+
+            if(!func)
+                return(false);
+
+            funcs.push_back(func);
+        }
+
+        return SaveImage(funcs,out);
+    }
+
+    bool Module::SaveImage(const char *filename)
+    {
+        std::vector<uint8_t> image_data;
+
+        if(!filename||!SaveImage(image_data))
+            return(false);
+
+        return WriteImageFile(filename,image_data);
+    }
+
+    bool Module::LoadImage(ModuleImage *image)
+    {
+        std::vector<Func *> funcs;
+        Arena *arena=new Arena;
+        bool result;
+
+        {
+            ImageLoader loader(this,arena,image->GetData());
+
+            result=loader.Load(image->GetSize());
+
+            if(result)
+                funcs=loader.Release();
+        }
+
+        for(size_t i=0;result&&i<funcs.size();i++)
+        {
+            if(script_func.find(funcs[i]->func_name)!=script_func.end())
+            {
+                LogError("%s",("模块映像中的脚本函数与已有函数重名: "+funcs[i]->func_name).c_str());
+                result=false;
+            }
+        }
+
+        if(!result)
+        {
+            for(Func *func:funcs)                                               //函数引用映像中的参数块，须先于映像释放
+                delete func;
+
+            delete arena;
+            delete image;
+            return(false);
+        }
+
+        for(Func *func:funcs)
+        {
+            script_func.emplace(func->func_name,func);
+            AddFuncSlot(func);
+            IndexLabels(func);
+        }
+
+        arena_list.push_back(arena);
+        image_list.push_back(image);
+        return(true);
+    }
+
+    /**
+    * 从内存载入模块映像，数据会被复制一份
+    */
+    bool Module::LoadImage(const void *data,size_t size)
+    {
+        ModuleImage *image=new ModuleImage;
+
+        if(!image->Copy(data,size))
+        {
+            delete image;
+            return(false);
+        }
+
+        return LoadImage(image);
+    }
+
+    /**
+    * 以文件映射方式载入模块映像，不读取整个文件，也不经过词法与语法分析
+    */
+    bool Module::LoadImage(const char *filename)
+    {
+        ModuleImage *image=new ModuleImage;
+
+        if(!image->Map(filename))
+        {
+            LogError("%s",("无法映射模块映像文件: "+std::string(filename?filename:"")).c_str());
+            delete image;
+            return(false);
+        }
+
+        return LoadImage(image);
+    }
+}//namespace hgl::devil
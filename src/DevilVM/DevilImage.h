@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <hgl/devil/DevilModule.h>
+#include <hgl/log/Log.h>
+#include "as_tokendef.h"
+
+namespace hgl::devil
+{
+    using namespace angle_script;
+
+    class Func;
+    class ValueInterface;
+    class CompInterface;
+    union SystemFuncParam;
+    struct CallArg;
+
+    /**
+    * 预编译模块映像的文件格式<br>
+    * 所有记录都是定长的，各段按8字节对齐；名字与字符串常量都存放在字符串池中，以在池中的偏移引用
+    */
+    namespace image
+    {
+        constexpr char      Magic[8]    ={'D','E','V','I','L','I','M','G'};
+        constexpr uint32_t  Version     =4;
+        constexpr uint32_t  EndianMark  =0x01020304;
+
+        enum class CommandKind:uint8_t
+        {
+            NativeCall,         //a=真实函数序号,b=参数块首槽,c=参数个数
+            ScriptCall,         //a=脚本函数序号,b=参数表首项,c=参数个数,type=为1时是尾呼叫
+            Goto,               //a=跳转标识名
+            CompGoto,           //a=比较式序号,b=else跳转标识名
+            Return,
+            Assign,             //type=目标类型,a=帧内偏移,b=量序号
+            ReturnValue,        //a=量序号
+            InlineCall,         //a=被展开的脚本函数序号,b=展开的函数体结束处的跳转标识名,c=为1时总是呼叫,type=为1时展开处在尾位置
+        };//enum class CommandKind
+
+        enum class ValueKind:uint8_t
+        {
+            Constant,           //data=数值的原始字节
+            Property,           //a=属性序号
+            Local,              //a=帧内偏移
+            NativeCall,         //a=真实函数序号,data[0]=参数块首槽,data[1]=参数个数
+            ScriptCall,         //a=脚本函数序号,data[0]=参数表首项,data[1]=参数个数
+        };//enum class ValueKind
+
+        struct Section
+        {
+            uint32_t offset;                                                    ///<在映像中的字节偏移
+            uint32_t count;                                                     ///<记录个数
+        };
+
+        enum SectionIndex
+        {
+            siNative=0,         //NativeRecord
+            siProperty,         //PropertyRecord
+            siFunc,             //FuncRecord
+            siLabel,            //LabelRecord
+            siCommand,          //CommandRecord
+            siValue,            //ValueRecord
+            siComp,             //CompRecord
+            siParam,            //SystemFuncParam大小的参数槽
+            siParamType,        //uint8_t,真实函数的参数类型
+            siFrame,            //uint8_t,局部变量初始帧
+            siString,           //char,字符串池
+            siArg,              //uint32_t,脚本函数呼叫的参数(量序号)
+
+            siCount
+        };
+
+        struct Header
+        {
+            char        magic[8];
+            uint32_t    version;
+            uint32_t    endian;                                                 ///<EndianMark
+            uint32_t    pointer_size;                                           ///<sizeof(void *)
+            uint32_t    param_size;                                             ///<sizeof(SystemFuncParam)
+            uint64_t    file_size;
+            uint64_t    checksum;                                               ///<头之后全部数据的校验值(按8字节处理的FNV-1a 64)
+            Section     section[siCount];
+            uint32_t    reserved;
+        };//struct Header
+
+        struct NativeRecord                                                     ///<真实函数绑定，按名字与签名匹配
+        {
+            uint32_t    name;
+            uint32_t    first_param_type;
+            uint8_t     result;
+            uint8_t     param_count;
+            uint16_t    reserved;
+        };
+
+        struct PropertyRecord                                                   ///<属性绑定，按名字与类型匹配
+        {
+            uint32_t    name;
+            uint32_t    type;
+        };
+
+        struct FuncRecord
+        {
+            uint32_t    name;
+            uint32_t    frame_size;
+            uint32_t    frame_init;                                             ///<在siFrame中的偏移
+            uint32_t    first_label;
+            uint32_t    label_count;
+            uint32_t    first_command;
+            uint32_t    command_count;
+            uint32_t    first_param_type;                                       ///<参数类型在siParamType中的位置
+            uint8_t     result;                                                 ///<返回类型
+            uint8_t     param_count;
+            uint16_t    reserved;
+        };
+
+        struct LabelRecord
+        {
+            uint32_t    name;
+            int32_t     index;                                                  ///<跳转目标指令编号
+        };
+
+        struct CommandRecord
+        {
+            uint8_t     kind;                                                   ///<CommandKind
+            uint8_t     type;
+            uint16_t    reserved;
+            uint32_t    a,b,c;
+        };
+
+        struct ValueRecord
+        {
+            uint8_t     kind;                                                   ///<ValueKind
+            uint8_t     type;
+            uint16_t    reserved;
+            uint32_t    a;
+            uint32_t    data[2];
+        };
+
+        struct CompRecord
+        {
+            uint32_t    op;                                                     ///<比较运算符(ttEqual等)
+            uint32_t    left,right;                                             ///<量序号
+        };
+
+        static_assert(sizeof(Header)%8==0,"image header must keep sections 8-byte aligned");
+        static_assert(sizeof(CommandRecord)==16&&sizeof(ValueRecord)==16,"image records must stay packed");
+    }//namespace image
+
+    /**
+    * 将已编译的脚本函数写为模块映像<br>
+    * 各指令通过Command::Save调用本类的Write/Add系列函数写出自己
+    */
+    class ImageWriter
+    {
+        OBJECT_LOGGER
+
+        std::vector<image::NativeRecord>    native_list;
+        std::vector<image::PropertyRecord>  property_list;
+        std::vector<image::FuncRecord>      func_list;
+        std::vector<image::LabelRecord>     label_list;
+        std::vector<image::CommandRecord>   command_list;
+        std::vector<image::ValueRecord>     value_list;
+        std::vector<image::CompRecord>      comp_list;
+        std::vector<uint64_t>               param_list;
+        std::vector<uint8_t>                param_type_list;
+        std::vector<uint8_t>                frame_list;
+        std::vector<uint32_t>               arg_list;
+        std::string                         string_pool;
+
+        ankerl::unordered_dense::map<const void *,std::string_view> bind_name;  //映射函数/属性到名字
+        ankerl::unordered_dense::map<const void *,uint32_t> bind_index;         //映射函数/属性到记录序号
+        ankerl::unordered_dense::map<const Func *,uint32_t> func_index;
+        StringMap<uint32_t> string_index;
+
+    private:
+
+        int32_t AddNative(const FuncMap *);
+        int32_t AddProperty(const PropertyMap *);
+        bool AddParam(const FuncMap *,const SystemFuncParam *,int,uint32_t &,uint32_t &);
+        bool AddArgs(const CallArg *,uint32_t,uint32_t &);
+
+    public:
+
+        ImageWriter(const std::vector<Func *> &,const StringMap<FuncMap *> &,const StringMap<PropertyMap *> &);
+
+        uint32_t AddString(std::string_view);                                   ///<加入字符串池，返回偏移
+
+        bool WriteFunc(const Func *);                                           ///<写出一个函数(局部变量帧、跳转标识与全部指令)
+
+        bool WriteNativeCall(const FuncMap *,const SystemFuncParam *,int);
+        bool WriteScriptCall(const Func *,const CallArg *,uint32_t,bool);
+        bool WriteGoto(std::string_view);
+        bool WriteInlineCall(const Func *,std::string_view,bool,bool);
+        bool WriteCompGoto(const CompInterface *,std::string_view);
+        bool WriteReturn();
+        bool WriteReturnValue(const ValueInterface *);
+        bool WriteAssign(eTokenType,uint32_t,const ValueInterface *);
+
+        int32_t AddConstValue(eTokenType,const void *,size_t);
+        int32_t AddPropertyValue(eTokenType,const PropertyMap *);
+        int32_t AddScriptValue(eTokenType,uint32_t);
+        int32_t AddNativeCallValue(eTokenType,const FuncMap *,const SystemFuncParam *,int);
+        int32_t AddScriptCallValue(eTokenType,const Func *,const CallArg *,uint32_t);
+        int32_t AddComp(eTokenType,const ValueInterface *,const ValueInterface *);
+
+        bool Finish(std::vector<uint8_t> &);                                    ///<生成完整映像
+    };//class ImageWriter
+
+    /**
+    * 已载入内存的模块映像(写时复制的文件映射，或一份内存副本)<br>
+    * 载入后参数块直接位于映像中，其中的字符串指向映像内的字符串池，所以映像须与模块同生命周期
+    */
+    class ModuleImage
+    {
+        uint8_t *data;
+        size_t size;
+        bool mapped;
+
+    public:
+
+        ModuleImage(){data=nullptr;size=0;mapped=false;}
+        ~ModuleImage();
+
+        ModuleImage(const ModuleImage &)=delete;
+        ModuleImage &operator=(const ModuleImage &)=delete;
+
+        bool Map(const char *);                                                 ///<映射文件
+        bool Copy(const void *,size_t);                                         ///<复制一份内存数据
+
+        uint8_t *GetData()const{return data;}
+        size_t GetSize()const{return size;}
+    };//class ModuleImage
+
+    bool WriteImageFile(const char *,const std::vector<uint8_t> &);             ///<写出映像文件，失败时删除不完整的文件
+}//namespace hgl::devil
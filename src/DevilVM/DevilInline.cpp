@@ -0,0 +1,193 @@
+#include"DevilFunc.h"
+#include <algorithm>
+
+namespace hgl::devil
+{
+    namespace
+    {
+        int FindFlag(const Func *func,std::string_view name)
+        {
+            const auto it=func->goto_flag.find(name);
+
+            return(it==func->goto_flag.end()?-1:it->second);
+        }
+
+        /**
+        * 被呼叫的函数是否可以展开到caller中<br>
+        * 只展开没有参数、局部变量与返回值的函数，这样它的指令不访问局部变量帧，除跳转与返回外都可以直接共用<br>
+        * 自身含有展开的呼叫、呼叫自己或caller的函数不展开
+        */
+        bool CanInline(const Func *caller,const Func *callee,uint32_t limit)
+        {
+            if(callee==caller
+             ||(callee->state!=FuncState::Ready
+              &&callee->state!=FuncState::Compiling)                           //同一次延迟编译的函数在全部完成后才发布
+             ||callee->IsReplaced()
+             ||!callee->arena
+             ||!callee->param_list.empty()
+             ||callee->frame_size
+             ||callee->result_type!=ttVoid)
+                return(false);
+
+            size_t size=callee->command.size();
+
+            if(size&&dynamic_cast<Return *>(callee->command[size-1]))          //结尾的return展开后不产生指令
+                --size;
+
+            if(size>limit)
+                return(false);
+
+            for(Command *cmd:callee->command)
+            {
+                if(!cmd
+                 ||dynamic_cast<InlineCall *>(cmd)
+                 ||dynamic_cast<ReturnValue *>(cmd))
+                    return(false);
+
+                if(auto *call=dynamic_cast<ScriptFuncCall *>(cmd))
+                {
+                    const Func *target=call->GetFunc()->GetLatest();
+
+                    if(target==callee||target==caller)
+                        return(false);
+                }
+                else
+                if(auto *goto_cmd=dynamic_cast<Goto *>(cmd))
+                {
+                    if(FindFlag(callee,goto_cmd->GetFlag())<0)
+                        return(false);
+                }
+                else
+                if(auto *comp_goto_cmd=dynamic_cast<CompGoto *>(cmd))
+                {
+                    if(FindFlag(callee,comp_goto_cmd->else_flag)<0)
+                        return(false);
+                }
+            }
+
+            return(true);
+        }
+    }//namespace
+
+    /**
+    * 将呼叫的小函数展开到本函数中，须在本函数发布之前进行<br>
+    * 展开处是一条InlineCall，之后是被呼叫函数的指令：跳转换成本函数中改名后的跳转标识("函数名@呼叫位置.标识")，return换成跳到展开结尾的goto，脚本函数呼叫重新创建，其余指令直接共用<br>
+    * 被呼叫的函数以后被热更新替换时，InlineCall改为呼叫新版本并跳过展开的部分。共用的指令位于其它Arena时，该Arena计入本函数，直到本函数的函数体被释放
+    * @param limit 被呼叫函数的最大指令数(不含结尾的return)，为0时不展开
+    * @return 展开的呼叫数
+    */
+    int Func::Inline(uint32_t limit)
+    {
+        const int count=static_cast<int>(command.size());
+
+        if(!limit||!count)
+            return(0);
+
+        std::vector<Func *> site(count,nullptr);
+        int inlined=0;
+
+        for(int i=0;i<count;i++)
+        {
+            auto *call=dynamic_cast<ScriptFuncCall *>(command[i]);
+
+            if(!call||call->GetArgCount())
+                continue;
+
+            Func *callee=call->GetFunc();
+
+            if(!CanInline(this,callee,limit))
+                continue;
+
+            site[i]=callee;
+            ++inlined;
+        }
+
+        if(!inlined)
+            return(0);
+
+        absl::InlinedVector<Command *,8> result;
+        std::vector<int> new_index(count+1);
+        std::vector<std::pair<std::string,int>> new_flag;
+
+        for(int i=0;i<count;i++)
+        {
+            new_index[i]=static_cast<int>(result.size());
+
+            Func *callee=site[i];
+
+            if(!callee)
+            {
+                result.push_back(command[i]);
+                continue;
+            }
+
+            const std::string prefix=callee->func_name+"@"+std::to_string(i);      //'@'不能出现在脚本的标识符中，不会与已有的标识重名
+            const std::string_view end_flag=arena->CopyString(prefix);
+
+            result.push_back(arena->New<InlineCall>(module,this,callee,end_flag));
+
+            const int base=static_cast<int>(result.size());
+
+            for(const auto &kv:callee->goto_flag)
+                new_flag.emplace_back(prefix+"."+kv.first,base+kv.second);
+
+            for(Command *cmd:callee->command)
+            {
+                if(auto *goto_cmd=dynamic_cast<Goto *>(cmd))
+                    cmd=arena->New<Goto>(module,this,arena->CopyString(prefix+"."+std::string(goto_cmd->GetFlag())));
+                else
+                if(auto *comp_goto_cmd=dynamic_cast<CompGoto *>(cmd))
+                {
+                    auto *cg=arena->New<CompGoto>(module,comp_goto_cmd->GetComp(),this);
+
+                    cg->else_flag=arena->CopyString(prefix+"."+std::string(comp_goto_cmd->else_flag));
+                    cmd=cg;
+                }
+                else
+                if(dynamic_cast<Return *>(cmd))
+                    cmd=arena->New<Goto>(module,this,end_flag);
+                else
+                if(auto *call=dynamic_cast<ScriptFuncCall *>(cmd))                 //是否尾呼叫由所在函数决定，不能共用
+                    cmd=arena->New<ScriptFuncCall>(module,call->GetFunc(),call->GetArg(),call->GetArgCount());
+
+                result.push_back(cmd);
+            }
+
+            new_flag.emplace_back(std::string(end_flag),static_cast<int>(result.size()));
+
+            if(callee->arena!=arena
+             &&std::find(inline_arena.begin(),inline_arena.end(),callee->arena)==inline_arena.end())
+            {
+                inline_arena.push_back(callee->arena);
+                ++callee->arena->func_count;
+            }
+
+            value_call_list.insert(value_call_list.end(),callee->value_call_list.begin(),callee->value_call_list.end());
+
+            LogInfo("%s",("在函数<"+func_name+">中展开"+callee->func_name+"()").c_str());
+        }
+
+        new_index[count]=static_cast<int>(result.size());
+
+        for(auto &kv:goto_flag)
+            kv.second=new_index[kv.second];
+
+        for(auto &flag:new_flag)
+        {
+            inner_flag.emplace(flag.first);                                     //展开产生的标识不能由宿主直接进入
+            goto_flag.emplace(std::move(flag.first),flag.second);
+        }
+
+        command=std::move(result);
+
+        if(module->GetOptimize())
+            Optimize();                                                         //展开处的return多数成为跳到下一条的goto
+        else
+            inner_flag.clear();
+
+        UpdateGotoFlag();
+        CompileBytecode();
+
+        return(inlined);
+    }
+}//namespace hgl::devil
@@ -0,0 +1,315 @@
+#include"DevilLexer.h"
+#include <array>
+#include <bit>
+
+#if DEVIL_VM_LEXER_SIMD
+    #if defined(__AVX2__)
+        #include <immintrin.h>
+        #define DEVIL_LEXER_AVX2
+    #endif//__AVX2__
+
+    #if defined(__SSE2__)||defined(_M_X64)||(defined(_M_IX86_FP)&&_M_IX86_FP>=2)
+        #include <emmintrin.h>
+        #define DEVIL_LEXER_SSE2
+    #endif//__SSE2__
+#endif//DEVIL_VM_LEXER_SIMD
+
+namespace hgl::devil
+{
+    namespace
+    {
+        enum WordCharClass:uint8_t
+        {
+            wccNone=0,
+            wccStart,                                                       //可以作为标识符开头：字母与下划线
+            wccDigit                                                        //只能出现在标识符中间：数字
+        };
+
+        constexpr std::array<uint8_t,256> word_char_class=[]
+        {
+            std::array<uint8_t,256> table{};
+
+            for(int c='a';c<='z';c++)table[c]=wccStart;
+            for(int c='A';c<='Z';c++)table[c]=wccStart;
+            for(int c='0';c<='9';c++)table[c]=wccDigit;
+
+            table['_']=wccStart;
+
+            return table;
+        }();
+
+        /*
+         * 各种扫描条件：标量版本逐字节判断，向量版本返回各字节是否命中的掩码(命中字节为0xFF)
+         */
+
+        struct NotWhiteSpace                                                //找到第一个不是空白的字节(空白包括UTF8 BOM的三个字节，与as_tokendef.h中的whiteSpace一致)
+        {
+            static bool Test(char c)
+            {
+                const unsigned char uc=static_cast<unsigned char>(c);
+
+                return !(uc==' '||uc=='\t'||uc=='\r'||uc=='\n'||uc==0xEF||uc==0xBB||uc==0xBF);
+            }
+
+        #ifdef DEVIL_LEXER_SSE2
+            static __m128i Test(__m128i v)
+            {
+                __m128i ws=_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8(' ')),
+                                                     _mm_cmpeq_epi8(v,_mm_set1_epi8('\t'))),
+                                        _mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8('\r')),
+                                                     _mm_cmpeq_epi8(v,_mm_set1_epi8('\n'))));
+
+                ws=_mm_or_si128(ws,_mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8(char(0xEF))),
+                                                _mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8(char(0xBB))),
+                                                             _mm_cmpeq_epi8(v,_mm_set1_epi8(char(0xBF))))));
+
+                return _mm_xor_si128(ws,_mm_set1_epi8(char(0xFF)));
+            }
+        #endif//DEVIL_LEXER_SSE2
+
+        #ifdef DEVIL_LEXER_AVX2
+            static __m256i Test(__m256i v)
+            {
+                __m256i ws=_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8(' ')),
+                                                           _mm256_cmpeq_epi8(v,_mm256_set1_epi8('\t'))),
+                                           _mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8('\r')),
+                                                           _mm256_cmpeq_epi8(v,_mm256_set1_epi8('\n'))));
+
+                ws=_mm256_or_si256(ws,_mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8(char(0xEF))),
+                                                      _mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8(char(0xBB))),
+                                                                      _mm256_cmpeq_epi8(v,_mm256_set1_epi8(char(0xBF))))));
+
+                return _mm256_xor_si256(ws,_mm256_set1_epi8(char(0xFF)));
+            }
+        #endif//DEVIL_LEXER_AVX2
+        };//struct NotWhiteSpace
+
+        template<char C> struct IsByte                                      //找到指定字节
+        {
+            static bool Test(char c){return c==C;}
+
+        #ifdef DEVIL_LEXER_SSE2
+            static __m128i Test(__m128i v){return _mm_cmpeq_epi8(v,_mm_set1_epi8(C));}
+        #endif//DEVIL_LEXER_SSE2
+
+        #ifdef DEVIL_LEXER_AVX2
+            static __m256i Test(__m256i v){return _mm256_cmpeq_epi8(v,_mm256_set1_epi8(C));}
+        #endif//DEVIL_LEXER_AVX2
+        };//struct IsByte
+
+        struct StringStop                                                   //字符串常量中需要停下来处理的字节：引号、转义符、换行
+        {
+            static bool Test(char c){return c=='"'||c=='\\'||c=='\n';}
+
+        #ifdef DEVIL_LEXER_SSE2
+            static __m128i Test(__m128i v)
+            {
+                return _mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8('"')),
+                                    _mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8('\\')),
+                                                 _mm_cmpeq_epi8(v,_mm_set1_epi8('\n'))));
+            }
+        #endif//DEVIL_LEXER_SSE2
+
+        #ifdef DEVIL_LEXER_AVX2
+            static __m256i Test(__m256i v)
+            {
+                return _mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8('"')),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8('\\')),
+                                                       _mm256_cmpeq_epi8(v,_mm256_set1_epi8('\n'))));
+            }
+        #endif//DEVIL_LEXER_AVX2
+        };//struct StringStop
+
+        /**
+        * 从pos开始查找第一个满足条件的字节
+        * @return 字节位置，没有找到返回length
+        */
+        template<typename M>
+        uint32_t FindFirst(const char *source,uint32_t pos,uint32_t length)
+        {
+            if(pos<length&&M::Test(source[pos]))                            //token之间大多只隔一个空格，先判断一个字节
+                return pos;
+
+        #ifdef DEVIL_LEXER_AVX2
+            for(;pos+32<=length;pos+=32)
+            {
+                const uint32_t mask=static_cast<uint32_t>(_mm256_movemask_epi8(M::Test(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(source+pos)))));
+
+                if(mask)
+                    return pos+std::countr_zero(mask);
+            }
+        #endif//DEVIL_LEXER_AVX2
+
+        #ifdef DEVIL_LEXER_SSE2
+            for(;pos+16<=length;pos+=16)
+            {
+                const uint32_t mask=static_cast<uint32_t>(_mm_movemask_epi8(M::Test(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source+pos)))));
+
+                if(mask)
+                    return pos+std::countr_zero(mask);
+            }
+        #endif//DEVIL_LEXER_SSE2
+
+            for(;pos<length;pos++)
+                if(M::Test(source[pos]))
+                    return pos;
+
+            return length;
+        }
+
+        /**
+        * 扫描普通字符串常量(pos指向开头的引号)，规则与asCTokenizer::IsConstant相同
+        * @return 字符串常量的类型
+        */
+        eTokenType ScanString(const char *source,uint32_t pos,uint32_t length,uint32_t &token_length)
+        {
+            uint32_t n=pos+1;
+
+            while(true)
+            {
+                n=FindFirst<StringStop>(source,n,length);
+
+                if(n>=length)                                               //到了源码结尾
+                    break;
+
+                if(source[n]=='"')
+                {
+                    token_length=n+1-pos;
+                    return ttStringConstant;
+                }
+
+                if(source[n]=='\n')
+                    break;
+
+                //转义符，跳过后面一个字节(但换行依然结束字符串)
+                if(n+1<length&&source[n+1]=='\n')
+                {
+                    n++;
+                    break;
+                }
+
+                n+=2;
+
+                if(n>=length)
+                {
+                    n=length;
+                    break;
+                }
+            }
+
+            token_length=n-pos;
+            return ttNonTerminatedStringConstant;
+        }
+    }//namespace
+
+    bool Tokenize(TokenList &tokens,const char *source,uint32_t length)
+    {
+        asCTokenizer tokenizer;
+        uint32_t pos=0;
+        bool result=true;
+
+        tokens.clear();
+        tokens.reserve(length/8+1);
+
+        while(true)
+        {
+            pos=FindFirst<NotWhiteSpace>(source,pos,length);
+
+            if(pos>=length)
+                break;
+
+            const char c=source[pos];
+
+            if(c=='/'&&pos+1<length)
+            {
+                if(source[pos+1]=='/')                                      //单行注释，到换行为止(包括换行)
+                {
+                    pos=FindFirst<IsByte<'\n'>>(source,pos+2,length);
+
+                    if(pos<length)
+                        ++pos;
+
+                    continue;
+                }
+
+                if(source[pos+1]=='*')                                      //多行注释，到*/为止
+                {
+                    uint32_t n=pos+2;
+
+                    while(true)
+                    {
+                        n=FindFirst<IsByte<'*'>>(source,n,length);
+
+                        if(n+1>=length)
+                        {
+                            n=length;
+                            break;
+                        }
+
+                        if(source[n+1]=='/')
+                        {
+                            n+=2;
+                            break;
+                        }
+
+                        ++n;
+                    }
+
+                    pos=n;
+                    continue;
+                }
+            }
+
+            eTokenType type;
+            uint32_t len;
+
+            if(word_char_class[static_cast<unsigned char>(c)]==wccStart)      //标识符或关键字
+            {
+                uint32_t n=pos+1;
+
+                while(n<length&&word_char_class[static_cast<unsigned char>(source[n])])
+                    ++n;
+
+                len=n-pos;
+                type=GetWordTokenType(source+pos,len);
+            }
+            else
+            if(c=='"'&&!(pos+2<length&&source[pos+1]=='"'&&source[pos+2]=='"'))   //普通字符串常量，多行字符串仍交给asCTokenizer
+            {
+                type=ScanString(source,pos,length,len);
+            }
+            else
+            {
+                hgl::uint tl;
+
+                type=tokenizer.GetToken(source+pos,length-pos,&tl);
+                len=tl;
+
+                if(type<=ttEnd||len==0)                                     //无法识别(或未结束的字符常量切出了空token)，结束
+                    break;
+
+                if(type<=ttMultilineComment)                                //不会出现，以防万一
+                {
+                    pos+=len;
+                    continue;
+                }
+            }
+
+            if(len>LexTokenMaxLength)
+            {
+                result=false;
+                break;
+            }
+
+            if(len>length-pos)                                              //不允许越过源码结尾
+                len=length-pos;
+
+            tokens.push_back(LexToken{pos,len,static_cast<uint32_t>(type)});
+
+            pos+=len;
+        }
+
+        tokens.push_back(LexToken{pos<length?pos:length,0,ttEnd});
+        return(result);
+    }
+}//namespace hgl::devil
@@ -0,0 +1,41 @@
+#pragma once
+
+#include"as_tokenizer.h"
+#include <cstdint>
+#include <vector>
+
+#ifndef DEVIL_VM_LEXER_SIMD                                                 //可在编译参数中设为0，强制使用逐字节扫描
+#define DEVIL_VM_LEXER_SIMD 1
+#endif//DEVIL_VM_LEXER_SIMD
+
+namespace hgl::devil
+{
+    using namespace angle_script;
+
+    /**
+    * 预切分好的token，只记录在源码中的位置
+    */
+    struct LexToken
+    {
+        uint32_t offset;                                                    ///<在源码中的偏移
+        uint32_t length:24;                                                 ///<长度
+        uint32_t type:8;                                                    ///<eTokenType
+    };//struct LexToken
+
+    static_assert(sizeof(LexToken)==8,"LexToken must stay packed in 8 bytes.");
+    static_assert(ttCast<256,"eTokenType must fit in LexToken::type.");
+
+    constexpr uint32_t LexTokenMaxLength=(1u<<24)-1;                         ///<单个token的最大长度
+
+    using TokenList=std::vector<LexToken>;
+
+    /**
+    * 将整段脚本一次性切分为token数组
+    * 空白与注释直接跳过不进入数组，遇到无法识别的字符时结束，数组末尾总是一个ttEnd
+    * @param tokens 输出的token数组
+    * @param source 脚本源码
+    * @param length 源码长度
+    * @return 是否完整切分(存在超长token时返回false，此前的token依然有效)
+    */
+    bool Tokenize(TokenList &tokens,const char *source,uint32_t length);
+}//namespace hgl::devil
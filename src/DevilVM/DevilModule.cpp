@@ -1,7 +1,13 @@
 #include <hgl/devil/DevilModule.h>
 #include"DevilParse.h"
 #include"DevilFunc.h"
+#include"DevilImage.h"
+#include <hgl/devil/DevilContext.h>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 namespace hgl
 {
@@ -9,6 +15,8 @@ namespace devil
 {
     namespace
     {
+        constexpr size_t MinFuncPerCompileThread=16;                           //每个编译线程至少分到的函数数，函数太少时启动线程得不偿失
+
         eTokenType ToToken(detail::BindType type)
         {
             switch(type)
@@ -21,14 +29,196 @@ namespace devil
                 case detail::BindType::UInt:   return ttUInt;
                 case detail::BindType::UInt8:  return ttUInt8;
                 case detail::BindType::UInt16: return ttUInt16;
+                case detail::BindType::Int64:  return ttInt64;
+                case detail::BindType::UInt64: return ttUInt64;
                 case detail::BindType::Float:  return ttFloat;
+                case detail::BindType::Double: return ttDouble;
                 case detail::BindType::String: return ttString;
             }
 
             return ttVoid;
         }
+
+        struct CallDepthInfo
+        {
+            int depth;                  //从此函数开始的最大呼叫深度
+            uint32_t frame_bytes;       //从此函数开始所需的局部变量帧字节数上限
+        };
+
+        struct CallEdge
+        {
+            Func *callee;               //呼叫时转发到的最新版本
+            bool tail;                  //尾呼叫，被呼叫函数替换呼叫者，不增加呼叫深度
+        };
+
+        /**
+        * 静态分析呼叫深度<br>
+        * 尾呼叫不增加深度，只经过尾呼叫的环(状态A呼叫状态B呼叫状态A)深度是有限的，所以按强连通分量分析：
+        * 分量内部只有尾呼叫时，其中的函数深度相同；分量内部有普通呼叫时是真正的递归
+        */
+        class CallDepthAnalyser
+        {
+            struct Node
+            {
+                int index;
+                int low;
+                bool on_stack;
+                bool done;
+                std::vector<CallEdge> edge;
+                CallDepthInfo result;
+            };
+
+            ankerl::unordered_dense::map<Func *,Node> node_map;
+            std::vector<Func *> stack;
+            int next_index=0;
+
+            static void GetCallEdge(Func *func,std::vector<CallEdge> &edge)
+            {
+                for(const Instruction &ins:func->bytecode)
+                {
+                    if(ins.op==OpCode::ScriptCall)
+                        edge.push_back({ins.script.func->GetLatest(),false});
+                    else
+                    if(ins.op==OpCode::TailCall)
+                        edge.push_back({ins.script.func->GetLatest(),true});
+                    else
+                    if(ins.op==OpCode::InlineCall                       //被展开的函数被替换后才真正呼叫
+                     &&(ins.cond||ins.script.func->IsReplaced()))
+                        edge.push_back({ins.script.func->GetLatest(),ins.index<0});
+                }
+
+                for(Func *callee:func->value_call_list)                 //量中的呼叫同样压在呼叫堆栈上
+                    edge.push_back({callee->GetLatest(),false});
+            }
+
+            /**
+            * 求出一个强连通分量的结果，分量中的函数已按Tarjan算法从栈中取出
+            * @return 分量内部有普通呼叫(递归)时返回false
+            */
+            bool Resolve(const std::vector<Func *> &member)
+            {
+                CallDepthInfo result{1,0};
+
+                for(Func *func:member)
+                {
+                    const Node &node=node_map.find(func)->second;
+                    uint32_t own=func->frame_size;
+
+                    for(const CallEdge &e:node.edge)
+                    {
+                        const Node &target=node_map.find(e.callee)->second;
+
+                        if(!target.done)                                //同一分量中的函数
+                        {
+                            if(!e.tail)
+                                return(false);
+
+                            continue;
+                        }
+
+                        if(e.tail)
+                        {
+                            result.depth=std::max(result.depth,target.result.depth);
+                            result.frame_bytes=std::max(result.frame_bytes,target.result.frame_bytes);
+                        }
+                        else
+                        {
+                            result.depth=std::max(result.depth,target.result.depth+1);
+                            own=std::max(own,func->frame_size+target.result.frame_bytes);
+                        }
+                    }
+
+                    result.frame_bytes=std::max(result.frame_bytes,own);
+                }
+
+                for(Func *func:member)
+                {
+                    Node &node=node_map.find(func)->second;
+
+                    node.done=true;
+                    node.result=result;
+                }
+
+                return(true);
+            }
+
+        public:
+
+            bool Analyse(Func *func)
+            {
+                {
+                    Node node{next_index,next_index,true,false,{},{}};
+
+                    GetCallEdge(func,node.edge);
+                    node_map.emplace(func,std::move(node));
+                }
+
+                ++next_index;
+                stack.push_back(func);
+
+                const size_t edge_count=node_map.find(func)->second.edge.size();
+
+                for(size_t i=0;i<edge_count;i++)
+                {
+                    Func *callee=node_map.find(func)->second.edge[i].callee;     //递归中node_map可能重新分配，每次重新查找
+                    const auto it=node_map.find(callee);
+
+                    if(it==node_map.end())
+                    {
+                        if(!Analyse(callee))
+                            return(false);
+
+                        const int low=node_map.find(callee)->second.low;
+                        Node &node=node_map.find(func)->second;
+
+                        node.low=std::min(node.low,low);
+                    }
+                    else
+                    if(it->second.on_stack)
+                    {
+                        const int index=it->second.index;
+                        Node &node=node_map.find(func)->second;
+
+                        node.low=std::min(node.low,index);
+                    }
+                }
+
+                const Node &node=node_map.find(func)->second;
+
+                if(node.low!=node.index)
+                    return(true);
+
+                std::vector<Func *> member;
+
+                do
+                {
+                    member.push_back(stack.back());
+                    stack.pop_back();
+                    node_map.find(member.back())->second.on_stack=false;
+                }
+                while(member.back()!=func);
+
+                return Resolve(member);
+            }
+
+            const CallDepthInfo &GetResult(Func *func)const{return node_map.find(func)->second.result;}
+        };//class CallDepthAnalyser
     }//namespace
 
+    Module::~Module()
+    {
+        Module::Clear();
+
+        for(auto &kv:func_map)
+            delete kv.second;                               //映射函数中保存的可呼叫对象随之析构
+
+        for(auto &kv:prop_map)
+            delete kv.second;
+
+        for(Context *context:context_list)                  //之后析构的Context不再访问本模块
+            context->module=nullptr;
+    }
+
     /**
     * 映射一个属性
     * @param intro 属性在脚本语言中的描述,如"int value","string name"等
@@ -39,7 +229,7 @@ namespace devil
     {
         Parse parse(this,intro);
         eTokenType type;
-        std::string name;
+        std::string_view name;
 
         type=parse.GetToken(name);
 
@@ -63,13 +253,32 @@ namespace devil
             dpm->type=type;
             dpm->address=address;
 
-            prop_map.emplace(name,dpm);
+            prop_map.emplace(std::string(name),dpm);
 
             return(true);
         }
     }
 
-    bool Module::_MapFuncTyped(const char *name,void *this_pointer,void *func_pointer,detail::BindType result,std::initializer_list<detail::BindType> params)
+    /**
+    * 设置之后映射的函数是否使用按签名生成的呼叫入口
+    * @param use 为true时使用按签名生成的呼叫入口，为false时使用汇编呼叫
+    * @return 是否设置成功，当前平台没有汇编呼叫实现时无法关闭
+    */
+    bool Module::SetNativeThunk(bool use)
+    {
+    #if !DEVIL_VM_ASM_NATIVE_CALL
+        if(!use)
+        {
+            LogError("%s","当前平台没有汇编实现的真实函数呼叫，只能使用按签名生成的呼叫入口");
+            return(false);
+        }
+    #endif//DEVIL_VM_ASM_NATIVE_CALL
+
+        native_thunk=use;
+        return(true);
+    }
+
+    bool Module::_MapFuncTyped(const char *name,void *this_pointer,void *func_pointer,NativeThunk thunk,detail::NativeCallable &&callable,detail::BindType result,std::initializer_list<detail::BindType> params)
     {
         if(!name||!(*name))
             return(false);
@@ -85,6 +294,8 @@ namespace devil
 
         dfm->base=this_pointer;
         dfm->func=func_pointer;
+        dfm->thunk=(native_thunk||!func_pointer?thunk:nullptr);      //lambda等没有函数地址的对象只能使用thunk
+        dfm->callable=std::move(callable);
         dfm->result=ToToken(result);
 
         dfm->param.reserve(params.size());
@@ -117,18 +328,269 @@ namespace devil
         return(true);
     }
 
-    Func *Module::GetScriptFunc(const std::string &name)
+    /**
+    * 取得脚本函数，延迟编译的函数在此时编译
+    */
+    Func *Module::GetScriptFunc(std::string_view name)
     {
         const auto it=script_func.find(name);
-        if(it!=script_func.end())
-            return it->second;
+        if(it==script_func.end())
+        {
+            LogError("%s",
+               ("没有找到指定脚本函数: "+std::string(name)).c_str());
+            return(nullptr);
+        }
+
+        return PrepareFunc(it->second->GetLatest());
+    }
+
+    Func *Module::GetScriptFunc(const FuncHandle &handle)
+    {
+        if(handle.generation!=handle_generation
+         ||handle.index>=func_slot_list.size())
+            return(nullptr);
 
-           LogError("%s",
-               ("没有找到指定脚本函数: "+name).c_str());
-        return(nullptr);
+        return PrepareFunc(func_slot_list[handle.index].func->GetLatest());
     }
 
-        FuncMap *Module::GetFuncMap(const std::string &name)
+    /**
+    * 确保函数已编译，延迟编译的函数在此时编译<br>
+    * 编译中遇到的呼叫目标只排入队列，由最外层的调用依次编译，不会随呼叫链递归<br>
+    * 可由多个线程同时调用：已编译的函数不加锁直接返回，否则在lazy_lock中编译或等待其它线程编译完成
+    */
+    Func *Module::PrepareFunc(Func *func)
+    {
+        if(func->state.load(std::memory_order_acquire)==FuncState::Ready)
+            return func;
+
+        std::lock_guard<std::recursive_mutex> lk(lazy_lock);
+
+        if(func->state.load(std::memory_order_relaxed)==FuncState::Pending)
+        {
+            func->state.store(FuncState::Queued,std::memory_order_relaxed);
+            lazy_queue.push_back(func);
+
+            if(!lazy_compiling)
+                CompileLazyFunc();
+        }
+
+        if(func->state.load(std::memory_order_relaxed)==FuncState::Failed)
+        {
+            LogError("%s",
+                ("脚本函数或其呼叫的函数编译失败: "+func->func_name).c_str());
+            return(nullptr);
+        }
+
+        return func;
+    }
+
+    FuncHandle Module::GetFuncHandle(std::string_view name)
+    {
+        FuncHandle handle;
+
+        const auto it=script_func.find(name);
+
+        if(it==script_func.end())
+        {
+            LogError("%s",("没有找到指定脚本函数: "+std::string(name)).c_str());
+            return handle;
+        }
+
+        handle.index=it->second->slot;
+        handle.generation=handle_generation;
+        return handle;
+    }
+
+    /**
+    * 解析跳转标识句柄，延迟编译的函数需先编译才能知道其中的跳转标识
+    */
+    LabelHandle Module::GetLabelHandle(const FuncHandle &func_handle,std::string_view label)
+    {
+        LabelHandle handle;
+
+        Func *func=GetScriptFunc(func_handle);
+
+        if(!func)
+            return handle;
+
+        std::lock_guard<std::mutex> lk(reload_lock);                           //热更新时会增加跳转标识编号
+
+        const StringMap<uint32_t> &label_id=func_slot_list[func_handle.index].label_id;
+        const auto it=label_id.find(label);
+
+        if(it==label_id.end())
+        {
+            LogError("%s",("没有在函数"+func->func_name+"内找到跳转标识"+std::string(label)).c_str());
+            return handle;
+        }
+
+        handle.func=func_handle;
+        handle.label=it->second;
+        return handle;
+    }
+
+    bool Module::IsValid(const FuncHandle &handle)const
+    {
+        return handle.generation==handle_generation
+             &&handle.index<func_slot_list.size();
+    }
+
+    bool Module::IsValid(const LabelHandle &handle)
+    {
+        Func *func=GetScriptFunc(handle.func);
+
+        return func
+             &&handle.label<func->label_index.size()
+             &&func->label_index[handle.label]>=0;
+    }
+
+    /**
+    * 为新加入模块的函数分配句柄编号
+    */
+    void Module::AddFuncSlot(Func *func)
+    {
+        func->slot=static_cast<uint32_t>(func_slot_list.size());
+
+        func_slot_list.push_back(FuncSlot{func,{}});
+    }
+
+    /**
+    * 为函数的跳转标识分配编号并建立编号到指令的表，须在函数发布(被其它线程看到)之前完成<br>
+    * 同名标识在各版本中编号相同，所以句柄在热更新后依然可用
+    */
+    void Module::IndexLabels(Func *func)
+    {
+        StringMap<uint32_t> &label_id=func_slot_list[func->slot].label_id;
+
+        for(const auto &kv:func->goto_flag)
+            label_id.try_emplace(kv.first,static_cast<uint32_t>(label_id.size()));
+
+        func->label_index.assign(label_id.size(),-1);
+
+        for(const auto &kv:func->goto_flag)
+            func->label_index[label_id.find(kv.first)->second]=kv.second;
+    }
+
+    /**
+    * 编译延迟编译队列中的全部函数，其中有一个失败则本次编译的函数全部标记为失败<br>
+    * 同一次编译的函数可能互相呼叫，部分失败时无法保证其余函数可以执行<br>
+    * 须在lazy_lock中调用，全部函数编译、展开完成后才发布为Ready
+    */
+    bool Module::CompileLazyFunc()
+    {
+        std::vector<Func *> compiled;
+        bool result=true;
+
+        Arena *arena=new Arena;                                                 //本次编译的函数共用一个Arena，失败的函数同样保留在模块中
+
+        arena_list.push_back(arena);
+
+        lazy_compiling=true;
+
+        for(size_t i=0;i<lazy_queue.size();i++)                                //编译过程中队列会增长
+        {
+            Func *func=lazy_queue[i];
+
+            func->state.store(FuncState::Compiling,std::memory_order_relaxed); //递归呼叫自己时直接取用
+            func->arena=arena;
+            ++arena->func_count;
+
+            LogInfo("%s",("func "+func->func_name+"()\n{").c_str());
+
+            Parse parse(this,func->lazy_body.data(),static_cast<int>(func->lazy_body.size()));
+
+            if(parse.ParseFunc(func))
+            {
+                IndexLabels(func);
+                LogInfo("%s","}\n");
+            }
+            else
+            {
+                LogError("%s",("解晰函数失败: "+func->func_name).c_str());
+                result=false;
+            }
+
+            func->lazy_body=std::string_view();
+            func->lazy_source.reset();
+
+            compiled.push_back(func);
+        }
+
+        lazy_queue.clear();
+        lazy_compiling=false;
+
+        if(result)
+        {
+            for(Func *func:compiled)                                            //同一次编译的函数都已完成，再展开其中呼叫的小函数
+                if(func->Inline(inline_limit))
+                    IndexLabels(func);
+        }
+
+        for(Func *func:compiled)
+            func->state.store(result?FuncState::Ready:FuncState::Failed,std::memory_order_release);
+
+        return result;
+    }
+
+    /**
+    * 静态分析从指定脚本函数开始的最大呼叫深度
+    * @param name 起始函数名称
+    * @param frame_bytes 返回所需的局部变量帧字节数上限，可为nullptr
+    * @return 最大呼叫深度(只调用真实函数的函数为1，尾呼叫不增加深度)，存在递归(只经过尾呼叫的除外)或函数不存在时返回-1
+    */
+    int Module::GetCallDepth(std::string_view name,uint32_t *frame_bytes)
+    {
+        Func *func=GetScriptFunc(name);
+
+        if(!func)
+            return(-1);
+
+        CallDepthAnalyser analyser;
+
+        if(!analyser.Analyse(func))
+        {
+            LogError("%s",
+                     ("函数呼叫图中存在递归，无法静态确定呼叫深度: "+std::string(name)).c_str());
+            return(-1);
+        }
+
+        const CallDepthInfo &result=analyser.GetResult(func);
+
+        if(frame_bytes)
+            *frame_bytes=result.frame_bytes;
+
+        return result.depth;
+    }
+
+    uint32_t Module::GetMaxFrameSize()const
+    {
+        uint32_t size=0;
+
+        for(const auto &kv:script_func)
+            size=std::max(size,kv.second->GetLatest()->frame_size);
+
+        return size;
+    }
+
+    size_t Module::GetArenaBytes(size_t *reserved_bytes)const
+    {
+        size_t used=0,reserved=0;
+
+        std::lock_guard<std::recursive_mutex> lk(lazy_lock);
+
+        for(const Arena *arena:arena_list)
+        {
+            used+=arena->GetUsedBytes();
+            reserved+=arena->GetReservedBytes();
+        }
+
+        if(reserved_bytes)
+            *reserved_bytes=reserved;
+
+        return used;
+    }
+
+        FuncMap *Module::GetFuncMap(std::string_view name)
     {
         const auto it=func_map.find(name);
         if(it!=func_map.end())
@@ -150,7 +612,7 @@ namespace devil
         return(true);
     }
 
-    PropertyMap *Module::GetPropertyMap(const std::string &name)
+    PropertyMap *Module::GetPropertyMap(std::string_view name)
     {
         const auto it=prop_map.find(name);
         if(it!=prop_map.end())
@@ -160,23 +622,18 @@ namespace devil
     }
 
     /**
-    * 添加脚本并编译
-    * @param source 脚本
-    * @param source_length 脚本长度，-1表示自动检测
-    * @return 是否添加并编译成功
+    * 声明脚本中的全部函数：解析返回类型与参数表，只按花括号匹配出各函数体的范围，不解析函数体<br>
+    * 函数声明格式为 func [返回类型] 函数名([类型 参数名,...])
+    * @param parse 已切分好token的脚本，函数体范围直接指向其源码
+    * @param declared 本次已声明的函数，用于检查重名
+    * @param func_list 新建的函数按出现顺序加入此列表，失败时也已加入的由调用者释放
+    * @param func_token 各函数参数表之后的token位置，与func_list一一对应
+    * @param replace 是否用于热更新，为true时函数必须已存在
+    * @return 是否全部声明成功
     */
-    bool Module::AddScript(const char *source,int source_length)
+    bool Module::DeclareScript(Parse &parse,StringMap<Func *> &declared,std::vector<Func *> &func_list,std::vector<size_t> &func_token,bool replace)
     {
-        if(!source)return(false);
-
-        if(source_length==-1)
-            source_length=strlen(source);
-
-        if(source_length<1)
-            return(false);
-
-        Parse parse(this,source,source_length);
-        std::string name;
+        std::string_view name;
 
         while(true)
         {
@@ -184,56 +641,498 @@ namespace devil
 
             if(type==ttFunc)
             {
-                parse.GetToken(name);                           //取得函数名
+                eTokenType result_type=ttVoid;
+
+                type=parse.GetToken(name);                      //取得返回类型或函数名
 
-                if(script_func.find(name)==script_func.end())   //查找是否有同样的函数名存在
+                if(type==ttVoid||GetValueSize(type))
                 {
-                    Func *func=new Func(this,name);
+                    result_type=type;
+                    type=parse.GetToken(name);
+                }
 
-                    LogInfo("%s",("func "+name+"()\n{").c_str());
+                if(type!=ttIdentifier)
+                {
+                    LogError("%s",("脚本函数名称不正确: "+std::string(name)).c_str());
+                    return(false);
+                }
 
-                    if(parse.ParseFunc(func))                   //解析函数
-                    {
-                        script_func.emplace(name,func);
+                if(declared.find(name)!=declared.end()
+                 ||(!replace&&script_func.find(name)!=script_func.end()))      //查找是否有同样的函数名存在
+                {
+                    LogError("%s",("脚本函数名称重复: "+std::string(name)).c_str());
+                    return(false);
+                }
 
-                        LogInfo("%s","}\n");
-                    }
-                    else
-                    {
-                        delete func;
+                if(replace&&script_func.find(name)==script_func.end())         //热更新时不能增加函数，函数表在运行中的Context里不加锁读取
+                {
+                    LogError("%s",("热更新的函数不存在: "+std::string(name)).c_str());
+                    return(false);
+                }
 
-                        LogError("%s",("解晰函数失败: "+name).c_str());
-                        return(false);
-                    }
+                Func *func=new Func(this,std::string(name));
+
+                func->result_type=result_type;
+
+                func_list.push_back(func);
+
+                if(!parse.ParseParams(func))
+                {
+                    LogError("%s",("函数参数表无法解析: "+std::string(name)).c_str());
+                    return(false);
                 }
-                else
+
+                if(replace&&!func->SameSignature(script_func.find(name)->second))        //已编译的呼叫者按原来的参数传递
+                {
+                    LogError("%s",("热更新不能改变函数的参数与返回类型: "+std::string(name)).c_str());
+                    return(false);
+                }
+
+                func_token.push_back(parse.GetTokenIndex());
+
+                if(!parse.SkipFunc(func->lazy_body))
                 {
-                    LogError("%s",("脚本函数名称重复: "+name).c_str());
+                    LogError("%s",("函数体不完整: "+std::string(name)).c_str());
                     return(false);
                 }
 
+                declared.emplace(func->func_name,func);
                 continue;
             }//if type == ttFunc
             else
-            if(type==ttEnum)
+            if(type==ttEnum||type==ttConst)
+                continue;
+            else
+                break;
+        }//while
+
+        return(true);
+    }
+
+    /**
+    * 延迟编译时只声明函数<br>
+    * 源码复制一份由这些函数共同持有，全部编译后释放
+    */
+    bool Module::IndexScript(const char *source,int source_length)
+    {
+        auto text=std::make_shared<const std::string>(source,source_length);
+
+        Parse parse(this,text->data(),source_length);
+        StringMap<Func *> declared;
+        std::vector<Func *> func_list;
+        std::vector<size_t> func_token;
+
+        if(!DeclareScript(parse,declared,func_list,func_token,false))
+        {
+            for(Func *func:func_list)
+                delete func;
+
+            return(false);
+        }
+
+        for(Func *func:func_list)
+        {
+            func->lazy_source=text;
+            func->state=FuncState::Pending;
+
+            script_func.emplace(func->func_name,func);
+            AddFuncSlot(func);
+        }
+
+        return(true);
+    }
+
+    /**
+    * 编译多段脚本，分为三步：<br>
+    * 1.切分token，声明全部脚本中的函数名与函数体范围<br>
+    * 2.多线程编译各函数体，共用第1步的token，呼叫本次声明的函数时直接取用已声明的函数，不依赖其它函数是否已编译完成<br>
+    * 3.按声明顺序将函数并入模块，热更新时替换同名函数<br>
+    * 各函数的编译互不影响，所以结果与线程数无关。任何一个函数失败则本次的函数全部放弃<br>
+    * 每个编译线程把指令等分配在自己的Arena中，失败时随Arena整体丢弃
+    * @param sources 脚本列表
+    * @param new_func 返回各段脚本中新加入的函数
+    * @param replace 是否用于热更新
+    * @return 是否全部编译成功
+    */
+    bool Module::CompileScripts(const std::vector<std::string_view> &sources,std::vector<std::vector<Func *>> &new_func,bool replace)
+    {
+        std::vector<std::unique_ptr<Parse>> parse_list;                        //各段脚本的token，编译函数体时共用
+        StringMap<Func *> declared;
+        std::vector<Func *> func_list;
+        std::vector<size_t> func_token;
+        std::vector<size_t> func_source;                                        //各函数所在的脚本
+        std::vector<size_t> source_end;                                         //各段脚本的函数在func_list中的结束位置
+        bool result=true;
+
+        for(const std::string_view source:sources)
+        {
+            parse_list.push_back(std::make_unique<Parse>(this,source.data(),static_cast<int>(source.size())));
+
+            if(!DeclareScript(*parse_list.back(),declared,func_list,func_token,replace))
             {
-//                parse.ParseEnum();
-            }//if type == ttEnum
+                result=false;
+                break;
+            }
+
+            func_source.resize(func_list.size(),parse_list.size()-1);
+            source_end.push_back(func_list.size());
+        }
+
+        const size_t func_count=(result?func_list.size():0);
+
+        std::vector<uint8_t> compiled(func_count,0);
+
+        auto CompileOne=[&](size_t index,Arena &arena)
+        {
+            Func *func=func_list[index];
+
+            func->arena=&arena;
+            ++arena.func_count;
+
+            Parse parse(*parse_list[func_source[index]],func_token[index]);
+
+            parse.SetScope(&declared,&compile_lock);
+
+            if(parse.ParseFunc(func))
+                compiled[index]=1;
             else
-            if(type==ttConst)
+                LogError("%s",("解晰函数失败: "+func->func_name).c_str());
+        };
+
+        std::vector<std::unique_ptr<Arena>> arena_per_thread;                  //每个编译线程一个Arena，全部成功后并入模块
+
+        {
+            size_t thread_count=(compile_threads>0?size_t(compile_threads):std::max(1u,std::thread::hardware_concurrency()));
+
+            thread_count=std::min(thread_count,func_count/MinFuncPerCompileThread);
+
+            if(OnTrueFuncCall)                                                  //编译期会呼叫真实函数，只能在当前线程顺序编译
+                thread_count=0;
+
+            arena_per_thread.resize(std::max<size_t>(thread_count,1));
+
+            for(auto &arena:arena_per_thread)
+                arena=std::make_unique<Arena>();
+
+            if(thread_count<=1)
             {
+                for(size_t i=0;i<func_count;i++)
+                    CompileOne(i,*arena_per_thread[0]);
             }
             else
-                break;
-        }//while
+            {
+                std::atomic<size_t> next_index{0};
+                std::vector<std::thread> thread_list;
+
+                auto CompileProc=[&](Arena *arena)
+                {
+                    size_t index;
+
+                    while((index=next_index.fetch_add(1,std::memory_order_relaxed))<func_count)
+                        CompileOne(index,*arena);
+                };
+
+                thread_list.reserve(thread_count-1);
+
+                for(size_t i=1;i<thread_count;i++)
+                    thread_list.emplace_back(CompileProc,arena_per_thread[i].get());
+
+                CompileProc(arena_per_thread[0].get());                         //当前线程同样参与编译
+
+                for(std::thread &t:thread_list)
+                    t.join();
+            }
+        }
+
+        for(size_t i=0;i<func_count;i++)
+            if(!compiled[i])
+                result=false;
+
+        if(!result)
+        {
+            for(Func *func:func_list)                                           //Arena随arena_per_thread一起释放
+                delete func;
+
+            return(false);
+        }
+
+        for(Func *func:func_list)                                               //全部编译完成后按声明顺序展开，结果与线程数无关
+            func->Inline(inline_limit);
+
+        {
+            std::lock_guard<std::recursive_mutex> lk(lazy_lock);               //其它线程中的延迟编译也会加入Arena
+
+            for(auto &arena:arena_per_thread)
+                if(arena->func_count)
+                    arena_list.push_back(arena.release());
+        }
+
+        new_func.resize(sources.size());
+
+        size_t index=0;
+
+        for(size_t s=0;s<sources.size();s++)
+        {
+            for(;index<source_end[s];index++)
+            {
+                Func *func=func_list[index];
+
+                func->lazy_body=std::string_view();
+
+                if(replace)
+                {
+                    Func *old=script_func.find(func->func_name)->second->GetLatest();
+
+                    func->prev_version=old;
+                    func->slot=old->slot;
+
+                    IndexLabels(func);
+
+                    for(Func *f=old;f;f=f->prev_version)                        //所有旧版本都直接指向最新版本，呼叫时只需转发一次
+                        f->replaced.store(func,std::memory_order_release);
+                }
+                else
+                {
+                    script_func.emplace(func->func_name,func);
+                    AddFuncSlot(func);
+                    IndexLabels(func);
+                }
+
+                new_func[s].push_back(func);
+            }
+        }
+
+        if(replace)
+        {
+            const uint64_t epoch=++reload_epoch;                               //新版本全部发布后才进入新纪元
+
+            for(Func *func:func_list)
+                retired_list.emplace_back(func->prev_version,epoch);
+        }
 
         return(true);
     }
 
+    /**
+    * 热更新：编译脚本，以其中的函数替换同名的已有函数<br>
+    * 新的呼叫与启动立即使用新版本；已在执行旧版本的帧继续执行旧版本，执行跳转时如新版本有同名跳转标识且局部变量布局相同则换到新版本继续<br>
+    * 旧版本的函数体在所有Context都不再引用后由ReclaimFunc释放(纪元回收)，本函数结束时会先尝试回收一次<br>
+    * 可以在其它线程中的Context运行时调用，但不能与AddScript等修改函数表的操作同时进行
+    * @param source 脚本
+    * @param source_length 脚本长度，-1表示自动检测
+    * @return 是否全部替换成功，有任何一个函数编译失败时不替换任何函数
+    */
+    bool Module::ReloadScript(const char *source,int source_length)
+    {
+        if(!source)return(false);
+
+        if(source_length==-1)
+            source_length=strlen(source);
+
+        if(source_length<1)
+            return(false);
+
+        {
+            std::lock_guard<std::mutex> lk(reload_lock);
+
+            std::vector<std::vector<Func *>> new_func;
+
+            if(!CompileScripts({std::string_view(source,source_length)},new_func,true))
+                return(false);
+
+            for(Func *func:new_func[0])
+                LogInfo("%s",("热更新脚本函数: "+func->func_name).c_str());
+        }
+
+        ReclaimFunc();
+        return(true);
+    }
+
+    /**
+    * 回收旧版本的函数体<br>
+    * 每个Context在持有函数引用期间公布自己进入时的纪元，只有所有Context公布的纪元都不早于旧版本被替换时的纪元，才说明没有Context还能执行它<br>
+    * 空闲的Context保留最后一次离开时的纪元，之后替换下的函数要等它再次进入、离开(或与模块分离)后才能回收
+    */
+    size_t Module::ReclaimFunc()
+    {
+        std::lock_guard<std::mutex> lk(reload_lock);
+        std::lock_guard<std::recursive_mutex> lazy_lk(lazy_lock);              //延迟编译会加入Arena、增加Arena的引用计数
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);                   //与Context进入纪元时的屏障配对
+
+        uint64_t min_epoch=UINT64_MAX;
+
+        {
+            std::lock_guard<std::mutex> ctx_lk(context_lock);
+
+            for(Context *context:context_list)
+                min_epoch=std::min(min_epoch,context->pin_epoch.load());
+        }
+
+        size_t count=0;
+
+        for(size_t i=0;i<retired_list.size();)
+        {
+            if(retired_list[i].second<=min_epoch)
+            {
+                retired_list[i].first->ReleaseBody();
+                retired_list[i]=retired_list.back();
+                retired_list.pop_back();
+                ++count;
+            }
+            else
+                ++i;
+        }
+
+        if(count)
+        {
+            for(auto it=arena_list.begin();it!=arena_list.end();)               //其中的函数体都已释放的Arena整体释放
+            {
+                if((*it)->func_count==0)
+                {
+                    delete *it;
+                    it=arena_list.erase(it);
+                }
+                else
+                    ++it;
+            }
+        }
+
+        return count;
+    }
+
+    void Module::AttachContext(Context *context)
+    {
+        std::lock_guard<std::mutex> lk(context_lock);
+
+        context_list.push_back(context);
+    }
+
+    void Module::DetachContext(Context *context)
+    {
+        std::lock_guard<std::mutex> lk(context_lock);
+
+        const auto it=std::find(context_list.begin(),context_list.end(),context);
+
+        if(it!=context_list.end())
+            context_list.erase(it);
+    }
+
+    /**
+    * 添加脚本并编译，设置了编译缓存目录时优先从缓存载入，开启延迟编译时只声明函数
+    * @param source 脚本
+    * @param source_length 脚本长度，-1表示自动检测
+    * @return 是否添加并编译成功
+    */
+    bool Module::AddScript(const char *source,int source_length)
+    {
+        if(!source)return(false);
+
+        if(source_length==-1)
+            source_length=strlen(source);
+
+        if(source_length<1)
+            return(false);
+
+        return AddScripts({std::string_view(source,source_length)});
+    }
+
+    /**
+    * 添加多段脚本一起编译，各段脚本中的函数先全部声明再编译，所以可以互相呼叫
+    * @param sources 脚本列表
+    * @return 是否全部添加并编译成功(命中编译缓存的脚本在失败时依然保留)
+    */
+    bool Module::AddScripts(const std::vector<std::string_view> &sources)
+    {
+        std::vector<std::string_view> compile_list;
+        std::vector<std::string> cache_list;
+
+        const bool use_cache=(!cache_path.empty()&&!OnTrueFuncCall);           //编译期会呼叫真实函数时不能跳过编译
+
+        for(const std::string_view source:sources)
+        {
+            if(source.empty())
+                return(false);
+
+            std::string cache_filename;
+
+            if(use_cache)
+            {
+                cache_filename=GetCacheFilename(source.data(),static_cast<int>(source.size()));
+
+                if(LoadCache(cache_filename))
+                    continue;
+            }
+
+            if(lazy_compile)
+            {
+                if(!IndexScript(source.data(),static_cast<int>(source.size())))
+                    return(false);
+
+                continue;
+            }
+
+            compile_list.push_back(source);
+            cache_list.push_back(std::move(cache_filename));
+        }
+
+        if(compile_list.empty())
+            return(true);
+
+        std::vector<std::vector<Func *>> new_func;
+
+        if(!CompileScripts(compile_list,new_func))
+            return(false);
+
+        for(size_t i=0;i<cache_list.size();i++)
+            if(!cache_list[i].empty()&&!new_func[i].empty())
+                SaveCache(cache_list[i],new_func[i]);
+
+        return(true);
+    }
+
+    /**
+    * 清除全部脚本函数<br>
+    * 函数对象(包括热更新留下的旧版本)逐个删除，指令等编译产物随各Arena整体释放，不逐个析构
+    */
     void Module::Clear()
     {
+        {
+            std::lock_guard<std::mutex> lk(context_lock);
+
+            for(Context *context:context_list)                                  //不再有可执行的函数
+                context->Stop();
+        }
+
+        for(auto &kv:script_func)
+        {
+            Func *func=kv.second->GetLatest();
+
+            while(func)
+            {
+                Func *prev=func->prev_version;
+
+                delete func;
+                func=prev;
+            }
+        }
+
         script_func.clear();
-        string_list.clear();
+        lazy_queue.clear();
+        retired_list.clear();
+
+        func_slot_list.clear();
+        ++handle_generation;                                                    //之前解析的句柄全部失效
+
+        for(Arena *arena:arena_list)
+            delete arena;
+
+        arena_list.clear();
+
+        for(ModuleImage *image:image_list)                                     //脚本函数已清除，映像数据不再被引用
+            delete image;
+
+        image_list.clear();
     }
 
 #ifdef _DEBUG
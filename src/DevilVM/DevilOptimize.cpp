@@ -0,0 +1,325 @@
+#include"DevilFunc.h"
+
+namespace hgl::devil
+{
+    namespace
+    {
+        int FindFlag(const Func *func,std::string_view name)
+        {
+            const auto it=func->goto_flag.find(name);
+
+            return(it==func->goto_flag.end()?-1:it->second);
+        }
+
+        /**
+        * 沿goto链找到最终的跳转目标，死循环的链在走过指令数那么多跳后停下(链上任一标识都等价)
+        * @param name 起始跳转标识，返回最终跳转标识
+        * @return 最终落到的指令编号，等于指令数表示函数结尾，标识不存在时返回-1
+        */
+        int FollowGoto(const Func *func,std::string_view &name)
+        {
+            const int count=static_cast<int>(func->command.size());
+            int index=FindFlag(func,name);
+
+            if(index<0)
+                return(-1);
+
+            for(int hop=0;hop<count;hop++)
+            {
+                while(index<count&&!func->command[index])                      //常量折叠去掉的比较跳转
+                    ++index;
+
+                if(index>=count)
+                    break;
+
+                auto *goto_cmd=dynamic_cast<Goto *>(func->command[index]);
+
+                if(!goto_cmd)
+                    break;
+
+                const int next=FindFlag(func,goto_cmd->GetFlag());
+
+                if(next<0)                                                      //下一跳的标识不存在，停在这一跳以便运行时报错
+                    break;
+
+                name=goto_cmd->GetFlag();
+                index=next;
+            }
+
+            return(index);
+        }
+
+        /**
+        * 跳转重定向：goto与比较跳转直接跳到goto链的最终目标，最终目标是返回或函数结尾的goto直接换成返回
+        * @return 修改的跳转数量
+        */
+        int ThreadJumps(Func *func,Module *module)
+        {
+            const int count=static_cast<int>(func->command.size());
+            int threaded=0;
+
+            for(int i=0;i<count;i++)
+            {
+                Command *cmd=func->command[i];
+
+                if(auto *goto_cmd=dynamic_cast<Goto *>(cmd))
+                {
+                    std::string_view name=goto_cmd->GetFlag();
+                    const int target=FollowGoto(func,name);
+
+                    if(target<0)
+                        continue;
+
+                    Command *dest=(target<count?func->command[target]:nullptr);
+
+                    if(target==count)
+                        func->command[i]=func->arena->New<Return>(module);      //函数结尾与return一样返回上一级
+                    else
+                    if(dynamic_cast<Return *>(dest)||dynamic_cast<ReturnValue *>(dest))
+                        func->command[i]=dest;                                  //指令不保存运行状态，可以在同一函数中出现多次
+                    else
+                    if(name!=goto_cmd->GetFlag())
+                        goto_cmd->SetFlag(name);
+                    else
+                        continue;
+
+                    ++threaded;
+                }
+                else
+                if(auto *comp_goto_cmd=dynamic_cast<CompGoto *>(cmd))
+                {
+                    std::string_view name=comp_goto_cmd->else_flag;
+
+                    if(FollowGoto(func,name)<0||name==comp_goto_cmd->else_flag)
+                        continue;
+
+                    comp_goto_cmd->else_flag=name;
+                    ++threaded;
+                }
+            }
+
+            return(threaded);
+        }
+
+        /**
+        * 从函数入口与宿主可以直接启动的跳转标识出发，标记所有可以执行到的指令
+        */
+        void MarkLive(const Func *func,std::vector<bool> &live)
+        {
+            const int count=static_cast<int>(func->command.size());
+            std::vector<int> stack;
+
+            const auto Mark=[&](int index)
+            {
+                if(index<0||index>=count||live[index])          //等于count的是函数结尾
+                    return;
+
+                live[index]=true;
+                stack.push_back(index);
+            };
+
+            Mark(0);
+
+            for(const auto &kv:func->goto_flag)
+                if(!func->inner_flag.contains(kv.first))        //手写的标识可能被宿主用StartFlag/Goto直接进入
+                    Mark(kv.second);
+
+            while(!stack.empty())
+            {
+                const int index=stack.back();
+                Command *cmd=func->command[index];
+
+                stack.pop_back();
+
+                if(auto *goto_cmd=dynamic_cast<Goto *>(cmd))
+                    Mark(FindFlag(func,goto_cmd->GetFlag()));   //没有找到的标识运行时报错，之后不会继续执行
+                else
+                if(auto *comp_goto_cmd=dynamic_cast<CompGoto *>(cmd))
+                {
+                    Mark(index+1);
+                    Mark(FindFlag(func,comp_goto_cmd->else_flag));
+                }
+                else
+                if(auto *inline_cmd=dynamic_cast<InlineCall *>(cmd))           //被展开的函数被替换时跳过展开的部分
+                {
+                    Mark(index+1);
+                    Mark(FindFlag(func,inline_cmd->end_flag));
+                }
+                else
+                if(!dynamic_cast<Return *>(cmd)
+                 &&!dynamic_cast<ReturnValue *>(cmd))
+                    Mark(index+1);
+            }
+        }
+
+        /**
+        * 去掉跳转到下一条保留指令的goto，由高到低处理，嵌套的if/else可以逐层消去
+        */
+        void RemoveNextGoto(const Func *func,std::vector<bool> &keep)
+        {
+            const int count=static_cast<int>(func->command.size());
+
+            for(int i=count-1;i>=0;i--)
+            {
+                if(!keep[i])
+                    continue;
+
+                auto *goto_cmd=dynamic_cast<Goto *>(func->command[i]);
+
+                if(!goto_cmd)
+                    continue;
+
+                const int target=FindFlag(func,goto_cmd->GetFlag());
+
+                if(target<=i)
+                    continue;
+
+                int next=i+1;
+
+                while(next<target&&!keep[next])
+                    ++next;
+
+                if(next==target)
+                    keep[i]=false;
+            }
+        }
+
+        /**
+        * 标记尾呼叫：脚本函数呼叫之后是return或函数结尾时，呼叫时不必保留当前函数<br>
+        * 内联展开的函数体结束处是return或函数结尾时，被展开的函数被替换后同样以尾呼叫转到新版本<br>
+        * 每次优化都重新判断，内联展开后原来在被展开函数结尾的呼叫不一定还在尾位置
+        * @return 尾呼叫数量
+        */
+        int MarkTailCall(Func *func)
+        {
+            const int count=static_cast<int>(func->command.size());
+            int tail=0;
+
+            const auto IsReturn=[&](int index)
+            {
+                return(index==count||(index>=0&&index<count&&dynamic_cast<Return *>(func->command[index])));
+            };
+
+            for(int i=0;i<count;i++)
+            {
+                bool is_tail;
+
+                if(auto *call=dynamic_cast<ScriptFuncCall *>(func->command[i]))
+                {
+                    is_tail=IsReturn(i+1);
+                    call->SetTail(is_tail);
+                }
+                else
+                if(auto *inline_cmd=dynamic_cast<InlineCall *>(func->command[i]))
+                {
+                    is_tail=IsReturn(FindFlag(func,inline_cmd->end_flag));
+                    inline_cmd->SetTail(is_tail);
+                }
+                else
+                    continue;
+
+                if(is_tail)
+                    ++tail;
+            }
+
+            return(tail);
+        }
+    }//namespace
+
+    /**
+    * 函数体解析完成后的优化<br>
+    * 两边都是常量的比较跳转在编译时求值：成立时去掉，不成立时换成无条件跳转<br>
+    * 跳转到goto的跳转直接改到最终目标，跳转到返回的goto换成返回<br>
+    * 然后去掉执行不到的指令(无条件跳转与返回之后、没有跳转进入的部分)，以及跳转到下一条指令的goto<br>
+    * 最后将之后就是返回的脚本函数呼叫标记为尾呼叫<br>
+    * 跳转标识按名字记录，所以只需要将指令编号换成压缩后的编号，之后再由UpdateGotoFlag解析
+    */
+    void Func::Optimize()
+    {
+        const int count=static_cast<int>(command.size());
+
+        if(!count)
+        {
+            inner_flag.clear();
+            return;
+        }
+
+        int folded=0;
+
+        for(int i=0;i<count;i++)
+        {
+            auto *comp_goto_cmd=dynamic_cast<CompGoto *>(command[i]);
+            bool result;
+
+            if(!comp_goto_cmd||!comp_goto_cmd->IsConstant(result))
+                continue;
+
+            if(result)
+                command[i]=nullptr;                                             //成立时继续执行下一条，比较式留在Arena中不再使用
+            else
+                command[i]=arena->New<Goto>(module,this,comp_goto_cmd->else_flag);
+
+            ++folded;
+        }
+
+        const int threaded=ThreadJumps(this,module);
+
+        std::vector<bool> keep(count,false);
+
+        MarkLive(this,keep);
+
+        for(int i=0;i<count;i++)
+            if(!command[i])
+                keep[i]=false;
+
+        RemoveNextGoto(this,keep);
+
+        std::vector<int> new_index(count+1);
+        int kept=0;
+
+        for(int i=0;i<count;i++)
+        {
+            new_index[i]=kept;
+
+            if(keep[i])
+                command[kept++]=command[i];
+        }
+
+        new_index[count]=kept;
+        command.resize(kept);
+
+        ankerl::unordered_dense::set<std::string_view> used_flag;             //仍被跳转指令引用的标识
+
+        for(Command *cmd:command)
+        {
+            if(auto *goto_cmd=dynamic_cast<Goto *>(cmd))
+                used_flag.insert(goto_cmd->GetFlag());
+            else
+            if(auto *comp_goto_cmd=dynamic_cast<CompGoto *>(cmd))
+                used_flag.insert(comp_goto_cmd->else_flag);
+            else
+            if(auto *inline_cmd=dynamic_cast<InlineCall *>(cmd))
+                used_flag.insert(inline_cmd->end_flag);
+        }
+
+        for(auto it=goto_flag.begin();it!=goto_flag.end();)
+        {
+            if(inner_flag.contains(it->first)
+             &&!used_flag.contains(it->first))                                  //被优化掉的if/else的标识，热更新时不能再据此换到新版本
+            {
+                it=goto_flag.erase(it);
+                continue;
+            }
+
+            it->second=new_index[it->second];
+            ++it;
+        }
+
+        inner_flag.clear();
+
+        const int tail=MarkTailCall(this);
+
+        if(folded||threaded||kept<count||tail)
+            LogInfo("%s",("函数<"+func_name+">优化: 折叠"+std::to_string(folded)+"个常量比较，重定向"+std::to_string(threaded)+"个跳转，尾呼叫"+std::to_string(tail)+"个，指令数"+std::to_string(count)+" -> "+std::to_string(kept)).c_str());
+    }
+}//namespace hgl::devil
@@ -2,15 +2,13 @@
 #include <hgl/devil/DevilModule.h>
 #include <memory>
 #include <cstring>
-#include <hgl/type/Str.Number.h>
+#include <charconv>
+#include <type_traits>
 
 namespace hgl::devil
 {
-    void ConvertString(std::string &targe,const char *source,int length)
+    void ConvertString(std::string &targe,std::string_view source)
     {
-        char *temp;
-        const char *sp;
-        char *tp;
         const char conv[][2]=
         {
             {'t',   '\t'},
@@ -22,15 +20,16 @@ namespace hgl::devil
             {0,0}
         };
 
-        temp=new char[length+1];
-        sp=source;
-        tp=temp;
+        targe.clear();
+        targe.reserve(source.size());
 
-        while(length)
+        size_t pos=0;
+
+        while(pos<source.size())
         {
-            if(*sp=='\\')
+            if(source[pos]=='\\'&&pos+1<source.size())
             {
-                char sc=*(sp+1);
+                char sc=source[pos+1];
                 int select;
 
                 for(select=0;;select++)
@@ -38,90 +37,112 @@ namespace hgl::devil
                     else
                     if(conv[select][0]==sc)
                     {
-                        *tp++=conv[select][1];
+                        targe.push_back(conv[select][1]);
 
                         break;
                     }
 
                 if(!conv[select][0])        //没选中什么
                 {
-                    *tp++='\\';
-                    *tp++=sc;
+                    targe.push_back('\\');
+                    targe.push_back(sc);
                 }
 
-                length-=2;
-                sp+=2;
+                pos+=2;
             }
             else
             {
-                *tp++=*sp++;
-
-                length--;
+                targe.push_back(source[pos++]);
             }
         }
-
-        *tp=0;
-        targe.assign(temp);
-
-        delete[] temp;
     }
 
     Parse::Parse(Module *dm,const char *str,int len)
     {
         module=dm;
+        cur_func=nullptr;
 
         source_start=str;
-        source_cur=str;
+        token_index=0;
 
-        if(len==-1)
-            source_length=strlen(str);
-        else
-            source_length=len;
+        arena=nullptr;
+        declared_func=nullptr;
+        module_lock=nullptr;
+
+        const uint32_t length=(len==-1?static_cast<uint32_t>(strlen(str)):static_cast<uint32_t>(len));
+
+        if(!Tokenize(token_list,str,length))
+            LogError("%s",
+                     ("脚本中存在超长的token，在偏移"+std::to_string(token_list.back().offset)+"处停止解析").c_str());
+
+        tokens=token_list.data();
     }
 
-    eTokenType Parse::GetToken(std::string &intro)
+    /**
+    * 多个函数体同时编译时共用声明阶段切分好的token，token数组由owner持有，只读
+    */
+    Parse::Parse(const Parse &owner,size_t start)
     {
-        while(true)
-        {
-            uint len;
-            eTokenType type;
-            const char *source;
+        module=owner.module;
+        cur_func=nullptr;
 
-            if(source_length<=0)return(ttEnd);
+        source_start=owner.source_start;
+        tokens=owner.tokens;
+        token_index=start;
 
-            type=parse.GetToken(source_cur,source_length,&len);
+        arena=nullptr;
+        declared_func=nullptr;
+        module_lock=nullptr;
+    }
 
-            source          =   source_cur;
+    /**
+    * @param declared 已声明但可能还在编译中的脚本函数
+    * @param lock 查找模块中的脚本函数时使用的锁(可能触发延迟编译)
+    */
+    void Parse::SetScope(const StringMap<Func *> *declared,std::mutex *lock)
+    {
+        declared_func=declared;
+        module_lock=lock;
+    }
 
-            source_cur      +=  len;
-            source_length   -=  len;
+    Func *Parse::FindScriptFunc(std::string_view name)
+    {
+        if(declared_func)
+        {
+            const auto it=declared_func->find(name);
 
-            if(type<=ttEnd)
-                return ttEnd;
+            if(it!=declared_func->end())
+                return it->second;
+        }
 
-            if(type<=ttMultilineComment)        //跳过注释，空格，换行
-                continue;
+        if(!module_lock)
+            return module->GetScriptFunc(name);
 
-            intro.assign(source,static_cast<size_t>(len));
-            return type;
-        }
+        std::lock_guard<std::mutex> lk(*module_lock);
+
+        return module->GetScriptFunc(name);
     }
 
-    eTokenType Parse::CheckToken(std::string &intro)
+    eTokenType Parse::GetToken(std::string_view &intro)
     {
-        const char *cur=source_cur;
-        uint len=source_length;
-        eTokenType type;
+        const LexToken &tk=tokens[token_index];
 
-        type=GetToken(intro);
+        if(tk.type!=ttEnd)                      //停在结尾，之后一直返回ttEnd
+            ++token_index;
 
-        source_cur      =cur;
-        source_length   =len;
+        intro=std::string_view(source_start+tk.offset,tk.length);
+        return static_cast<eTokenType>(tk.type);
+    }
 
-        return(type);
+    eTokenType Parse::CheckToken(std::string_view &intro)
+    {
+        const LexToken &tk=tokens[token_index];
+
+        intro=std::string_view(source_start+tk.offset,tk.length);
+        return static_cast<eTokenType>(tk.type);
     }
 
-    bool Parse::GetToken(eTokenType tt,std::string &name)
+    bool Parse::GetToken(eTokenType tt,std::string_view &name)
     {
         eTokenType type;
 
@@ -137,45 +158,44 @@ namespace hgl::devil
         }
     }
 
-    void Parse::ParseValue(Func *func,eTokenType value_type,std::string &/*type_name*/)
+    void Parse::ParseValue(Func *func,eTokenType value_type)
     {
         eTokenType type;
 
-        std::string value_name;
+        std::string_view value_name;
 
         type=GetToken(value_name);
 
         if(type!=ttIdentifier)  //变量名称
             return;
 
-        ValueInterface *dvi=func->AddValue(value_type,value_name);
-
-        if(!dvi)
+        if(!func->AddValue(value_type,value_name))
         {
             LogError("%s",
-                     ("函数<"+func->func_name+">的变量<"+value_name
+                     ("函数<"+func->func_name+">的变量<"+std::string(value_name)
                       +">定义无法解析").c_str());
             return;
         }
 
-        type=GetToken(value_name);
+        std::string_view temp;
 
-        if(type==ttEndStatement)return; //分号
-        if(type!=ttAssignment)return;   //等号
+        type=CheckToken(temp);
 
-        ValueInterface *dvi_value=ParseValue();    //后面的值或表达式
+        if(type!=ttAssignment)return;   //没有等号
+
+        GetToken(temp);                 //取走等号
+
+        ValueInterface *dvi_value=ParseValue();    //后面的值
 
         if(!dvi_value)
         {
             LogError("%s",
-                     ("函数<"+func->func_name+">的变量<"+value_name
+                     ("函数<"+func->func_name+">的变量<"+std::string(value_name)
                       +">定义时的赋值式无法解析").c_str());
             return;
         }
 
-//      dvi->SetValue(dvi_value);       //赋值
-
-        return;
+        func->AddAssign(value_name,dvi_value,true);     //赋值
     }
 
 /*  void Parse::ParseEnum()
@@ -188,36 +208,123 @@ namespace hgl::devil
 
     }*/
 
-    bool Parse::ParseFunc(Func *func)
+    /**
+    * 解析参数表，如(int a,float b)。参数在声明时就加入函数，呼叫者据此编译参数的传递
+    */
+    bool Parse::ParseParams(Func *func)
     {
-        std::string name;
+        std::string_view name;
+        eTokenType type;
 
-//      GetToken(ttOpenParanthesis,name);       // (
-                                                // 脚本函数暂时不支持参数
-        GetToken(ttCloseParanthesis,name);      // )
+        if(GetToken(name)!=ttOpenParanthesis)
+            return(false);
+
+        type=GetToken(name);
+
+        if(type==ttCloseParanthesis)            //没有参数
+            return(true);
+
+        if(type==ttVoid
+         &&CheckToken(name)==ttCloseParanthesis)        // (void)
+        {
+            GetToken(name);
+            return(true);
+        }
+
+        while(true)
+        {
+            std::string_view param_name;
+
+            if(!GetValueSize(type)                                      //不是数据类型
+             ||GetToken(param_name)!=ttIdentifier
+             ||!func->AddParam(type,param_name))
+                return(false);
+
+            type=GetToken(name);
+
+            if(type==ttCloseParanthesis)
+                return(true);
+
+            if(type!=ttListSeparator)
+                return(false);
+
+            type=GetToken(name);
+        }
+    }
+
+    bool Parse::ParseFunc(Func *func)
+    {
+        cur_func=func;
+        arena=func->arena;
 
         if(!ParseCode(func))
             return(false);
 
-        for(int i=0;i<static_cast<int>(func->command.size());i++)
+        if(module->GetOptimize())
+            func->Optimize();
+
+        func->UpdateGotoFlag();
+        func->CompileBytecode();
+
+        return(true);
+    }
+
+    /**
+    * 跳过参数表之后的函数体，只做花括号匹配
+    * 函数体没有花括号时与ParseCode一样只有一句，但一句中可能含有else分支，所以取到下一个func之前
+    */
+    bool Parse::SkipFunc(std::string_view &body)
+    {
+        std::string_view name;
+        eTokenType type;
+
+        const uint32_t start=tokens[token_index].offset;
+        uint32_t end;
+
+        type=CheckToken(name);
+
+        if(type<=ttEnd)
+            return(false);
+
+        if(type==ttStartStatementBlock)
         {
-            Command *cmd=func->command[i].get();
-            if(!cmd)
-                continue;
+            int depth=0;
 
-            if(auto *goto_cmd=dynamic_cast<Goto *>(cmd))
-                goto_cmd->UpdateGotoFlag();
-            else
-            if(auto *comp_goto_cmd=dynamic_cast<CompGoto *>(cmd))
-                comp_goto_cmd->UpdateGotoFlag();
+            do
+            {
+                type=GetToken(name);
+
+                if(type==ttStartStatementBlock)
+                    ++depth;
+                else
+                if(type==ttEndStatementBlock)
+                    --depth;
+                else
+                if(type<=ttEnd)
+                    return(false);
+            }
+            while(depth);
+
+            end=static_cast<uint32_t>(name.data()+name.size()-source_start);
+        }
+        else
+        {
+            while(type!=ttFunc&&type>ttEnd)
+            {
+                GetToken(name);
+                type=CheckToken(name);
+            }
+
+            end=tokens[token_index].offset;
         }
 
+        body=std::string_view(source_start+start,end-start);
         return(true);
     }
 
     bool Parse::ParseCode(Func *func)
     {
-        std::string name;
+        std::string_view name;
         eTokenType type;
         bool ca;
         int StatmentCount;                  //花括号数量
@@ -288,7 +395,28 @@ namespace hgl::devil
 
             if(type==ttReturn)
             {
-                func->AddReturn();          //return
+                type=CheckToken(name);
+
+                if(type==ttEndStatement||type==ttEndStatementBlock)
+                {
+                    if(func->result_type!=ttVoid)
+                    {
+                        LogError("%s",("函数<"+func->func_name+">声明了返回类型，return必须带返回值").c_str());
+                        return(false);
+                    }
+
+                    func->AddReturn();          //return
+                }
+                else
+                {
+                    ValueInterface *value=ParseValue();     //return value
+
+                    if(!value||!func->AddReturnValue(value))
+                    {
+                        LogError("%s",("函数<"+func->func_name+">中return的返回值无法解析").c_str());
+                        return(false);
+                    }
+                }
 
                 continue;
             }
@@ -300,17 +428,39 @@ namespace hgl::devil
              ||type==ttInt64        ||type==ttUInt64
              ||type==ttFloat        ||type==ttDouble)
             {
-                ParseValue(func,type,name);         //解释变量定义
+                ParseValue(func,type);              //解释变量定义
 
                 continue;
             }
 
             if(type==ttIdentifier)              //未知标识
             {
-                std::string temp;
+                std::string_view temp;
 
                 type=GetToken(temp);
 
+                if(type==ttAssignment)          //等号,局部变量赋值
+                {
+                    ValueInterface *value=ParseValue();
+
+                    if(!value)
+                    {
+                        LogError("%s",("变量<"+std::string(name)+">的赋值式无法解析").c_str());
+                        return(false);
+                    }
+
+                    if(!func->HasValue(name))
+                    {
+                        LogWarning("%s",("赋值的目标不是局部变量: "+std::string(name)).c_str());
+                        continue;
+                    }
+
+                    if(!func->AddAssign(name,value,false))
+                        return(false);
+
+                    continue;
+                }
+                else
                 if(type==ttColon)               //冒号,Goto用标识
                 {
                     if(func->AddGotoFlag(name))
@@ -352,7 +502,7 @@ namespace hgl::devil
                                 }
                                 else
                                 {
-                                    const bool call=module->OnTrueFuncCall(name.c_str());
+                                    const bool call=module->OnTrueFuncCall(std::string(name).c_str());     //回调需要以0结尾的名字
 
                                     if(call)
                                         cmd->Run(nullptr);      //这里是解析器，为什么要执行一下 ？？
@@ -370,18 +520,24 @@ namespace hgl::devil
 
                     //脚本函数调用验证
                     {
-                        Func *script_func=module->GetScriptFunc(name);
+                        Func *script_func=FindScriptFunc(name);
 
                         if(script_func)
                         {
-                            func->AddScriptFuncCall(script_func);
+                            CallArg *arg;
+                            uint32_t arg_count;
+
+                            if(!ParseCallArgs(script_func,arg,arg_count))
+                                return(false);
+
+                            func->AddScriptFuncCall(script_func,arg,arg_count);
 
                             continue;
                         }
                     }
 
                     LogWarning("%s",
-                               ("脚本调用函数没有找到相应的真实函数映射与脚本函数: "+name).c_str());
+                               ("脚本调用函数没有找到相应的真实函数映射与脚本函数: "+std::string(name)).c_str());
 //                  return(false);      //错误也不退出，是为了把所有不支持的函数全列出来
                 }
             }
@@ -397,56 +553,72 @@ namespace hgl::devil
         return(true);
     }
 
-    template<typename T> bool ParseToNumber(T &result,const std::string &str);
+    template<typename T> bool ParseToNumber(T &result,std::string_view str)      //直接在源码上转换，不需要复制出以0结尾的字符串
+    {
+        const char *first=str.data();
+        const char *last=first+str.size();
 
-    template<> bool ParseToNumber<int>  (int &  result,const std::string &str){return hgl::stoi(str.c_str(), result);}
-    template<> bool ParseToNumber<uint> (uint & result,const std::string &str){return hgl::stou(str.c_str(), result);}
-    template<> bool ParseToNumber<float>(float &result,const std::string &str){return hgl::stof(str.c_str(), result);}
+        if constexpr(std::is_floating_point_v<T>)
+        {
+            return std::from_chars(first,last,result).ec==std::errc();      //"1.5f"之类的后缀会在f处停止
+        }
+        else
+        {
+            int base=10;
+
+            if(str.size()>2&&first[0]=='0'&&(first[1]=='x'||first[1]=='X'))     //十六进制
+            {
+                first+=2;
+                base=16;
+            }
+
+            return std::from_chars(first,last,result,base).ec==std::errc();
+        }
+    }
 
     template<typename T>
-    bool Parse::ParseNumber(T &result,const std::string &str)           //由于从程式理论上讲，调用这个函数时，都是因为测出str是数值的时候，所以不可能产生解析错误的情况。
+    bool Parse::ParseNumber(T &result,std::string_view str)            //由于从程式理论上讲，调用这个函数时，都是因为测出str是数值的时候，所以不可能产生解析错误的情况。
     {
         if(ParseToNumber<T>(result,str))
             return(true);
 
            LogError("%s",
-               ("解析数值\""+str+"\"失败!").c_str());
+               ("解析数值\""+std::string(str)+"\"失败!").c_str());
         return(false);
     }
 
     #ifdef _DEBUG
-    Command *Parse::ParseFuncCall(std::string &func_name,FuncMap *map,std::string &intro)
+    Command *Parse::ParseFuncCall(std::string_view func_name,FuncMap *map,std::string &intro)
     #else
     Command *Parse::ParseFuncCall(FuncMap *map)
     #endif//
     {
-        std::string name;
+        std::string_view name;
         eTokenType type;
 
         //按个数解晰参数
         int i=0,param_count=static_cast<int>(map->param.size());
         SystemFuncParam *param,*p;
 
-        #if HGL_CPU == HGL_CPU_X86_64
-        if(map->base)
-        {
-            param=new SystemFuncParam[param_count+1];
+        const bool this_param=map->ThisInParam();
+
+        param=arena->NewArray<SystemFuncParam>(param_count+(this_param?1:0));     //清零，小于8字节的参数不会留下未初始化的高位
 
-            param[0].void_pointer=map->base;            //x64下第一个参数放置this
+        if(this_param)
+        {
+            param[0].void_pointer=map->base;            //x64汇编呼叫时第一个参数放置this
 
             p=param+1;
         }
         else
         {
-            param=new SystemFuncParam[param_count];
-
             p=param;
         }
-        #endif//HGL_CPU == HGL_CPU_X86_64
 
         #ifdef _DEBUG
         //intro.Sprintf(u"%s(",func_name.c_str());
-        intro=func_name+"(";
+        intro.assign(func_name);
+        intro.push_back('(');
         #endif//
 
 
@@ -464,8 +636,12 @@ namespace hgl::devil
                                 if(type==ttFalse)           *(bool *)p=false;                   else
                                 if(type==ttIntConstant)
                                 {
-                                    if(!ParseNumber(*(int *)p,name))
+                                    int value;
+
+                                    if(!ParseNumber(value,name))
                                         break;
+
+                                    *(bool *)p=(value!=0);
                                 }
                                 else
                                     break;
@@ -480,7 +656,6 @@ namespace hgl::devil
                 case ttInt:
                 case ttInt8:
                 case ttInt16:
-//              case ttInt64:
                                 if(type==ttIntConstant
                                  ||type==ttFloatConstant
                                  ||type==ttDoubleConstant)
@@ -497,12 +672,29 @@ namespace hgl::devil
                                 if(i<param_count)intro.push_back(',');
                                 #endif//
 
+                                p++;
+                                continue;
+                case ttInt64:
+                                if(type==ttIntConstant
+                                 ||type==ttFloatConstant
+                                 ||type==ttDoubleConstant)
+                                {
+                                    if(!ParseNumber(*(int64 *)p,name))
+                                        break;
+                                }
+                                else
+                                    break;
+
+                                #ifdef _DEBUG
+                                intro+=std::to_string(*(int64 *)p);
+                                if(i<param_count)intro.push_back(',');
+                                #endif//
+
                                 p++;
                                 continue;
                 case ttUInt:
                 case ttUInt8:
                 case ttUInt16:
-//              case ttUInt64:
                                 if(type==ttIntConstant
                                  ||type==ttFloatConstant
                                  ||type==ttDoubleConstant)
@@ -519,10 +711,27 @@ namespace hgl::devil
                                 if(i<param_count)intro.push_back(',');
                                 #endif//
 
+                                p++;
+                                continue;
+                case ttUInt64:
+                                if(type==ttIntConstant
+                                 ||type==ttFloatConstant
+                                 ||type==ttDoubleConstant)
+                                {
+                                    if(!ParseNumber(*(uint64 *)p,name))
+                                        break;
+                                }
+                                else
+                                    break;
+
+                                #ifdef _DEBUG
+                                intro+=std::to_string(*(uint64 *)p);
+                                if(i<param_count)intro.push_back(',');
+                                #endif//
+
                                 p++;
                                 continue;
                 case ttFloat:
-//              case ttDouble:
                                 if(type==ttIntConstant
                                  ||type==ttFloatConstant
                                  ||type==ttDoubleConstant)
@@ -542,13 +751,31 @@ namespace hgl::devil
                                 p++;
                                 continue;
 
+                case ttDouble:
+                                if(type==ttIntConstant
+                                 ||type==ttFloatConstant
+                                 ||type==ttDoubleConstant)
+                                {
+                                    if(!ParseNumber(*(double *)p,name))
+                                        break;
+                                }
+                                else
+                                    break;
+
+                                #ifdef _DEBUG
+                                intro+=std::to_string(*(double *)p);
+                                if(i<param_count)intro.push_back(',');
+                                #endif//
+
+                                p++;
+                                continue;
+
                 case ttString:  if(type==ttStringConstant)
                                 {
                                     std::string str;
-                                    ConvertString(str,name.c_str()+1,static_cast<int>(name.size())-2);      //去掉两边的引号，并转换\t\n之类的数据
-                                    module->string_list.push_back(str);
+                                    ConvertString(str,name.substr(1,name.size()-2));      //去掉两边的引号，并转换\t\n之类的数据
 
-                                    *(char **)(p)=(char *)(module->string_list.back().c_str());
+                                    *(char **)(p)=const_cast<char *>(arena->CopyString(str).data());
 
                                     #ifdef _DEBUG
                                     intro+=name;
@@ -561,8 +788,6 @@ namespace hgl::devil
                                 break;
             }
 
-            delete[] param;
-
             #ifdef _DEBUG
             LogNotice("%s",
                       ("脚本中的参数和映射函数的格式要求不兼容！\n\t"+intro).c_str());
@@ -577,30 +802,69 @@ namespace hgl::devil
 //      if(CheckToken(name)==ttEndStatement)    //测试下一个是否分号
 //          GetToken(name);                     //取走分号
 
-        #if HGL_CPU == HGL_CPU_X86_64
-        if(map->base)param_count++;                 //如果是x64位下的C++函数，第一个参数放this指针
-        #endif//HGL_CPU == HGL_CPU_X86_64
-
-        if(map->result==ttVoid  )return(new SystemFuncCallFixed<void *     >(map,param,param_count));else
-
-        if(map->result==ttBool  )return(new SystemFuncCallFixed<bool       >(map,param,param_count));else
-        if(map->result==ttInt8  )return(new SystemFuncCallFixed<int8       >(map,param,param_count));else
-        if(map->result==ttInt16 )return(new SystemFuncCallFixed<int16      >(map,param,param_count));else
-        if(map->result==ttInt   )return(new SystemFuncCallFixed<int32      >(map,param,param_count));else
-        if(map->result==ttUInt8 )return(new SystemFuncCallFixed<uint8      >(map,param,param_count));else
-        if(map->result==ttUInt16)return(new SystemFuncCallFixed<uint16     >(map,param,param_count));else
-        if(map->result==ttUInt  )return(new SystemFuncCallFixed<uint32     >(map,param,param_count));else
-        if(map->result==ttFloat )return(new SystemFuncCallFixed<float      >(map,param,param_count));else
-        if(map->result==ttString)return(new SystemFuncCallFixed<char *    >(map,param,param_count));else
+        if(this_param)param_count++;                //x64汇编呼叫C++函数时，第一个参数放this指针
+
+        return CreateSystemFuncCall(*arena,map,param,param_count);
+    }
+
+    /**
+    * 解析脚本函数呼叫的参数，每个参数可以是任意的量，按被呼叫函数声明的参数类型转换
+    * @param callee 被呼叫的函数，参数表在声明时已确定
+    * @param arg 返回参数数组(位于Arena中)
+    * @param arg_count 返回参数个数
+    */
+    bool Parse::ParseCallArgs(Func *callee,CallArg *&arg,uint32_t &arg_count)
+    {
+        std::string_view name;
+        eTokenType type;
+
+        const uint32_t param_count=static_cast<uint32_t>(callee->param_list.size());
+
+        arg=arena->NewArray<CallArg>(param_count);
+        arg_count=0;
+
+        if(CheckToken(name)==ttCloseParanthesis)
+            GetToken(name);
+        else
+        while(true)
         {
-            delete[] param;
-            return(nullptr);
+            ValueInterface *value=ParseValue();
+
+            if(!value)
+                return(false);
+
+            if(arg_count>=param_count
+             ||!InitCallArg(arg[arg_count],callee->param_list[arg_count].type,value))
+            {
+                LogError("%s",
+                         ("呼叫脚本函数<"+callee->func_name+">的第"+std::to_string(arg_count+1)+"个参数与声明不符").c_str());
+                return(false);
+            }
+
+            ++arg_count;
+
+            type=GetToken(name);
+
+            if(type==ttCloseParanthesis)
+                break;
+
+            if(type!=ttListSeparator)
+                return(false);
+        }
+
+        if(arg_count!=param_count)
+        {
+            LogError("%s",
+                     ("呼叫脚本函数<"+callee->func_name+">的参数个数不正确，需要"+std::to_string(param_count)+"个").c_str());
+            return(false);
         }
+
+        return(true);
     }
 
     bool Parse::ParseIf(Func *func)
     {
-        std::string name;
+        std::string_view name;
         std::string flag;
         CompInterface *dci;
         CompGoto *dcg;
@@ -612,11 +876,8 @@ namespace hgl::devil
         if(!dci)
             return(false);
 
-        {
-            auto cmd=std::make_unique<CompGoto>(module,dci,func);
-            dcg=cmd.get();
-            func->command.emplace_back(std::move(cmd));                                        //增加比较跳转控制
-        }
+        dcg=arena->New<CompGoto>(module,dci,func);
+        func->AddCommand(dcg);                                                                      //增加比较跳转控制
 
         LogInfo("%s",("if "+flag).c_str());
 
@@ -628,23 +889,23 @@ namespace hgl::devil
 
             GetToken(ttElse,name);
 
-            dcg->else_flag=flag+"_else";                                                            //设置比较else的话跳到else段
+            dcg->else_flag=arena->CopyString(flag+"_else");                                                            //设置比较else的话跳到else段
 
-            func->AddGotoFlag(flag+"_else");                                                        //增加else段跳转旗标
+            func->AddGotoFlag(flag+"_else",true);                                                   //增加else段跳转旗标
 
             ParseCode(func);                                                                        //解析 else 段
         }
         else
-            dcg->else_flag=flag+"_end";                                                             //设置比较else的话直接跳到最后
+            dcg->else_flag=arena->CopyString(flag+"_end");                                                             //设置比较else的话直接跳到最后
 
-        func->AddGotoFlag(flag+"_end");                                                             //增加结束跳转用旗标
+        func->AddGotoFlag(flag+"_end",true);                                                        //增加结束跳转用旗标
 
         return(true);
     }
 
     CompInterface *Parse::ParseComp()
     {
-        std::string name;
+        std::string_view name;
         int comp;
         ValueInterface *left,*right;
 
@@ -658,65 +919,25 @@ namespace hgl::devil
         //解析比较符号
         comp=ParseCompType();
         if(comp==ttUnrecognizedToken)       //未知
-        {
-            delete left;
             return(nullptr);
-        }
         else
         if(comp==ttCloseParanthesis)        //右括号
-        {
-            //暂时不支持
-            delete left;
-            return(nullptr);
-        }
+            return(nullptr);                //暂时不支持
 
         //解析比较式右边
         right=ParseValue();
 
         if(!right)
-        {
-            delete left;
             return(nullptr);
-        }
 
         GetToken(ttCloseParanthesis,name);      // )
 
         //创建比较指令
         {
-            CompInterface *dci=nullptr;
-
-            #define DEVIL_COMP_FLAG(flag,func,_lt,_rt)  case flag:dci=new func<_lt,_rt>(left,right);break;
-
-            #define DEVIL_COMP_CREATE(lt,_lt,rt,_rt)    if((left->type==lt)&&(right->type==rt)) \
-                                                            switch(comp)    \
-                                                            {   \
-                                                                DEVIL_COMP_FLAG(ttEqual             ,CompEqu       ,_lt,_rt)   \
-                                                                DEVIL_COMP_FLAG(ttNotEqual          ,CompNotEqu    ,_lt,_rt)   \
-                                                                DEVIL_COMP_FLAG(ttLessThan          ,CompLess      ,_lt,_rt)   \
-                                                                DEVIL_COMP_FLAG(ttGreaterThan       ,CompGreater   ,_lt,_rt)   \
-                                                                DEVIL_COMP_FLAG(ttLessThanOrEqual   ,CompLessEqu   ,_lt,_rt)   \
-                                                                DEVIL_COMP_FLAG(ttGreaterThanOrEqual,CompGreaterEqu,_lt,_rt)   \
-                                                            };
-
-            #define DEVIL_COMP_ARRAY(lt,_lt)    DEVIL_COMP_CREATE(lt,_lt,ttBool,    bool);  \
-                                                DEVIL_COMP_CREATE(lt,_lt,ttInt,     int);   \
-                                                DEVIL_COMP_CREATE(lt,_lt,ttUInt,    uint);  \
-                                                DEVIL_COMP_CREATE(lt,_lt,ttFloat,   float); \
-                                                DEVIL_COMP_CREATE(lt,_lt,ttDouble,  double);\
-                                                DEVIL_COMP_CREATE(lt,_lt,ttInt64,   int64); \
-                                                DEVIL_COMP_CREATE(lt,_lt,ttUInt64,  uint64);\
-
-            DEVIL_COMP_ARRAY(ttBool,    bool    )
-            DEVIL_COMP_ARRAY(ttInt,     int     )
-            DEVIL_COMP_ARRAY(ttUInt,    uint    )
-            DEVIL_COMP_ARRAY(ttFloat,   float   )
-            DEVIL_COMP_ARRAY(ttDouble,  float   )
-            DEVIL_COMP_ARRAY(ttInt64,   int64   )
-            DEVIL_COMP_ARRAY(ttUInt64,  uint64  )
-
-            #undef DEVIL_COMP_ARRAY
-            #undef DEVIL_COMP_FLAG
-            #undef DEVIL_COMP_CREATE
+            CompInterface *dci=CreateComp(*arena,eTokenType(comp),left,right);
+
+            if(!dci)
+                LogError("%s","if 比较式两边的数据类型无法比较");
 
             return(dci);
         }
@@ -725,7 +946,7 @@ namespace hgl::devil
     ValueInterface *Parse::ParseValue()
     {
         int type;
-        std::string name,temp;
+        std::string_view name,temp;
 
         ValueInterface *dcii=nullptr;
 
@@ -742,7 +963,7 @@ namespace hgl::devil
 
                     if(map_func)
                     {
-                        GetToken(ttOpenParanthesis,name);   //取出 (
+                        GetToken(ttOpenParanthesis,temp);   //取出 (
 
                         #ifdef _DEBUG
                         std::string intro;
@@ -754,76 +975,76 @@ namespace hgl::devil
 
                         if(cmd)
                         {
-                            switch(map_func->result)
-                            {
-                                case ttBool:    dcii=new ValueFuncMap<bool     >(module,cmd,ttBool     );break;
-
-                                case ttInt8:    dcii=new ValueFuncMap<int8     >(module,cmd,ttInt8     );break;
-                                case ttInt16:   dcii=new ValueFuncMap<int16    >(module,cmd,ttInt16    );break;
-                                case ttInt:     dcii=new ValueFuncMap<int32    >(module,cmd,ttInt      );break;
-
-                                case ttUInt8:   dcii=new ValueFuncMap<uint8    >(module,cmd,ttUInt8    );break;
-                                case ttUInt16:  dcii=new ValueFuncMap<uint16   >(module,cmd,ttUInt16   );break;
-                                case ttUInt:    dcii=new ValueFuncMap<uint32   >(module,cmd,ttUInt     );break;
+                            dcii=CreateFuncMapValue(*arena,module,map_func,cmd);
 
-                                case ttFloat:   dcii=new ValueFuncMap<float    >(module,cmd,ttFloat    );break;
-
-                                case ttString:  dcii=new ValueFuncMap<char *>(module,cmd,ttString   );break;
-
-                                default:        LogError("%s","if中调用的函数返回类型无法支持");break;
-                            }
+                            if(!dcii)
+                                LogError("%s","if中调用的函数返回类型无法支持");
                         }
                         else
                             LogError("%s","if中的真实函数映射没有找到");
+
+                        return(dcii);
                     }
                 }
 
                 //脚本函数调用验证
-/*              {
-                    Func *script_func=module->GetScriptFunc(name);
+                {
+                    Func *script_func=FindScriptFunc(name);
 
-                    if(script_func)
+                    if(!script_func)
                     {
-                        func->command.emplace_back(std::make_unique<ScriptFuncCall>(module,script_func));
-                        return(true);
+                        LogError("%s",("脚本调用函数没有找到相应的真实函数映射与脚本函数: "+std::string(name)).c_str());
+                        return(nullptr);
+                    }
+
+                    if(script_func->result_type==ttVoid)
+                    {
+                        LogError("%s",("脚本函数<"+script_func->func_name+">没有返回值，不能作为量使用").c_str());
+                        return(nullptr);
                     }
-                }
 
-                ErrorHint(u"脚本调用函数没有找到相应的真实函数映射与脚本函数<%s>",name.c_str());*/
+                    GetToken(ttOpenParanthesis,temp);   //取出 (
+
+                    CallArg *arg;
+                    uint32_t arg_count;
+
+                    if(!ParseCallArgs(script_func,arg,arg_count))
+                        return(nullptr);
+
+                    dcii=CreateScriptCallValue(*arena,module,script_func,arg,arg_count);
+
+                    if(dcii&&cur_func)
+                        cur_func->value_call_list.push_back(script_func);
+                }
             }
-            else    //属性映射
+            else    //局部变量或属性映射
             {
-                PropertyMap *dpm=module->GetPropertyMap(name);
-
-                if(dpm)
+                if(cur_func)
                 {
-                    switch(dpm->type)
-                    {
-                        case ttBool:    dcii=new ValueProperty<bool    >(module,dpm,ttBool);break;
+                    dcii=cur_func->CreateValue(name);
 
-                        case ttInt8:    dcii=new ValueProperty<int8    >(module,dpm,ttInt8);break;
-                        case ttInt16:   dcii=new ValueProperty<int16   >(module,dpm,ttInt16);break;
-                        case ttInt:     dcii=new ValueProperty<int32   >(module,dpm,ttInt);break;
-                        //case ttInt64: dcii=new ValueProperty<int64   >(module,dpm,ttInt64);break;
+                    if(dcii)
+                        return(dcii);
+                }
 
-                        case ttUInt8:   dcii=new ValueProperty<uint8   >(module,dpm,ttUInt8);break;
-                        case ttUInt16:  dcii=new ValueProperty<uint16  >(module,dpm,ttUInt16);break;
-                        case ttUInt:    dcii=new ValueProperty<uint32  >(module,dpm,ttUInt);break;
-                        //case ttUInt64:    dcii=new ValueProperty<uint64  >(module,dpm,ttUInt64);break;
+                PropertyMap *dpm=module->GetPropertyMap(name);
 
-                        case ttFloat:   dcii=new ValueProperty<float   >(module,dpm,ttFloat);break;
-                        //case ttDouble:    dcii=new ValueProperty<double  >(module,dpm,ttDouble);break;
+                if(dpm)
+                {
+                    dcii=CreatePropertyValue(*arena,module,dpm);
 
-                        default:LogError("%s",
-                                         ("if 比较指令暂时不支持<"+std::string(GetTokenName(dpm->type))
-                                          +">类型的数据进行比较").c_str());
-                                return(nullptr);
+                    if(!dcii)
+                    {
+                        LogError("%s",
+                                 ("if 比较指令暂时不支持<"+std::string(GetTokenName(dpm->type))
+                                  +">类型的数据进行比较").c_str());
+                        return(nullptr);
                     }
                 }
                 else
                 {
                     LogError("%s",
-                             ("没有找到属性映射:"+name).c_str());
+                             ("没有找到属性映射:"+std::string(name)).c_str());
                     return(nullptr);
                 }
             }
@@ -831,45 +1052,79 @@ namespace hgl::devil
         else
         if(type==ttTrue||type==ttFalse) //布尔型
         {
-            dcii=new ValueBool(module,name.c_str());
+            dcii=arena->New<ValueBool>(module,type==ttTrue);
         }
         else
-        if(type==ttIntConstant)         //整数
+        if(type==ttIntConstant)         //整数，超出uint范围时使用uint64
         {
-            dcii=new ValueUInteger(module,name.c_str());
+            uint64 value;
+
+            if(!ParseNumber(value,name))
+                return(nullptr);
+
+            if(value>UINT32_MAX)
+                dcii=arena->New<ValueUInt64>(module,value);
+            else
+                dcii=arena->New<ValueUInteger>(module,static_cast<uint>(value));
         }
         else
         if(type==ttFloatConstant)       //浮点数
         {
-            dcii=new ValueFloat(module,name.c_str());
+            float value;
+
+            if(!ParseNumber(value,name))
+                return(nullptr);
+
+            dcii=arena->New<ValueFloat>(module,value);
         }
         else
         if(type==ttDoubleConstant)      //浮点数
         {
-            dcii=new ValueDouble(module,name.c_str());
+            double value;
+
+            if(!ParseNumber(value,name))
+                return(nullptr);
+
+            dcii=arena->New<ValueDouble>(module,value);
         }
         else
-        if(type==ttMinus)               // -号
+        if(type==ttMinus)               // -号，数值部分按正数解析后再取负
         {
             type=GetToken(name);
 
-            std::string str;
-            str.push_back('-');
-            str+=name;
-
-            if(type==ttIntConstant)         //整数
+            if(type==ttIntConstant)         //整数，超出int范围时使用int64
             {
-                dcii=new ValueInteger(module,str.c_str());
+                uint64 value;
+
+                if(!ParseNumber(value,name))
+                    return(nullptr);
+
+                const int64 negative=static_cast<int64>(0-value);
+
+                if(value>uint64(INT32_MAX)+1)
+                    dcii=arena->New<ValueInt64>(module,negative);
+                else
+                    dcii=arena->New<ValueInteger>(module,static_cast<int>(negative));
             }
             else
             if(type==ttFloatConstant)       //浮点数
             {
-                dcii=new ValueFloat(module,str.c_str());
+                float value;
+
+                if(!ParseNumber(value,name))
+                    return(nullptr);
+
+                dcii=arena->New<ValueFloat>(module,-value);
             }
             else
             if(type==ttDoubleConstant)      //浮点数
             {
-                dcii=new ValueDouble(module,str.c_str());
+                double value;
+
+                if(!ParseNumber(value,name))
+                    return(nullptr);
+
+                dcii=arena->New<ValueDouble>(module,-value);
             }
         }
 
@@ -879,7 +1134,7 @@ namespace hgl::devil
     eTokenType Parse::ParseCompType()
     {
         eTokenType type;
-        std::string name;
+        std::string_view name;
 
         type=GetToken(name);
 
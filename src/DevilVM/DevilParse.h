@@ -1,8 +1,10 @@
 ﻿#pragma once
 
-#include"as_tokenizer.h"
+#include"DevilLexer.h"
 #include"DevilFunc.h"
+#include <mutex>
 #include <string>
+#include <string_view>
 #include<hgl/platform/compiler/EventFunc.h>
 #include<hgl/log/Log.h>
 
@@ -16,30 +18,38 @@ namespace hgl::devil
 
         Module * module;
 
+        Func *              cur_func;                                                           //正在解析的函数
+        Arena *             arena;                                                              //正在解析的函数体所在的Arena
+
         const char *        source_start;
 
-        const char *        source_cur;
-        uint                source_length;
+        TokenList           token_list;                                                         //整段源码预先切分好的token
+        const LexToken *    tokens;                                                             //使用中的token，可能借用自另一个Parse
+        size_t              token_index;                                                        //下一个要取出的token
 
-        asCTokenizer        parse;
+        const StringMap<Func *> *   declared_func;                                              //本次编译中已声明的脚本函数，先于模块中的函数查找
+        std::mutex *                module_lock;                                                //多线程编译时查找模块中脚本函数所用的锁
 
     private:
 
         bool                    ParseCode(Func *);                                             //解析一段代码
 
         template<typename T>
-        bool                    ParseNumber(T &,const std::string &);
+        bool                    ParseNumber(T &,std::string_view);
 
-        ValueInterface *        ParseValue();                                                       //解析一个量(属性/数值/真实函数调用)
-        void                    ParseValue(Func *,eTokenType,std::string &);
+        ValueInterface *        ParseValue();                                                       //解析一个量(局部变量/属性/数值/真实函数调用)
+        void                    ParseValue(Func *,eTokenType);
         void                    ParseEnum();
 
         #ifdef _DEBUG
-        Command *               ParseFuncCall(std::string &,FuncMap *,std::string &);
+        Command *               ParseFuncCall(std::string_view,FuncMap *,std::string &);
         #else
         Command *               ParseFuncCall(FuncMap *);
         #endif//
         bool                    ParseIf(Func *);
+        bool                    ParseCallArgs(Func *,CallArg *&,uint32_t &);                        //解析脚本函数呼叫的参数，左括号已取出
+
+        Func *                  FindScriptFunc(std::string_view);
 
         CompInterface *         ParseComp();
         eTokenType              ParseCompType();
@@ -47,12 +57,22 @@ namespace hgl::devil
     public:
 
         Parse(Module *,const char *,int=-1);
+        Parse(const Parse &,size_t);                                                            //借用另一个Parse已切分好的token，从指定位置开始解析
+
+        Parse(const Parse &)=delete;
+        Parse &operator=(const Parse &)=delete;
+
+        size_t GetTokenIndex()const{return token_index;}
+
+        void SetScope(const StringMap<Func *> *,std::mutex *);                                 //设置多个函数同时编译时的查找范围
 
-        eTokenType GetToken(std::string &);     //取得一个token,自动跳过注释、换行、空格
-        eTokenType CheckToken(std::string &);   //检测下一个token,自动跳过注释、换行、空格,但不取出
+        eTokenType GetToken(std::string_view &);    //取得一个token(注释、换行、空格在切分时已跳过)。返回的文本指向源码，源码有效期间一直可用
+        eTokenType CheckToken(std::string_view &);  //检测下一个token,但不取出
 
-        bool GetToken(eTokenType,std::string &);    //找某一种Token为止
+        bool GetToken(eTokenType,std::string_view &);   //找某一种Token为止
 
-        bool ParseFunc(Func *);        //解析一个函数
+        bool ParseParams(Func *);      //解析函数的参数表
+        bool ParseFunc(Func *);        //解析一个函数(参数表之后的函数体)
+        bool SkipFunc(std::string_view &);     //不解析，跳过一个函数体，取得函数体的源码
     };
 }//namespace hgl::devil
\ No newline at end of file
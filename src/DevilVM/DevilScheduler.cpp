@@ -0,0 +1,212 @@
+#include <hgl/devil/DevilScheduler.h>
+#include <hgl/devil/DevilContext.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <thread>
+
+namespace hgl::devil
+{
+    struct Scheduler::Worker
+    {
+        std::mutex          lock;
+        std::deque<Context *> queue;                                    //本线程待运行的Context，自己从尾部取，窃取者从头部取
+
+        std::thread         thread;
+    };//struct Scheduler::Worker
+
+    Scheduler::Scheduler(int thread_count,uint64_t s)
+    {
+        slice=(s?s:1);
+        tick_serial=0;
+        busy_workers=0;
+        quit=false;
+
+        if(thread_count<=0)
+            thread_count=std::max(1u,std::thread::hardware_concurrency());
+
+        worker_list.reserve(thread_count);
+
+        for(int i=0;i<thread_count;i++)
+            worker_list.push_back(std::make_unique<Worker>());
+
+        for(int i=0;i<thread_count;i++)
+            worker_list[i]->thread=std::thread(&Scheduler::WorkerProc,this,i);
+    }
+
+    Scheduler::~Scheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lk(tick_lock);
+            quit=true;
+        }
+
+        tick_start.notify_all();
+
+        for(auto &w:worker_list)
+            if(w->thread.joinable())
+                w->thread.join();
+    }
+
+    bool Scheduler::Add(Context *context)
+    {
+        if(!context)
+            return(false);
+
+        if(std::find(context_list.begin(),context_list.end(),context)!=context_list.end())
+            return(false);
+
+        context_list.push_back(context);
+        return(true);
+    }
+
+    bool Scheduler::Remove(Context *context)
+    {
+        const auto it=std::find(context_list.begin(),context_list.end(),context);
+
+        if(it==context_list.end())
+            return(false);
+
+        context_list.erase(it);
+        return(true);
+    }
+
+    void Scheduler::Clear()
+    {
+        context_list.clear();
+    }
+
+    bool Scheduler::PopLocal(int id,Context *&context)
+    {
+        Worker *w=worker_list[id].get();
+
+        std::lock_guard<std::mutex> lk(w->lock);
+
+        if(w->queue.empty())
+            return(false);
+
+        context=w->queue.back();
+        w->queue.pop_back();
+        return(true);
+    }
+
+    bool Scheduler::Steal(int id,Context *&context)
+    {
+        const int count=static_cast<int>(worker_list.size());
+
+        for(int i=1;i<count;i++)
+        {
+            Worker *w=worker_list[(id+i)%count].get();
+
+            std::lock_guard<std::mutex> lk(w->lock);
+
+            if(w->queue.empty())
+                continue;
+
+            context=w->queue.front();
+            w->queue.pop_front();
+            return(true);
+        }
+
+        return(false);
+    }
+
+    void Scheduler::RunWorker(int id,SchedulerStats &local)
+    {
+        Context *context;
+
+        while(true)
+        {
+            if(!PopLocal(id,context))
+            {
+                if(!Steal(id,context))              //所有队列都空了，本次tick结束(tick期间队列只减不增)
+                    return;
+
+                ++local.steals;
+            }
+
+            const VMState state=context->GetState();
+
+            if(state==dvsStop)
+                continue;
+
+            if(state==dvsPause&&!context->IsBudgetExhausted())      //被宿主暂停
+                continue;
+
+            if(!context->RunFor(slice))
+                ++local.errors;
+
+            ++local.contexts;
+            local.instructions+=context->GetRetiredCount();
+
+            if(context->GetState()==dvsStop)
+                ++local.finished;
+        }
+    }
+
+    void Scheduler::WorkerProc(int id)
+    {
+        uint64_t serial=0;
+
+        while(true)
+        {
+            {
+                std::unique_lock<std::mutex> lk(tick_lock);
+
+                tick_start.wait(lk,[&]{return quit||tick_serial!=serial;});
+
+                if(quit)
+                    return;
+
+                serial=tick_serial;
+            }
+
+            SchedulerStats local;
+
+            RunWorker(id,local);
+
+            {
+                std::lock_guard<std::mutex> lk(tick_lock);
+
+                stats.contexts      +=local.contexts;
+                stats.instructions  +=local.instructions;
+                stats.finished      +=local.finished;
+                stats.errors        +=local.errors;
+                stats.steals        +=local.steals;
+
+                if(--busy_workers==0)
+                    tick_done.notify_one();
+            }
+        }
+    }
+
+    const SchedulerStats &Scheduler::Tick()
+    {
+        const int count=static_cast<int>(worker_list.size());
+
+        for(size_t i=0;i<context_list.size();i++)                       //轮流分配到各线程队列
+        {
+            Worker *w=worker_list[i%count].get();
+
+            std::lock_guard<std::mutex> lk(w->lock);
+            w->queue.push_back(context_list[i]);
+        }
+
+        const auto start=std::chrono::steady_clock::now();
+
+        {
+            std::unique_lock<std::mutex> lk(tick_lock);
+
+            stats=SchedulerStats();
+            busy_workers=count;
+            ++tick_serial;
+
+            tick_start.notify_all();
+            tick_done.wait(lk,[&]{return busy_workers==0;});
+        }
+
+        stats.seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+        return stats;
+    }
+}//namespace hgl::devil
@@ -46,6 +46,151 @@
 
 namespace angle_script
 {
+    namespace
+    {
+        // Perfect hash over tokenWords, built at compile time.
+        // The seed is searched until every word lands in its own slot, so a
+        // lookup is one hash, one table read and one compare.
+
+        constexpr hgl::uint keyWordTableSize = 2048;            // must be a power of two, large enough for a seed to be found quickly
+
+        constexpr hgl::uint WordLength(const char *word)
+        {
+            hgl::uint n = 0;
+            while( word[n] ) n++;
+            return n;
+        }
+
+        constexpr hgl::uint32 HashWord(const char *word, hgl::uint length, hgl::uint32 seed)
+        {
+            hgl::uint32 h = 2166136261u ^ seed;                  // FNV-1a
+
+            for( hgl::uint n = 0; n < length; n++ )
+            {
+                h ^= static_cast<unsigned char>(word[n]);
+                h *= 16777619u;
+            }
+
+            return (h ^ (h >> 15)) & (keyWordTableSize - 1);
+        }
+
+        constexpr bool IsWordChar(char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+        }
+
+        struct KeyWordTable
+        {
+            hgl::uint32     seed;
+            hgl::uint8      slot[keyWordTableSize];             // index+1 into tokenWords, 0 = empty
+            hgl::uint8      length[numTokenWords];
+            hgl::uint       maxWordLength;                      // longest identifier-like keyword
+            hgl::uint       maxOperatorLength;                  // longest operator
+            bool            operatorChar[256];                  // characters used by operators
+        };
+
+        constexpr bool HasDuplicateWord()
+        {
+            for( int i = 0; i < numTokenWords; i++ )
+                for( int j = i + 1; j < numTokenWords; j++ )
+                {
+                    const hgl::uint len = WordLength(tokenWords[i].word);
+
+                    if( len != WordLength(tokenWords[j].word) )
+                        continue;
+
+                    bool same = true;
+                    for( hgl::uint n = 0; n < len && same; n++ )
+                        same = (tokenWords[i].word[n] == tokenWords[j].word[n]);
+
+                    if( same ) return true;
+                }
+
+            return false;
+        }
+
+        constexpr KeyWordTable BuildKeyWordTable()
+        {
+            KeyWordTable table{};
+
+            for( int i = 0; i < numTokenWords; i++ )
+            {
+                const hgl::uint len = WordLength(tokenWords[i].word);
+
+                table.length[i] = static_cast<hgl::uint8>(len);
+
+                if( IsWordChar(tokenWords[i].word[0]) )
+                {
+                    if( len > table.maxWordLength ) table.maxWordLength = len;
+                }
+                else
+                {
+                    if( len > table.maxOperatorLength ) table.maxOperatorLength = len;
+
+                    for( hgl::uint n = 0; n < len; n++ )
+                        table.operatorChar[static_cast<unsigned char>(tokenWords[i].word[n])] = true;
+                }
+            }
+
+            for( hgl::uint32 seed = 0; ; seed++ )
+            {
+                for( hgl::uint n = 0; n < keyWordTableSize; n++ )
+                    table.slot[n] = 0;
+
+                bool ok = true;
+
+                for( int i = 0; i < numTokenWords && ok; i++ )
+                {
+                    const hgl::uint32 h = HashWord(tokenWords[i].word, table.length[i], seed);
+
+                    if( table.slot[h] )
+                        ok = false;
+                    else
+                        table.slot[h] = static_cast<hgl::uint8>(i + 1);
+                }
+
+                if( ok )
+                {
+                    table.seed = seed;
+                    return table;
+                }
+            }
+        }
+
+        static_assert(numTokenWords < 255, "tokenWords does not fit in the 8-bit keyword table");
+        static_assert(!HasDuplicateWord(), "tokenWords contains the same word twice");
+
+        constexpr KeyWordTable keyWordTable = BuildKeyWordTable();
+
+        const sTokenWord *FindTokenWord(const char *source, hgl::uint length)
+        {
+            const hgl::uint8 index = keyWordTable.slot[HashWord(source, length, keyWordTable.seed)];
+
+            if( !index || keyWordTable.length[index - 1] != length )
+                return nullptr;
+
+            const sTokenWord *tw = tokenWords + index - 1;
+
+            if( memcmp(tw->word, source, length) != 0 )
+                return nullptr;
+
+            return tw;
+        }
+    }//namespace
+
+    eTokenType GetWordTokenType(const char *word, hgl::uint length)
+    {
+        if( length <= keyWordTable.maxWordLength )
+        {
+            const sTokenWord *tw = FindTokenWord(word, length);
+
+            if( tw )
+                return tw->tokenType;
+        }
+
+        return ttIdentifier;
+    }
+
     asCTokenizer::asCTokenizer()
     {
     }
@@ -359,19 +504,8 @@ namespace angle_script
                     break;
             }
 
-            // Make sure the identifier isn't a reserved keyword
-            if( tokenLength > 50 ) return true;
-
-            char test[51];
-            memcpy(test, source, tokenLength*sizeof(char));
-            test[tokenLength] = 0;
-
-            for( hgl::uint i = 0; i < numTokenWords; i++ )
-            {
-                //if( strcmp(test, tokenWords[i].word) == 0 )
-                if( strcmp(test, tokenWords[i].word) == 0 )
-                    return false;
-            }
+            // A reserved keyword is returned directly as its own token
+            tokenType = GetWordTokenType(source, tokenLength);
 
             return true;
         }
@@ -381,72 +515,29 @@ namespace angle_script
 
     bool asCTokenizer::IsKeyWord()
     {
-        // Fill the list with all possible keywords
-        // Check each character against all the keywords in the list,
-        // remove keywords that don't match. When only one remains and
-        // it matches the source completely we have found a match.
-        int words[numTokenWords];
-        hgl::uint n;
-        for( n = 0; n < numTokenWords; n++ )
-            words[n] = n;
+        // Only operators get here, identifier-like keywords are found by
+        // IsIdentifier(). Try the longest possible operator first so that
+        // ">>=" wins over ">>" and ">". An operator only consists of operator
+        // characters, so there is no need to try past the first other one.
+        const hgl::uint limit = sourceLength < keyWordTable.maxOperatorLength ? sourceLength : keyWordTable.maxOperatorLength;
 
-        int numWords = numTokenWords;
-        int lastPossible = -1;
+        hgl::uint n = 0;
 
-        n = 0;
-        while( n < sourceLength && numWords >= 0 )
-        {
-            for( int i = 0; i < numWords; i++ )
-            {
-                if( tokenWords[words[i]].word[n] == '\0' )
-                {
-                    if( numWords > 1 )
-                    {
-                        lastPossible = words[i];
-                        words[i--] = words[--numWords];
-                        continue;
-                    }
-                    else
-                    {
-                        tokenType = tokenWords[words[i]].tokenType;
-                        tokenLength = n;
-                        return true;
-                    }
-                }
-
-                if( tokenWords[words[i]].word[n] != source[n] )
-                {
-                    words[i--] = words[--numWords];
-                }
-            }
+        while( n < limit && keyWordTable.operatorChar[static_cast<unsigned char>(source[n])] )
             n++;
-        }
 
-        // The source length ended or there where no more matchable words
-        if( numWords )
+        for( ; n > 0; n-- )
         {
-            // If any of the tokenWords also end at this
-            // position then we have found the matching token
-            for( int i = 0; i < numWords; i++ )
+            const sTokenWord *tw = FindTokenWord(source, n);
+
+            if( tw )
             {
-                if( tokenWords[words[i]].word[n] == '\0' )
-                {
-                    tokenType = tokenWords[words[i]].tokenType;
-                    tokenLength = n;
-                    return true;
-                }
+                tokenType = tw->tokenType;
+                tokenLength = n;
+                return true;
             }
         }
 
-        // It is still possible that a shorter token was found
-        if( lastPossible > -1 )
-        {
-            tokenType = tokenWords[lastPossible].tokenType;
-            //tokenLength = strlen(tokenWords[lastPossible].word);
-            tokenLength = strlen(tokenWords[lastPossible].word);
-            return true;
-        }
-
         return false;
     }
 }
@@ -51,6 +51,9 @@ namespace angle_script
 
    const char *GetTokenName(eTokenType);
 
+   // Returns the keyword token for an identifier-like word, or ttIdentifier
+   eTokenType GetWordTokenType(const char *word, hgl::uint length);
+
     class asCTokenizer
     {
     public: